@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <filesystem>
+#include <chrono>
+
+#include <networking.hpp>
+
+namespace uva
+{
+    namespace networking
+    {
+        namespace web_application
+        {
+            /// @brief A file packed into the binary by add_web_app(... EMBED_ASSETS). Generated archives are sorted by path.
+            struct embedded_asset
+            {
+                /* relative to app/, with '/' separators: "styles/uva.css" */
+                std::string_view path;
+                std::string_view content;
+                content_type type;
+                std::string_view etag;
+                std::string_view last_modified;
+            };
+            struct static_asset
+            {
+                /* nullptr for files of at least file_body_threshold bytes, which are sent from the file, and for embedded assets */
+                std::shared_ptr<const std::string> content;
+                /* embedded assets: the bytes in the binary */
+                std::string_view static_content;
+                std::filesystem::path path;
+                size_t size = 0;
+                content_type type;
+                /* strong validator, quoted: "0123456789abcdef" */
+                std::string etag;
+                /* HTTP-date of the file modification time */
+                std::string last_modified;
+                std::filesystem::file_time_type write_time;
+                /* the file with a .gz appended, compressed at build time, for compressible types */
+                std::shared_ptr<const static_asset> gzip;
+            };
+            /// @brief Registers an archive generated by add_web_app. Called by the generated code during static initialization.
+            /// Once an archive is registered, asset caches serve only embedded assets and never touch the disk.
+            bool register_embedded_assets(const embedded_asset* assets, size_t count);
+            /// @brief In-memory cache for the files under a root folder, with a memory budget and LRU eviction.
+            /// An entry is revalidated against the file modification time at most once per revalidate_interval.
+            /// Files of at least file_body_threshold bytes are never read, only their validators are kept.
+            class basic_asset_cache
+            {
+            public:
+                basic_asset_cache(std::filesystem::path __root, size_t __memory_budget, size_t __file_body_threshold = SIZE_MAX);
+            public:
+                static constexpr std::chrono::seconds revalidate_interval = std::chrono::seconds(1);
+            private:
+                struct entry
+                {
+                    std::shared_ptr<const static_asset> asset;
+                    std::list<std::string>::iterator lru_position;
+                    std::chrono::steady_clock::time_point checked_at;
+                };
+                std::filesystem::path m_root;
+                size_t m_memory_budget;
+                size_t m_file_body_threshold;
+                size_t m_memory_usage = 0;
+
+                /* built once by build_manifest, read only afterwards. "styles/uva.css" <-> "/styles/uva-0123456789abcdef.css" */
+                std::unordered_map<std::string, std::string> m_fingerprinted_urls;
+                std::unordered_map<std::string, std::string> m_fingerprinted_paths;
+
+                std::mutex m_mutex;
+                /* most recently used first */
+                std::list<std::string> m_lru;
+                std::unordered_map<std::string, entry> m_entries;
+            public:
+                /// @brief Returns the asset for an url path, like "/styles/uva.css", or nullptr if there is no such file.
+                /// Paths leaving the root (with '..') are never served.
+                std::shared_ptr<const static_asset> find(std::string_view url);
+                size_t memory_usage();
+                void set_memory_budget(size_t budget);
+
+                /// @brief Maps every asset (but views) to an url with its content hash. Must be called before serving, and the assets
+                /// should not change afterwards, since fingerprinted urls are cached by browsers forever.
+                void build_manifest();
+                /// @brief The fingerprinted url of a logical path, like "styles/uva.css", or an empty string if it is not in the manifest.
+                std::string_view fingerprinted_url(std::string_view path) const;
+                /// @brief Returns the asset for a fingerprinted url, or nullptr if url is not one.
+                std::shared_ptr<const static_asset> find_fingerprinted(std::string_view url);
+            private:
+                std::shared_ptr<const static_asset> load(const std::filesystem::path& path, std::error_code& ec);
+                std::shared_ptr<static_asset> load_file(const std::filesystem::path& path, std::error_code& ec);
+                std::shared_ptr<const static_asset> find_embedded(std::string_view path) const;
+                void add_to_manifest(const std::string& path, const static_asset& asset);
+                void erase(std::unordered_map<std::string, entry>::iterator it);
+                void evict();
+            };
+            /// @brief Makes the asset the body of response, without copying it.
+            void set_asset_body(http_message& response, const static_asset& asset);
+            /// @brief Makes response the asset, or an empty 304 response if the validators in request match it.
+            void respond_with_asset(const http_message& request, http_message& response, std::shared_ptr<const static_asset> asset);
+            /// @brief Strong ETag for content.
+            std::string make_etag(std::string_view content);
+            /// @brief The HTTP-date of a file modification time.
+            std::string http_date(std::filesystem::file_time_type write_time);
+        }; // namespace web_application
+    }; // namespace networking
+}; // namespace uva
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <networking.hpp>
+
+namespace uva
+{
+    namespace networking
+    {
+        enum class content_encoding
+        {
+            identity,
+            gzip,
+            deflate,
+        };
+        /// @brief The Content-Encoding token of an encoding, empty for identity.
+        std::string_view content_encoding_to_string(const content_encoding& encoding);
+        /// @brief Picks the encoding for an Accept-Encoding header, preferring gzip. Encodings with q=0 are never picked.
+        content_encoding negotiate_content_encoding(std::string_view accept_encoding);
+        /// @brief Whether compressing a body of this type is worth it. Images and fonts are already compressed.
+        bool is_compressible(const content_type& type);
+        /// @brief Compresses input with zlib, feeding it in chunks. level goes from 1 (fastest) to 9 (smallest).
+        std::string compress(std::string_view input, const content_encoding& encoding, int level);
+        /// @brief Wraps generator in one producing its output compressed with encoding, as a single zlib stream. Small chunks are
+        /// gathered until zlib has a block to write, so the generator may be called more than once per compressed chunk.
+        body_generator compress_body(body_generator generator, const content_encoding& encoding, int level);
+
+        struct compression_options
+        {
+            /* 0 disables compression */
+            int level = 6;
+            /* smaller bodies are sent as they are, the headers would cost more than what is saved */
+            size_t min_size = 1024;
+        };
+        /// @brief Compresses the raw_body of response with encoding, when its type and size are worth it, and sets Content-Encoding and Vary.
+        /// A streamed body is wrapped by compress_body, whatever its size. Shared, static and file bodies are left untouched.
+        /// Meant for the dispatch workers, not for the io threads.
+        void compress_response(http_message& response, const content_encoding& encoding, const compression_options& options);
+    }; // namespace networking
+}; // namespace uva
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <future>
+#include <string>
+
+#include <networking.hpp>
+#include <web_client.hpp>
+
+#include "http_test_server.hpp"
+
+#include <cspec.hpp>
+
+using namespace uva;
+using namespace networking;
+
+struct chunked_result
+{
+    bool completed = false;
+    error_code error;
+    std::string body;
+};
+
+//Gets / from a server answering with a chunked body made of chunks, the bytes after the head.
+static chunked_result get_chunked(const std::string& chunks, bool streamed = false)
+{
+    http_test_server server([&chunks](const std::string& head, size_t index) {
+        return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n" + chunks;
+    });
+
+    basic_web_client client(server.url());
+
+    auto result = std::make_shared<chunked_result>();
+    auto promise = std::make_shared<std::promise<void>>();
+    std::future<void> done = promise->get_future();
+
+    auto on_success = [result, promise](http_message response) {
+        result->completed = true;
+
+        if(response.raw_body.size()) {
+            result->body = response.raw_body;
+        }
+
+        promise->set_value();
+    };
+
+    auto on_error = [result, promise](error_code ec) {
+        result->error = ec;
+        promise->set_value();
+    };
+
+    if(streamed) {
+        client.get("/", {}, {}, [result](std::string_view chunk) {
+            result->body.append(chunk);
+        }, on_success, on_error);
+    } else {
+        client.get("/", {}, {}, on_success, on_error);
+    }
+
+    done.wait_for(std::chrono::seconds(5));
+
+    return *result;
+}
+
+cspec_describe("chunked Transfer-Encoding",
+    describe("a valid body",
+        it("is joined into raw_body", []() {
+            chunked_result result = get_chunked("5\r\nhello\r\n6;name=value\r\n world\r\n0\r\n\r\n");
+
+            expect(result.completed) to eq(true);
+            expect(result.body) to eq("hello world");
+        }),
+        it("is delivered chunk by chunk to on_chunk", []() {
+            chunked_result result = get_chunked("5\r\nhello\r\n6\r\n world\r\n0\r\nTrailer: ignored\r\n\r\n", true);
+
+            expect(result.completed) to eq(true);
+            expect(result.body) to eq("hello world");
+        })
+    ),
+    describe("a malformed body",
+        it("fails with bad_message on a chunk size which is not hex", []() {
+            chunked_result result = get_chunked("zz\r\nhello\r\n0\r\n\r\n");
+
+            expect(result.completed) to eq(false);
+            expect(result.error == std::errc::bad_message) to eq(true);
+        }),
+        it("fails with bad_message on a chunk size followed by garbage", []() {
+            chunked_result result = get_chunked("5zz\r\nhello\r\n0\r\n\r\n");
+
+            expect(result.completed) to eq(false);
+            expect(result.error == std::errc::bad_message) to eq(true);
+        }),
+        it("fails with value_too_large on a chunk size overflowing size_t", []() {
+            chunked_result result = get_chunked("FFFFFFFFFFFFFFFFFF\r\nhello\r\n0\r\n\r\n");
+
+            expect(result.completed) to eq(false);
+            expect(result.error == std::errc::value_too_large) to eq(true);
+        }),
+        it("fails with bad_message when the CRLF after the chunk data is missing", []() {
+            chunked_result result = get_chunked("5\r\nhelloXX\r\n0\r\n\r\n");
+
+            expect(result.completed) to eq(false);
+            expect(result.error == std::errc::bad_message) to eq(true);
+        })
+    ),
+    describe("a body bigger than max_body_size",
+        it("fails with value_too_large once its chunks go over it", []() {
+            set_max_body_size(8);
+            chunked_result result = get_chunked("5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n");
+            set_max_body_size(8 * 1024 * 1024);
+
+            expect(result.completed) to eq(false);
+            expect(result.error == std::errc::value_too_large) to eq(true);
+        }),
+        it("is delivered to on_chunk, which does not keep it", []() {
+            set_max_body_size(8);
+            chunked_result result = get_chunked("5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n", true);
+            set_max_body_size(8 * 1024 * 1024);
+
+            expect(result.completed) to eq(true);
+            expect(result.body) to eq("hello world");
+        }),
+        it("fails with value_too_large on trailer fields bigger than a head", []() {
+            std::string trailers;
+
+            while(trailers.size() <= http_message_parser::max_head_size) {
+                trailers += "Trailer: " + std::string(1000, 'x') + "\r\n";
+            }
+
+            chunked_result result = get_chunked("5\r\nhello\r\n0\r\n" + trailers + "\r\n", true);
+
+            expect(result.completed) to eq(false);
+            expect(result.error == std::errc::value_too_large) to eq(true);
+        })
+    )
+);
@@ -0,0 +1,118 @@
+#include <chrono>
+#include <vector>
+
+#include <networking.hpp>
+
+#include <cspec.hpp>
+
+using namespace uva;
+using namespace networking;
+
+/// @brief A local stand-in for an address that never answers. Its accept queue is full and nothing accepts, so new SYNs are dropped.
+struct unresponsive_listener
+{
+    asio::ip::tcp::acceptor acceptor;
+    asio::ip::tcp::socket queued;
+
+    unresponsive_listener(asio::io_context& context)
+        : acceptor(context), queued(context)
+    {
+        acceptor.open(asio::ip::tcp::v4());
+        acceptor.bind(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+        acceptor.listen(0);
+
+        queued.connect(acceptor.local_endpoint());
+    }
+};
+
+/// @brief A local stand-in for an address that refuses connections. The port is bound, so nothing else takes it, but not listened on.
+struct refusing_address
+{
+    asio::ip::tcp::socket socket;
+
+    refusing_address(asio::io_context& context)
+        : socket(context)
+    {
+        socket.open(asio::ip::tcp::v4());
+        socket.bind(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    }
+};
+
+struct race_result
+{
+    error_code error;
+    asio::ip::tcp::endpoint connected;
+    double seconds = 0;
+};
+
+static race_result race(asio::io_context& context, std::vector<asio::ip::tcp::endpoint> endpoints)
+{
+    race_result result;
+    auto start = std::chrono::steady_clock::now();
+
+    async_connect_race(context, endpoints, [&result, start](error_code ec, asio::ip::tcp::socket&& socket) {
+        result.error = ec;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if(!ec) {
+            result.connected = socket.remote_endpoint();
+        }
+    });
+
+    //Returns once the losing attempts are closed and the timer is cancelled.
+    context.run();
+
+    return result;
+}
+
+cspec_describe("uva::networking::async_connect_race",
+    it("connects to the first endpoint to accept", []() {
+        asio::io_context context;
+        asio::ip::tcp::acceptor live(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+
+        race_result result = race(context, { live.local_endpoint() });
+
+        expect(result.error.value()) to eq(0);
+        expect(result.connected == live.local_endpoint()) to eq(true);
+    }),
+    it("tries the next endpoint right away when one refuses", []() {
+        asio::io_context context;
+        refusing_address refusing(context);
+        asio::ip::tcp::acceptor live(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+
+        race_result result = race(context, { refusing.socket.local_endpoint(), live.local_endpoint() });
+
+        expect(result.error.value()) to eq(0);
+        expect(result.connected == live.local_endpoint()) to eq(true);
+        expect(result.seconds < 0.2) to eq(true);
+    }),
+    it("starts the next endpoint 250ms after one that does not answer", []() {
+        asio::io_context context;
+        unresponsive_listener unresponsive(context);
+        asio::ip::tcp::acceptor live(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+
+        race_result result = race(context, { unresponsive.acceptor.local_endpoint(), live.local_endpoint() });
+
+        expect(result.error.value()) to eq(0);
+        expect(result.connected == live.local_endpoint()) to eq(true);
+        expect(result.seconds >= 0.2) to eq(true);
+        //Far below the seconds a connect to a dead address takes to time out.
+        expect(result.seconds < 1.0) to eq(true);
+    }),
+    it("fails with the last error when every endpoint fails", []() {
+        asio::io_context context;
+        refusing_address first(context);
+        refusing_address second(context);
+
+        race_result result = race(context, { first.socket.local_endpoint(), second.socket.local_endpoint() });
+
+        expect(result.error == asio::error::connection_refused) to eq(true);
+    }),
+    it("fails with host_not_found given no endpoint", []() {
+        asio::io_context context;
+
+        race_result result = race(context, {});
+
+        expect(result.error == asio::error::host_not_found) to eq(true);
+    })
+);
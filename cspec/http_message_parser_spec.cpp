@@ -0,0 +1,139 @@
+#include <string>
+
+#include <networking.hpp>
+
+#include <cspec.hpp>
+
+using namespace uva;
+using namespace networking;
+
+//Whether parsing head, all of it at once, throws.
+static bool rejects(const std::string& head)
+{
+    http_message_parser parser;
+
+    try {
+        parser.parse(head);
+    } catch(const std::exception& e) {
+        return true;
+    }
+
+    return false;
+}
+
+static const std::string s_request = "GET /users?page=2 HTTP/1.1\r\nHost: localhost\r\nAccept:  text/html \r\n\r\n";
+
+cspec_describe("uva::networking::http_message_parser",
+    describe("parse",
+        it("parses a complete head", []() {
+            http_message_parser parser;
+
+            expect(parser.parse(s_request)) to eq(true);
+            expect(parser.head_size()) to eq(s_request.size());
+            expect(std::string(parser.start_line(0))) to eq("GET");
+            expect(std::string(parser.start_line(1))) to eq("/users?page=2");
+            expect(std::string(parser.start_line(2))) to eq("HTTP/1.1");
+            expect(parser.header_count()) to eq(2);
+            expect(std::string(parser.header_name(1))) to eq("Accept");
+            expect(std::string(parser.header_value(1))) to eq("text/html");
+        }),
+        it("resumes a head split across reads, byte by byte", []() {
+            http_message_parser parser;
+            bool done = false;
+
+            //Each call gets every byte received so far, as the receive buffer does.
+            for(size_t size = 1; size <= s_request.size(); ++size) {
+                done = parser.parse(std::string_view(s_request).substr(0, size));
+
+                if(done) {
+                    expect(size) to eq(s_request.size());
+                }
+            }
+
+            expect(done) to eq(true);
+            expect(std::string(parser.start_line(1))) to eq("/users?page=2");
+            expect(std::string(parser.header_value(0))) to eq("localhost");
+        }),
+        it("leaves the bytes after the head, a body or the next pipelined message, unparsed", []() {
+            http_message_parser parser;
+            std::string data = s_request + "GET / HTTP/1.1\r\n";
+
+            expect(parser.parse(data)) to eq(true);
+            expect(parser.head_size()) to eq(s_request.size());
+            expect(parser.header_count()) to eq(2);
+        }),
+        it("accepts lines ended by a bare LF", []() {
+            http_message_parser parser;
+
+            expect(parser.parse("GET / HTTP/1.1\nHost: localhost\n\n")) to eq(true);
+            expect(std::string(parser.start_line(2))) to eq("HTTP/1.1");
+            expect(std::string(parser.header_value(0))) to eq("localhost");
+        }),
+        it("ignores empty lines before the start line", []() {
+            http_message_parser parser;
+
+            expect(parser.parse("\r\n\r\nGET / HTTP/1.1\r\n\r\n")) to eq(true);
+            expect(std::string(parser.start_line(0))) to eq("GET");
+        }),
+        it("accepts a status line with an empty reason phrase", []() {
+            http_message_parser parser;
+
+            expect(parser.parse("HTTP/1.1 200 \r\n\r\n")) to eq(true);
+            expect(std::string(parser.start_line(1))) to eq("200");
+            expect(std::string(parser.start_line(2))) to eq("");
+        }),
+        it("parses again after reset", []() {
+            http_message_parser parser;
+
+            parser.parse(s_request);
+            parser.reset();
+
+            expect(parser.parse("POST /a HTTP/1.1\r\n\r\n")) to eq(true);
+            expect(std::string(parser.start_line(0))) to eq("POST");
+            expect(parser.header_count()) to eq(0);
+        })
+    ),
+    describe("rejects",
+        it("an incomplete head bigger than max_head_size", []() {
+            std::string head = "GET / HTTP/1.1\r\nX-Large: " + std::string(http_message_parser::max_head_size, 'x');
+
+            expect(rejects(head)) to eq(true);
+        }),
+        it("a head growing past max_head_size across reads", []() {
+            http_message_parser parser;
+            std::string data = "GET / HTTP/1.1\r\n";
+            bool thrown = false;
+
+            try {
+                while(data.size() <= http_message_parser::max_head_size + 1024) {
+                    data += "X-Header: " + std::string(100, 'x') + "\r\n";
+                    parser.parse(data.substr(0, data.size() - 2));
+                }
+            } catch(const std::exception& e) {
+                thrown = true;
+            }
+
+            expect(thrown) to eq(true);
+        }),
+        it("a start line without a second space", []() {
+            expect(rejects("GET /\r\n\r\n")) to eq(true);
+            expect(rejects("HTTP/1.1 200\r\n\r\n")) to eq(true);
+        }),
+        it("a start line without a space", []() {
+            expect(rejects("GET\r\n\r\n")) to eq(true);
+        }),
+        it("a header line without a colon", []() {
+            expect(rejects("GET / HTTP/1.1\r\nHost localhost\r\n\r\n")) to eq(true);
+        }),
+        it("a header line without a name", []() {
+            expect(rejects("GET / HTTP/1.1\r\n: localhost\r\n\r\n")) to eq(true);
+        }),
+        it("whitespace between a header name and its colon", []() {
+            expect(rejects("GET / HTTP/1.1\r\nHost : localhost\r\n\r\n")) to eq(true);
+        }),
+        it("a header folded over two lines (obs-fold)", []() {
+            expect(rejects("GET / HTTP/1.1\r\nX-Folded: first\r\n second\r\n\r\n")) to eq(true);
+            expect(rejects("GET / HTTP/1.1\r\nX-Folded: first\r\n\tsecond\r\n\r\n")) to eq(true);
+        })
+    )
+);
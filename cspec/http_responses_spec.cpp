@@ -0,0 +1,93 @@
+#include <string>
+#include <vector>
+
+#include <networking.hpp>
+
+#include <cspec.hpp>
+
+using namespace uva;
+using namespace networking;
+
+struct written_responses
+{
+    std::string data;
+    size_t returned = 0;
+    size_t completed = 0;
+};
+
+//Writes a response for each body with async_write_http_responses and reads back what went through the socket.
+static written_responses write_responses(const std::vector<std::string>& bodies, size_t max_batch_size)
+{
+    asio::io_context context;
+    asio::ip::tcp::acceptor acceptor(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+
+    asio::ip::tcp::socket client(context);
+    client.connect(acceptor.local_endpoint());
+
+    http_socket server(acceptor.accept());
+
+    std::vector<http_message> messages(bodies.size());
+    std::vector<const http_message*> responses;
+
+    for(size_t i = 0; i < bodies.size(); ++i) {
+        messages[i].status = status_code::ok;
+        messages[i].type = content_type::text_plain;
+        messages[i].raw_body = bodies[i];
+
+        responses.push_back(&messages[i]);
+    }
+
+    written_responses result;
+
+    result.returned = async_write_http_responses(server, responses, max_batch_size, [&result](error_code& ec, size_t written) {
+        result.completed = written;
+    });
+
+    context.run();
+    server.close();
+
+    //Until the end of stream.
+    asio::error_code ec;
+    asio::read(client, asio::dynamic_buffer(result.data), ec);
+
+    return result;
+}
+
+static size_t count(const std::string& data, std::string_view text)
+{
+    size_t found = 0;
+
+    for(size_t position = data.find(text); position != std::string::npos; position = data.find(text, position + text.size())) {
+        ++found;
+    }
+
+    return found;
+}
+
+cspec_describe("uva::networking::async_write_http_responses",
+    it("writes every response, in order", []() {
+        written_responses result = write_responses({ "first", "second", "third" }, 64 * 1024);
+
+        expect(result.returned) to eq(3);
+        expect(result.completed) to eq(3);
+        expect(count(result.data, "HTTP/1.1 200 OK\r\n")) to eq(3);
+        expect(result.data.find("first") < result.data.find("second")) to eq(true);
+        expect(result.data.find("second") < result.data.find("third")) to eq(true);
+        expect(result.data.ends_with("\r\n\r\nthird")) to eq(true);
+    }),
+    it("frames each body with its own Content-Length", []() {
+        written_responses result = write_responses({ "a", "bb" }, 64 * 1024);
+
+        expect(result.data.find("Content-Length: 1\r\n") < result.data.find("Content-Length: 2\r\n")) to eq(true);
+        expect(result.data.find("\r\n\r\na") != std::string::npos) to eq(true);
+    }),
+    it("leaves out the responses after max_batch_size", []() {
+        written_responses result = write_responses({ "first", "second", "third" }, 1);
+
+        //The first response is always written.
+        expect(result.returned) to eq(1);
+        expect(result.completed) to eq(1);
+        expect(count(result.data, "HTTP/1.1 200 OK\r\n")) to eq(1);
+        expect(result.data.ends_with("first")) to eq(true);
+    })
+);
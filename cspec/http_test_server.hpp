@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+/// @brief A blocking HTTP/1.1 server on a loopback port, for the specs. Each connection is served by its own thread,
+/// one request after the other, so the order the responses go out is the order the requests came in.
+class http_test_server
+{
+public:
+    struct reply
+    {
+        /* the whole response, head and body. Nothing written when empty */
+        std::string data;
+        /* the connection is closed after data is written. Always true when data is empty */
+        bool close = false;
+
+        reply(std::string __data, bool __close = false)
+            : data(std::move(__data)), close(__close || data.empty())
+        {
+        }
+    };
+    /* receives the request head and the index of the request on its connection */
+    using handler = std::function<reply(const std::string& head, size_t index)>;
+private:
+    asio::io_context m_context;
+    asio::ip::tcp::acceptor m_acceptor;
+    handler m_handler;
+
+    std::atomic<bool> m_stopped = false;
+    std::atomic<size_t> m_accepted = 0;
+    std::atomic<size_t> m_requests = 0;
+
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<asio::ip::tcp::socket>> m_sockets;
+    std::vector<std::thread> m_threads;
+    std::thread m_accept_thread;
+public:
+    http_test_server(handler __handler)
+        : m_acceptor(m_context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)), m_handler(std::move(__handler))
+    {
+        //Polled, so the destructor does not have to interrupt a blocking accept.
+        m_acceptor.non_blocking(true);
+
+        m_accept_thread = std::thread([this]() {
+            while(!m_stopped) {
+                asio::error_code ec;
+                auto socket = std::make_shared<asio::ip::tcp::socket>(m_context);
+
+                m_acceptor.accept(*socket, ec);
+
+                if(ec) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+
+                ++m_accepted;
+
+                std::scoped_lock lock(m_mutex);
+                m_sockets.push_back(socket);
+                m_threads.emplace_back([this, socket]() { serve(*socket); });
+            }
+        });
+    }
+    ~http_test_server()
+    {
+        m_stopped = true;
+        m_accept_thread.join();
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            //Wakes up the threads blocked reading.
+            for(auto& socket : m_sockets) {
+                asio::error_code ec;
+                socket->shutdown(asio::socket_base::shutdown_both, ec);
+            }
+        }
+
+        for(std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+private:
+    void serve(asio::ip::tcp::socket& socket)
+    {
+        asio::streambuf buffer;
+        size_t index = 0;
+
+        while(!m_stopped) {
+            asio::error_code ec;
+            size_t head_size = asio::read_until(socket, buffer, "\r\n\r\n", ec);
+
+            if(ec) {
+                break;
+            }
+
+            std::string head(asio::buffers_begin(buffer.data()), asio::buffers_begin(buffer.data()) + head_size);
+            buffer.consume(head_size);
+
+            ++m_requests;
+
+            reply response = m_handler(head, index++);
+
+            if(response.data.size()) {
+                asio::write(socket, asio::buffer(response.data), ec);
+            }
+
+            if(ec || response.close) {
+                break;
+            }
+        }
+
+        asio::error_code ec;
+        socket.shutdown(asio::socket_base::shutdown_both, ec);
+    }
+public:
+    std::string url() const
+    {
+        return "http://127.0.0.1:" + std::to_string(m_acceptor.local_endpoint().port());
+    }
+    size_t accepted() const
+    {
+        return m_accepted;
+    }
+    size_t requests() const
+    {
+        return m_requests;
+    }
+    /// @brief The target of the request line of head, like /users/42.
+    static std::string target(const std::string& head)
+    {
+        size_t begin = head.find(' ') + 1;
+        return head.substr(begin, head.find(' ', begin) - begin);
+    }
+    static std::string response(const std::string& body, std::string_view extra_headers = "")
+    {
+        return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" + std::string(extra_headers) + "\r\n" + body;
+    }
+};
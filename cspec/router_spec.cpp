@@ -0,0 +1,130 @@
+#include <string>
+
+#include <router.hpp>
+
+#include <cspec.hpp>
+
+using namespace uva;
+using namespace networking;
+using namespace web_application;
+
+static basic_router sample_router()
+{
+    basic_router router;
+
+    router.add("GET", "/", "GET /");
+    router.add("GET", "/users", "GET /users");
+    router.add("GET", "/users/new", "GET /users/new");
+    router.add("GET", "/users/:id", "GET /users/:id");
+    router.add("GET", "/users/:id/posts/:post_id", "GET /users/:id/posts/:post_id");
+    router.add("GET", "/files/*path", "GET /files/*path");
+    router.add("POST", "/users", "POST /users");
+
+    return router;
+}
+
+static std::string found_route(const basic_router& router, std::string_view method, std::string_view path)
+{
+    route_match match;
+
+    if(!router.find(method, path, match)) {
+        return "";
+    }
+
+    return *match.route;
+}
+
+cspec_describe("uva::networking::web_application::basic_router",
+    describe("find",
+        it("matches static routes exactly", []() {
+            basic_router router = sample_router();
+
+            expect(found_route(router, "GET", "/")) to eq("GET /");
+            expect(found_route(router, "GET", "/users")) to eq("GET /users");
+            expect(found_route(router, "GET", "/users/new")) to eq("GET /users/new");
+            expect(found_route(router, "GET", "/user")) to eq("");
+        }),
+        it("keeps the methods apart", []() {
+            basic_router router = sample_router();
+
+            expect(found_route(router, "POST", "/users")) to eq("POST /users");
+            expect(found_route(router, "POST", "/users/new")) to eq("");
+            expect(found_route(router, "DELETE", "/users")) to eq("");
+        }),
+        it("fills the parameters with views into the path", []() {
+            basic_router router = sample_router();
+            std::string path = "/users/42/posts/7";
+
+            route_match match;
+
+            expect(router.find("GET", path, match)) to eq(true);
+            expect(*match.route) to eq("GET /users/:id/posts/:post_id");
+            expect(match.param_count) to eq(2);
+            expect(std::string(match.params[0].first)) to eq("id");
+            expect(std::string(match.params[0].second)) to eq("42");
+            expect(std::string(match.params[1].first)) to eq("post_id");
+            expect(std::string(match.params[1].second)) to eq("7");
+            expect(match.params[0].second.data() == path.data() + 7) to eq(true);
+        }),
+        it("prefers static text over parameters", []() {
+            basic_router router = sample_router();
+
+            expect(found_route(router, "GET", "/users/new")) to eq("GET /users/new");
+            expect(found_route(router, "GET", "/users/newest")) to eq("GET /users/:id");
+        }),
+        it("backtracks to a parameter when the static branch fails further down", []() {
+            basic_router router;
+            router.add("GET", "/users/new/edit", "GET /users/new/edit");
+            router.add("GET", "/users/:id/posts", "GET /users/:id/posts");
+
+            route_match match;
+
+            expect(router.find("GET", "/users/new/posts", match)) to eq(true);
+            expect(*match.route) to eq("GET /users/:id/posts");
+            expect(match.param_count) to eq(1);
+            expect(std::string(match.params[0].second)) to eq("new");
+        }),
+        it("matches the rest of the path with a splat", []() {
+            basic_router router = sample_router();
+            route_match match;
+
+            expect(router.find("GET", "/files/css/site.css", match)) to eq(true);
+            expect(*match.route) to eq("GET /files/*path");
+            expect(std::string(match.params[0].second)) to eq("css/site.css");
+        }),
+        it("does not match an empty parameter", []() {
+            basic_router router = sample_router();
+
+            expect(found_route(router, "GET", "/users/")) to eq("");
+        })
+    ),
+    describe("add",
+        it("counts every route", []() {
+            expect(sample_router().size()) to eq(7);
+        }),
+        it("throws when two routes name the same parameter differently", []() {
+            basic_router router = sample_router();
+            bool thrown = false;
+
+            try {
+                router.add("GET", "/users/:user_id/friends", "GET /users/:user_id/friends");
+            } catch(const std::exception& e) {
+                thrown = true;
+            }
+
+            expect(thrown) to eq(true);
+        }),
+        it("throws on segments after a splat", []() {
+            basic_router router;
+            bool thrown = false;
+
+            try {
+                router.add("GET", "/files/*path/edit", "GET /files/*path/edit");
+            } catch(const std::exception& e) {
+                thrown = true;
+            }
+
+            expect(thrown) to eq(true);
+        })
+    )
+);
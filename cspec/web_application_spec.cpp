@@ -0,0 +1,192 @@
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <networking.hpp>
+#include <web_application.hpp>
+
+#include <cspec.hpp>
+
+using namespace uva;
+using namespace routing;
+using namespace networking;
+
+/// @brief Answers with the path it was called for, so each response tells which request it belongs to.
+class echo_controller : public web_application::basic_web_controller
+{
+public:
+    void echo()
+    {
+        web_application::current_response.status = status_code::ok;
+        web_application::current_response.type = content_type::text_plain;
+        web_application::current_response.raw_body = request.url;
+    }
+};
+
+//web_application::init never returns and can run a single time, every example shares the application it starts.
+static unsigned short application_port()
+{
+    static std::once_flag started;
+    static unsigned short port = 0;
+
+    std::call_once(started, []() {
+        //Takes a free port, released for the application to listen on.
+        {
+            asio::io_context context;
+            asio::ip::tcp::acceptor acceptor(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+            port = acceptor.local_endpoint().port();
+        }
+
+        GET("/:name", echo_controller::echo);
+
+        std::thread([]() {
+            static std::string port_argument = "--port=" + std::to_string(port);
+            const char* argv[] = { "web_application_spec", "--protocol=http", "--address=127.0.0.1", "--workers=2", port_argument.c_str() };
+
+            web_application::init(5, argv);
+        }).detach();
+
+        //Until the listener is up.
+        for(size_t i = 0; i < 100; ++i) {
+            asio::io_context context;
+            asio::ip::tcp::socket socket(context);
+            error_code ec;
+
+            socket.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port), ec);
+
+            if(!ec) {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+
+    return port;
+}
+
+struct exchanged_response
+{
+    /* the start line, without CRLF */
+    std::string status;
+    std::string body;
+};
+
+/// @brief Writes data in a single write and returns the first count responses, in the order they came.
+/// Gives up after 5 seconds, so a server that never answers fails the example instead of hanging it.
+static std::vector<exchanged_response> exchange(const std::string& data, size_t count)
+{
+    asio::io_context context;
+    asio::ip::tcp::socket socket(context);
+    socket.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), application_port()));
+
+    asio::write(socket, asio::buffer(data));
+
+    std::vector<exchanged_response> responses;
+    std::promise<void> done;
+
+    std::thread reader([&]() {
+        asio::streambuf buffer;
+        error_code ec;
+
+        while(responses.size() < count) {
+            size_t head_size = asio::read_until(socket, buffer, "\r\n\r\n", ec);
+
+            if(ec) {
+                break;
+            }
+
+            std::string head(asio::buffers_begin(buffer.data()), asio::buffers_begin(buffer.data()) + head_size);
+            buffer.consume(head_size);
+
+            size_t content_length = 0;
+            size_t header = head.find("Content-Length: ");
+
+            if(header != std::string::npos) {
+                content_length = std::stoull(head.substr(header + 16));
+            }
+
+            if(buffer.size() < content_length) {
+                asio::read(socket, buffer, asio::transfer_exactly(content_length - buffer.size()), ec);
+
+                if(ec) {
+                    break;
+                }
+            }
+
+            exchanged_response response;
+            response.status = head.substr(0, head.find("\r\n"));
+            response.body.assign(asio::buffers_begin(buffer.data()), asio::buffers_begin(buffer.data()) + content_length);
+
+            responses.push_back(std::move(response));
+            buffer.consume(content_length);
+        }
+
+        done.set_value();
+    });
+
+    if(done.get_future().wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+        //Wakes up the blocked read.
+        error_code ec;
+        socket.shutdown(asio::socket_base::shutdown_both, ec);
+    }
+
+    reader.join();
+
+    return responses;
+}
+
+static std::string request(const std::string& path)
+{
+    return "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+}
+
+cspec_describe("uva::networking::web_application",
+    describe("pipelining",
+        it("answers two requests sent in a single write, in order", []() {
+            std::vector<exchanged_response> responses = exchange(request("/a") + request("/b"), 2);
+
+            expect(responses.size()) to eq(2);
+            expect(responses[0].body) to eq("/a");
+            expect(responses[1].body) to eq("/b");
+        }),
+        it("answers many requests sent in a single write, in order", []() {
+            constexpr size_t count = 64;
+            std::string data;
+
+            for(size_t i = 0; i < count; ++i) {
+                data += request("/" + std::to_string(i));
+            }
+
+            std::vector<exchanged_response> responses = exchange(data, count);
+
+            expect(responses.size()) to eq(count);
+
+            for(size_t i = 0; i < responses.size(); ++i) {
+                expect(responses[i].body) to eq("/" + std::to_string(i));
+            }
+        })
+    ),
+    describe("max_body_size",
+        it("answers 413 to a Content-Length over it, after the requests before", []() {
+            set_max_body_size(16);
+            std::vector<exchanged_response> responses = exchange(request("/a") + "POST /b HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 1000\r\n\r\n", 2);
+            set_max_body_size(8 * 1024 * 1024);
+
+            expect(responses.size()) to eq(2);
+            expect(responses[0].body) to eq("/a");
+            expect(responses[1].status) to eq("HTTP/1.1 413 Payload Too Large");
+        }),
+        it("answers 413 to chunks going over it", []() {
+            set_max_body_size(16);
+            std::vector<exchanged_response> responses = exchange("POST /a HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n10\r\n0123456789abcdef\r\n1\r\nx\r\n0\r\n\r\n", 1);
+            set_max_body_size(8 * 1024 * 1024);
+
+            expect(responses.size()) to eq(1);
+            expect(responses[0].status) to eq("HTTP/1.1 413 Payload Too Large");
+        })
+    )
+);
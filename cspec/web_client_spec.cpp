@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <networking.hpp>
+#include <web_client.hpp>
+
+#include "http_test_server.hpp"
+
+#include <cspec.hpp>
+
+using namespace uva;
+using namespace networking;
+
+struct request_result
+{
+    std::promise<void> promise;
+    bool succeeded = false;
+    std::string body;
+    error_code error;
+};
+
+static std::function<void(http_message)> on_success(std::shared_ptr<request_result> result)
+{
+    return [result](http_message response) {
+        result->succeeded = true;
+        result->body += response.raw_body;
+        result->promise.set_value();
+    };
+}
+
+static std::function<void(error_code)> on_error(std::shared_ptr<request_result> result)
+{
+    return [result](error_code ec) {
+        result->error = ec;
+        result->promise.set_value();
+    };
+}
+
+static void wait(std::shared_ptr<request_result> result)
+{
+    result->promise.get_future().wait_for(std::chrono::seconds(5));
+}
+
+static const std::string s_chunked_head = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n";
+
+cspec_describe("uva::networking::basic_web_client",
+    describe("destructor",
+        it("drops the requests in flight without calling them back", []() {
+            http_test_server server([](const std::string& head, size_t index) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return http_test_server::response("ok");
+            });
+
+            std::atomic<size_t> calls = 0;
+
+            web_client_pool_options options;
+            options.max_connections = 4;
+            options.pipeline_depth = 4;
+
+            auto client = std::make_unique<basic_web_client>(server.url(), options);
+
+            for(size_t i = 0; i < 32; ++i) {
+                client->get("/" + std::to_string(i), {}, {}, [&calls](http_message response) {
+                    ++calls;
+                }, [&calls](error_code ec) {
+                    ++calls;
+                });
+            }
+
+            //Written, but not answered yet.
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            client.reset();
+
+            size_t calls_at_destruction = calls;
+
+            //The handlers still pending complete now, with the client gone.
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+            expect(calls.load()) to eq(calls_at_destruction);
+        }),
+        it("can be destroyed from a response callback", []() {
+            http_test_server server([](const std::string& head, size_t index) {
+                return http_test_server::response("ok");
+            });
+
+            std::atomic<bool> destroyed = false;
+            std::unique_ptr<basic_web_client> client = std::make_unique<basic_web_client>(server.url());
+
+            client->get("/", {}, {}, [&client, &destroyed](http_message response) {
+                client.reset();
+                destroyed = true;
+            });
+
+            for(size_t i = 0; i < 100 && !destroyed; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            expect(destroyed.load()) to eq(true);
+        })
+    ),
+    describe("pipelining",
+        it("matches each response to its request, in the order they were written", []() {
+            http_test_server server([](const std::string& head, size_t index) {
+                return http_test_server::response(http_test_server::target(head));
+            });
+
+            web_client_pool_options options;
+            options.max_connections = 1;
+            options.pipeline_depth = 8;
+
+            constexpr size_t count = 32;
+
+            std::mutex mutex;
+            std::vector<std::string> bodies(count);
+            std::vector<size_t> order;
+
+            std::atomic<size_t> remaining = count;
+            std::promise<void> promise;
+
+            //Destroyed first, the callbacks still pending are dropped before what they use goes away.
+            basic_web_client client(server.url(), options);
+
+            for(size_t i = 0; i < count; ++i) {
+                client.get("/" + std::to_string(i), {}, {}, [&, i](http_message response) {
+                    {
+                        std::scoped_lock lock(mutex);
+                        bodies[i] = response.raw_body;
+                        order.push_back(i);
+                    }
+
+                    if(--remaining == 0) {
+                        promise.set_value();
+                    }
+                }, [&](error_code ec) {
+                    if(--remaining == 0) {
+                        promise.set_value();
+                    }
+                });
+            }
+
+            promise.get_future().wait_for(std::chrono::seconds(5));
+
+            std::scoped_lock lock(mutex);
+
+            for(size_t i = 0; i < count; ++i) {
+                expect(bodies[i]) to eq("/" + std::to_string(i));
+            }
+
+            //A single connection completes its responses first in, first out.
+            expect(std::is_sorted(order.begin(), order.end())) to eq(true);
+            expect(order.size()) to eq(count);
+            expect(server.accepted()) to eq(1);
+        })
+    ),
+    describe("retries",
+        it("sends a GET again when its connection closes before the response", []() {
+            std::atomic<size_t> count = 0;
+
+            http_test_server server([&count](const std::string& head, size_t index) -> http_test_server::reply {
+                if(count++ == 0) {
+                    return { "", true };
+                }
+
+                return http_test_server::response("ok");
+            });
+
+            basic_web_client client(server.url());
+            auto result = std::make_shared<request_result>();
+
+            client.get("/", {}, {}, on_success(result), on_error(result));
+            wait(result);
+
+            expect(result->succeeded) to eq(true);
+            expect(result->body) to eq("ok");
+            expect(server.requests()) to eq(2);
+        }),
+        it("fails a GET whose connection closes again", []() {
+            http_test_server server([](const std::string& head, size_t index) -> http_test_server::reply {
+                return { "", true };
+            });
+
+            basic_web_client client(server.url());
+            auto result = std::make_shared<request_result>();
+
+            client.get("/", {}, {}, on_success(result), on_error(result));
+            wait(result);
+
+            expect(result->succeeded) to eq(false);
+            expect(server.requests()) to eq(2);
+        }),
+        it("never sends a POST again", []() {
+            http_test_server server([](const std::string& head, size_t index) -> http_test_server::reply {
+                return { "", true };
+            });
+
+            basic_web_client client(server.url());
+            auto result = std::make_shared<request_result>();
+
+            client.post("/", std::string("body"), content_type::text_plain, {}, on_success(result), on_error(result));
+            wait(result);
+
+            expect(result->succeeded) to eq(false);
+            expect(server.requests()) to eq(1);
+        }),
+        it("never sends a GET again once part of its body went to on_chunk", []() {
+            http_test_server server([](const std::string& head, size_t index) -> http_test_server::reply {
+                return { s_chunked_head + "5\r\nhello\r\n", true };
+            });
+
+            basic_web_client client(server.url());
+            auto result = std::make_shared<request_result>();
+
+            client.get("/", {}, {}, [result](std::string_view chunk) {
+                result->body += chunk;
+            }, on_success(result), on_error(result));
+            wait(result);
+
+            expect(result->succeeded) to eq(false);
+            expect(result->body) to eq("hello");
+            expect(server.requests()) to eq(1);
+        })
+    )
+);
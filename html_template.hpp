@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <filesystem>
+#include <chrono>
+
+#include <networking.hpp>
+
+namespace uva
+{
+    namespace networking
+    {
+        namespace web_application
+        {
+            using exposed_function_map = std::map<std::string, std::function<std::string(var)>>;
+            /// @brief A view parsed once into literal spans, <var>name</var> and <var>function(arguments)</var> nodes.
+            class basic_compiled_html_template
+            {
+            public:
+                enum class node_type
+                {
+                    literal,
+                    variable,
+                    function_call,
+                };
+                struct node
+                {
+                    node_type type;
+                    /* literal: the span of the source */
+                    size_t offset = 0;
+                    size_t size = 0;
+                    /* variable: the local name; function_call: the function name */
+                    std::string name;
+                    /* function_call: parsed once, at compile time */
+                    var arguments;
+                    /* function_call: what is between the parentheses */
+                    std::string arguments_text;
+                    const std::function<std::string(var)>* function = nullptr;
+                };
+            public:
+                /// @brief Parses source. Only .cpp.html views have nodes other than literals, the others are plain html.
+                /// Throws if a called function is not in functions, which must outlive the compiled template.
+                /// Without functions the template can be inspected (like the view compiler does), but not rendered.
+                basic_compiled_html_template(std::string __source, bool __is_template, const exposed_function_map* functions);
+            private:
+                std::string m_source;
+                std::vector<node> m_nodes;
+                size_t m_literal_size = 0;
+                /* the largest render so far, the output buffer is reserved with it */
+                mutable std::atomic<size_t> m_render_size_hint = 0;
+            public:
+                std::string render(const var& locals) const;
+                const std::vector<node>& nodes() const { return m_nodes; }
+                std::string_view literal(const node& n) const { return std::string_view(m_source).substr(n.offset, n.size); }
+            };
+            /// @brief Compiled views by controller and name, found under views_root/controller/name.(cpp.html|html).
+            /// When watch_files is set (development), an entry is revalidated against the file modification time at most once per revalidate_interval.
+            /// Otherwise views are read from disk only once.
+            class basic_html_template_cache
+            {
+            public:
+                basic_html_template_cache(std::filesystem::path __views_root, const exposed_function_map& __functions, bool __watch_files);
+            public:
+                static constexpr std::chrono::seconds revalidate_interval = std::chrono::seconds(1);
+            private:
+                struct entry
+                {
+                    std::shared_ptr<const basic_compiled_html_template> compiled;
+                    std::filesystem::path path;
+                    std::filesystem::file_time_type write_time;
+                    std::chrono::steady_clock::time_point checked_at;
+                };
+                std::filesystem::path m_views_root;
+                const exposed_function_map& m_functions;
+                bool m_watch_files;
+
+                std::mutex m_mutex;
+                std::unordered_map<std::string, entry> m_entries;
+            public:
+                /// @brief Returns the compiled view, or nullptr if there is no such view.
+                std::shared_ptr<const basic_compiled_html_template> find(const std::string& controller, const std::string& name);
+                void clear();
+                /// @brief Whether views are read again when their files change, as in development.
+                bool watches_files() const { return m_watch_files; }
+            private:
+                std::filesystem::path find_view_file(const std::string& controller, const std::string& name) const;
+            };
+        }; // namespace web_application
+    }; // namespace networking
+}; // namespace uva
@@ -1,5 +1,14 @@
+# Off by default, so building an app does not need the networking tool. When on, the app still reads the view files while running
+# in the development environment, so edits show without a rebuild.
+option(NETWORKING_COMPILE_VIEWS "Compile app/views into the web app instead of reading them at runtime" OFF)
+
+# add_web_app(name [EMBED_ASSETS])
+# EMBED_ASSETS packs the files under app/ into the executable, and compiles the views even if NETWORKING_COMPILE_VIEWS is off.
+# The app then does not read app/ at all.
 function(add_web_app name)
 
+    cmake_parse_arguments(PARSE_ARGV 1 WEB_APP "EMBED_ASSETS" "" "")
+
     message(STATUS "Add web app for folder ${CMAKE_CURRENT_LIST_DIR}")
 
     file(GLOB_RECURSE source_files CONFIGURE_DEPENDS 
@@ -19,6 +28,54 @@ function(add_web_app name)
         ${source_files}
         "${CMAKE_CURRENT_LIST_DIR}/config/routes.cpp")
 
+    if(NETWORKING_COMPILE_VIEWS OR WEB_APP_EMBED_ASSETS)
+        if(TARGET networking)
+            set(networking_tool $<TARGET_FILE:networking>)
+            set(networking_tool_target networking)
+        else()
+            find_program(networking_tool networking HINTS "${NETWORKING_ROOT_DIR}/bin" REQUIRED)
+        endif()
+    endif()
+
+    # Views are translated into C++ render functions, so they are neither read nor parsed at runtime.
+    if(NETWORKING_COMPILE_VIEWS OR WEB_APP_EMBED_ASSETS)
+        file(GLOB_RECURSE view_files CONFIGURE_DEPENDS "${CMAKE_CURRENT_LIST_DIR}/app/views/*.html")
+
+        if(view_files)
+            set(compiled_views "${CMAKE_CURRENT_BINARY_DIR}/${name}_views.cpp")
+
+            add_custom_command(
+                OUTPUT ${compiled_views}
+                COMMAND ${networking_tool} compile-views "${CMAKE_CURRENT_LIST_DIR}/app/views" "${compiled_views}" "${CMAKE_CURRENT_LIST_DIR}/include/helpers"
+                DEPENDS ${view_files} ${networking_tool_target}
+                COMMENT "Compiling views of ${name}"
+            )
+
+            SET(source_files
+                ${source_files}
+                ${compiled_views})
+        endif()
+    endif()
+
+    # Everything else under app/ becomes a sorted archive with precomputed ETags and content types.
+    if(WEB_APP_EMBED_ASSETS)
+        file(GLOB_RECURSE asset_files CONFIGURE_DEPENDS "${CMAKE_CURRENT_LIST_DIR}/app/*")
+        list(FILTER asset_files EXCLUDE REGEX "^${CMAKE_CURRENT_LIST_DIR}/app/views/")
+
+        set(embedded_assets "${CMAKE_CURRENT_BINARY_DIR}/${name}_assets.cpp")
+
+        add_custom_command(
+            OUTPUT ${embedded_assets}
+            COMMAND ${networking_tool} embed-assets "${CMAKE_CURRENT_LIST_DIR}/app" "${embedded_assets}"
+            DEPENDS ${asset_files} ${networking_tool_target}
+            COMMENT "Embedding assets of ${name}"
+        )
+
+        SET(source_files
+            ${source_files}
+            ${embedded_assets})
+    endif()
+
     include_directories("${CMAKE_CURRENT_LIST_DIR}/include/controllers")
     include_directories("${CMAKE_CURRENT_LIST_DIR}/include/helpers")
     include_directories("${CMAKE_CURRENT_LIST_DIR}/include/models")
@@ -1,7 +1,18 @@
 #pragma once
 
 #include <memory>
+#include <algorithm>
 #include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <variant>
+#include <type_traits>
+#include <chrono>
 
 #include <asio.hpp>
 #include <asio/ssl.hpp>
@@ -18,6 +29,7 @@ namespace uva
             ok = 200,
             no_content = 204,
             moved = 302,
+            not_modified = 304,
             bad_request = 400,
             unauthorized = 401,
             not_found = 404,
@@ -30,10 +42,92 @@ namespace uva
             application_json,
             image_jpeg,
             text_html,
-            text_css
+            text_css,
+            text_csv,
+            text_plain,
+            text_javascript,
+            image_png,
+            image_gif,
+            image_svg,
+            image_x_icon,
+            font_woff,
+            font_woff2,
+            application_octet_stream
         };
         const std::string& content_type_to_string(const content_type& status);
         content_type content_type_from_string(const std::string& status);
+        /// @brief The content type for a file extension, like ".css". application_octet_stream when it is unknown.
+        content_type content_type_from_extension(std::string_view extension);
+        /// @brief Headers with O(1) access through http_headers::get.
+        enum class known_header : uint8_t {
+            /* updates here must reflect on s_known_headers */
+            content_length,
+            content_type,
+            connection,
+            transfer_encoding,
+            host,
+            accept_encoding,
+            if_none_match,
+            if_modified_since,
+            count
+        };
+        const std::string& known_header_to_string(const known_header& header);
+        bool case_insensitive_equals(std::string_view a, std::string_view b);
+        /// @brief Flat storage for http headers. Names and values are kept in one string and the entries are
+        /// (name, value) offsets into it, inline for the first inline_capacity headers. Names are compared case
+        /// insensitively and the known_header ones are interned into slots when added.
+        class http_headers
+        {
+        public:
+            static constexpr size_t inline_capacity = 16;
+        private:
+            struct entry
+            {
+                uint32_t name_offset;
+                uint32_t name_size;
+                uint32_t value_offset;
+                uint32_t value_size;
+            };
+            std::string m_storage;
+            entry m_inline_entries[inline_capacity];
+            std::vector<entry> m_overflow_entries;
+            size_t m_size = 0;
+            /* index of the entry + 1, 0 when missing */
+            uint16_t m_known_slots[(size_t)known_header::count] = {};
+        public:
+            http_headers() = default;
+            http_headers(const std::map<var, var>& headers);
+            http_headers& operator=(const std::map<var, var>& headers);
+        public:
+            size_t size() const;
+            bool empty() const;
+            void clear();
+            void reserve(size_t storage_size);
+
+            std::string_view name(size_t index) const;
+            std::string_view value(size_t index) const;
+
+            /// @brief Adds a header, even if one with the same name already exists.
+            void add(std::string_view name, std::string_view value);
+            /// @brief Replaces the value of the header name or adds it.
+            void set(std::string_view name, std::string_view value);
+
+            /// @brief Returns the value of header or an empty view if it is missing.
+            std::string_view get(const known_header& header) const;
+            std::string_view get(std::string_view name) const;
+            bool contains(const known_header& header) const;
+            bool contains(std::string_view name) const;
+
+            /// @brief Compatibility with var maps: returns the value of the header or null.
+            var fetch(std::string_view name) const;
+            var to_var() const;
+        private:
+            const entry& at(size_t index) const;
+            entry& at(size_t index);
+            size_t find(std::string_view name) const;
+        };
+        /// @brief Produces a body chunk by chunk. Stores the next chunk in its argument and returns true, or returns false when the body has ended.
+        using body_generator = std::function<bool(std::string& chunk)>;
         struct http_message
         {
             http_message() = default;
@@ -48,97 +142,453 @@ namespace uva
             std::string url;
             std::string endpoint;
             std::string raw_body;
+            /* when set, the body is written with chunked Transfer-Encoding instead of raw_body */
+            body_generator body_stream;
+            /* when set, the body is written from it instead of raw_body. Used to share cached bodies without copying */
+            std::shared_ptr<const std::string> shared_body;
+            /* when set, the body is written from it instead of raw_body. It must live as long as the program, like assets embedded in the binary */
+            std::string_view static_body;
+            /* when set, the body is sent from this file, of file_body_size bytes. On plain http sockets it goes with sendfile(2), without being read into memory */
+            std::filesystem::path file_body;
+            size_t file_body_size = 0;
             std::string host;
             var params;
-            var headers;
+            http_headers headers;
 
             web_connection* connection;
+            /* order of the request in its connection */
+            size_t sequence = 0;
         public:
             http_message& operator=(http_message&& message) = default;
         };
-        template<typename T>
-        class basic_thread_safe_pipeline_waiter
+        /// @brief Resumable parser for the head (start line and headers) of an HTTP/1.1 message.
+        /// It works directly on the receive buffer: every call to parse receives all the bytes read so far
+        /// and continues from where the previous call stopped. Tokens are kept as offsets and returned as
+        /// views into the last buffer passed to parse, so they are valid until that buffer is changed.
+        class http_message_parser
         {
+        public:
+            enum class state
+            {
+                start_line,
+                headers,
+                done
+            };
+            struct span
+            {
+                uint32_t offset = 0;
+                uint32_t size = 0;
+            };
+            struct header_span
+            {
+                span name;
+                span value;
+            };
+            /* heads bigger than this are rejected */
+            static constexpr size_t max_head_size = 64 * 1024;
         private:
-            //thread safe
-            std::mutex m_deque_mutex;
-            //T pipeline
-            std::deque<T> m_deque;
-            //waiter
-            std::condition_variable m_wait_variable;
-            std::mutex m_wait_mutex;
+            state m_state = state::start_line;
+            std::string_view m_data;
+            /* where the current line begins */
+            size_t m_line_offset = 0;
+            /* where the search for the end of current line continues */
+            size_t m_scan_offset = 0;
+            span m_start_line[3];
+            std::vector<header_span> m_headers;
         public:
-        void push_back(T&& t)
+            /// @brief Continues parsing data. Throws std::runtime_error on malformed heads: a start line without three parts, a header line
+            /// without a name and a colon, with whitespace before the colon or folded (obs-fold), or a head bigger than max_head_size.
+            /// @param data All bytes received so far. The bytes passed in previous calls must be at the beginning.
+            /// @return True when the head is complete.
+            bool parse(std::string_view data);
+            void reset();
+            bool is_done() const;
+            /// @brief The size of the head, including the empty line. Valid after parse returns true.
+            size_t head_size() const;
+
+            /// @brief The tokens of start line. For requests: method, target and version. For responses: version, status and reason.
+            std::string_view start_line(size_t index) const;
+            size_t header_count() const;
+            std::string_view header_name(size_t index) const;
+            std::string_view header_value(size_t index) const;
+        private:
+            std::string_view view(const span& s) const;
+            void parse_start_line(size_t begin, size_t end);
+            void parse_header_line(size_t begin, size_t end);
+        };
+        /// @brief What push_back does when a basic_lock_free_pipeline is full.
+        enum class pipeline_full_policy
+        {
+            /* spins until a consumer makes room. Deadlocks when the thread pushing is the one consuming */
+            wait,
+            /* moves the element to a mutex guarded overflow deque, drained once the ring is empty. push_back never blocks */
+            overflow,
+        };
+        /// @brief Bounded lock-free multi producer/multi consumer pipeline. It is a ring buffer where each cell
+        /// carries a sequence number telling whether it is free or ready to be consumed (Dmitry Vyukov's queue).
+        /// Waiting spins for a while and then parks the thread in a futex (std::atomic::wait).
+        /// @tparam T The element type. Must be default constructible and move assignable.
+        /// @tparam Capacity Elements held by the ring. Must be a power of two.
+        /// @tparam FullPolicy What push_back does when the ring is full. try_push_back always fails instead.
+        /// The elements of a producer are popped in the order it pushed them, overflowed or not.
+        template<typename T, size_t Capacity = 1024, pipeline_full_policy FullPolicy = pipeline_full_policy::wait>
+        class basic_lock_free_pipeline
         {
-            std::scoped_lock locker(m_deque_mutex);
+            static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+        private:
+            struct cell
+            {
+                std::atomic<size_t> sequence;
+                T data;
+            };
+            static constexpr size_t s_mask = Capacity - 1;
+            static constexpr size_t s_spin_count = 256;
 
-            m_deque.push_back(std::move(t));
+            std::unique_ptr<cell[]> m_buffer;
 
-            m_wait_variable.notify_one();
-        }
-        T pop_front()
-        {
-            std::scoped_lock locker(m_deque_mutex);
+            //Each position in its own cache line, so producers and consumers do not contend.
+            alignas(64) std::atomic<size_t> m_enqueue_pos = 0;
+            alignas(64) std::atomic<size_t> m_dequeue_pos = 0;
 
-            T& t = m_deque.front();
-            T __t = std::move(t);
+            //waiter
+            alignas(64) std::atomic<uint32_t> m_signal = 0;
+            std::atomic<uint32_t> m_waiters = 0;
 
-            m_deque.pop_front();
+            //overflow, only used with pipeline_full_policy::overflow. While it has elements every push goes to it,
+            //so what a producer pushed to the ring is always popped before what it overflowed.
+            alignas(64) std::atomic<bool> m_overflowing = false;
+            std::mutex m_overflow_mutex;
+            std::deque<T> m_overflow;
+            static constexpr bool s_overflows = FullPolicy == pipeline_full_policy::overflow;
+        public:
+            basic_lock_free_pipeline()
+                : m_buffer(std::make_unique<cell[]>(Capacity))
+            {
+                for(size_t i = 0; i < Capacity; ++i) {
+                    m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+            basic_lock_free_pipeline(const basic_lock_free_pipeline&) = delete;
+            basic_lock_free_pipeline& operator=(const basic_lock_free_pipeline&) = delete;
+        private:
+            static void cpu_relax()
+            {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#elif defined(__aarch64__)
+                asm volatile("yield");
+#else
+                std::this_thread::yield();
+#endif
+            }
+            void notify()
+            {
+                m_signal.fetch_add(1);
 
-            return __t;
-        }
-        T pop_back()
-        {
-            std::scoped_lock locker(m_deque_mutex);
+                //Skip the syscall when no one is parked.
+                if(m_waiters.load()) {
+                    m_signal.notify_all();
+                }
+            }
+            /// @brief Claims up to max free cells for writing. Returns the first position and the number of claimed cells.
+            size_t claim_push(size_t max, size_t& pos)
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
 
-            T& t = m_deque.back();
-            T __t = std::move(t);
+                while(true) {
+                    size_t count = 0;
 
-            m_deque.pop_back();
+                    while(count < max) {
+                        size_t sequence = m_buffer[(pos + count) & s_mask].sequence.load(std::memory_order_acquire);
 
-            return __t;
-        }
-        T& front()
-        {
-            std::scoped_lock locker(m_deque_mutex);
+                        if(sequence != pos + count) {
+                            break;
+                        }
 
-            return m_deque.front();
-        }
-        void consume_front()
-        {
-            std::scoped_lock locker(m_deque_mutex);
-            m_deque.pop_front();
-        }
-        void clear()
-        {
-            std::scoped_lock lock(m_deque_mutex);
-            m_deque.clear();
-        }
+                        ++count;
+                    }
 
-        bool empty()
-        {
-            std::scoped_lock lock(m_deque_mutex);
-            return m_deque.empty();
-        }
+                    if(!count) {
+                        size_t sequence = m_buffer[pos & s_mask].sequence.load(std::memory_order_acquire);
 
-        size_t size()
-        {
-            std::scoped_lock lock(m_deque_mutex);
-            return m_deque.size();
-        }
+                        if((intptr_t)sequence - (intptr_t)pos < 0) {
+                            //full
+                            return 0;
+                        }
 
-        void wait()
-        {
-            while (empty())
+                        //Another producer got this position.
+                        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    if(m_enqueue_pos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                        return count;
+                    }
+                }
+            }
+            /// @brief Claims up to max ready cells for reading. Returns the first position and the number of claimed cells.
+            size_t claim_pop(size_t max, size_t& pos)
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+                while(true) {
+                    size_t count = 0;
+
+                    while(count < max) {
+                        size_t sequence = m_buffer[(pos + count) & s_mask].sequence.load(std::memory_order_acquire);
+
+                        if(sequence != pos + count + 1) {
+                            break;
+                        }
+
+                        ++count;
+                    }
+
+                    if(!count) {
+                        size_t sequence = m_buffer[pos & s_mask].sequence.load(std::memory_order_acquire);
+
+                        if((intptr_t)sequence - (intptr_t)(pos + 1) < 0) {
+                            //empty
+                            return 0;
+                        }
+
+                        //Another consumer got this position.
+                        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    if(m_dequeue_pos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                        return count;
+                    }
+                }
+            }
+            bool ring_empty() const
+            {
+                size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                return m_buffer[pos & s_mask].sequence.load(std::memory_order_acquire) != pos + 1;
+            }
+            /// @brief Moves up to max overflowed elements into items. Called once the ring is empty.
+            size_t try_pop_overflow(T* items, size_t max)
+            {
+                if(!s_overflows || !m_overflowing.load(std::memory_order_acquire)) {
+                    return 0;
+                }
+
+                std::scoped_lock lock(m_overflow_mutex);
+
+                size_t count = std::min(max, m_overflow.size());
+
+                for(size_t i = 0; i < count; ++i) {
+                    items[i] = std::move(m_overflow.front());
+                    m_overflow.pop_front();
+                }
+
+                //Producers go back to the ring.
+                if(m_overflow.empty()) {
+                    m_overflowing.store(false, std::memory_order_release);
+                }
+
+                return count;
+            }
+        public:
+            /// @brief Pushes t to the ring, or returns false without touching t when it is full (or overflowing).
+            bool try_push_back(T&& t)
+            {
+                size_t pos;
+
+                if(s_overflows && m_overflowing.load(std::memory_order_acquire)) {
+                    return false;
+                }
+
+                if(!claim_push(1, pos)) {
+                    return false;
+                }
+
+                cell& c = m_buffer[pos & s_mask];
+                c.data = std::move(t);
+                c.sequence.store(pos + 1, std::memory_order_release);
+
+                notify();
+
+                return true;
+            }
+            /// @brief Moves up to count elements from items into the pipeline with a single claim. Returns the number of elements pushed.
+            size_t try_push_back(T* items, size_t count)
+            {
+                if(s_overflows && m_overflowing.load(std::memory_order_acquire)) {
+                    return 0;
+                }
+
+                size_t pos;
+                size_t claimed = claim_push(count, pos);
+
+                for(size_t i = 0; i < claimed; ++i) {
+                    cell& c = m_buffer[(pos + i) & s_mask];
+                    c.data = std::move(items[i]);
+                    c.sequence.store(pos + i + 1, std::memory_order_release);
+                }
+
+                if(claimed) {
+                    notify();
+                }
+
+                return claimed;
+            }
+            void push_back(T&& t)
+            {
+                if constexpr(s_overflows) {
+                    if(try_push_back(std::move(t))) {
+                        return;
+                    }
+
+                    {
+                        std::scoped_lock lock(m_overflow_mutex);
+                        m_overflow.push_back(std::move(t));
+                        m_overflowing.store(true, std::memory_order_release);
+                    }
+
+                    notify();
+                } else {
+                    while(!try_push_back(std::move(t))) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+            void push_back(T* items, size_t count)
+            {
+                if constexpr(s_overflows) {
+                    size_t pushed = try_push_back(items, count);
+
+                    for(size_t i = pushed; i < count; ++i) {
+                        push_back(std::move(items[i]));
+                    }
+
+                    return;
+                }
+
+                while(count) {
+                    size_t pushed = try_push_back(items, count);
+
+                    if(!pushed) {
+                        std::this_thread::yield();
+                    }
+
+                    items += pushed;
+                    count -= pushed;
+                }
+            }
+            bool try_pop_front(T& t)
+            {
+                size_t pos;
+
+                if(!claim_pop(1, pos)) {
+                    return try_pop_overflow(&t, 1) == 1;
+                }
+
+                cell& c = m_buffer[pos & s_mask];
+                t = std::move(c.data);
+                c.sequence.store(pos + Capacity, std::memory_order_release);
+
+                return true;
+            }
+            /// @brief Moves up to max elements into items with a single claim. Returns the number of elements popped.
+            size_t try_pop_front(T* items, size_t max)
+            {
+                size_t pos;
+                size_t claimed = claim_pop(max, pos);
+
+                if(!claimed) {
+                    return try_pop_overflow(items, max);
+                }
+
+                for(size_t i = 0; i < claimed; ++i) {
+                    cell& c = m_buffer[(pos + i) & s_mask];
+                    items[i] = std::move(c.data);
+                    c.sequence.store(pos + i + Capacity, std::memory_order_release);
+                }
+
+                return claimed;
+            }
+            T pop_front()
+            {
+                T t;
+
+                while(!try_pop_front(t)) {
+                    wait();
+                }
+
+                return t;
+            }
+            /// @brief Only valid with a single consumer and when the pipeline is not empty.
+            T& front()
             {
-                std::unique_lock<std::mutex> ul(m_wait_mutex);
-                m_wait_variable.wait(ul);
+                if(s_overflows && ring_empty()) {
+                    std::scoped_lock lock(m_overflow_mutex);
+                    //References to deque elements stay valid while producers push behind them.
+                    return m_overflow.front();
+                }
+
+                return m_buffer[m_dequeue_pos.load(std::memory_order_relaxed) & s_mask].data;
+            }
+            void consume_front()
+            {
+                T t;
+                try_pop_front(t);
+            }
+            void clear()
+            {
+                T t;
+                while(try_pop_front(t));
+            }
+            bool empty() const
+            {
+                return ring_empty() && !(s_overflows && m_overflowing.load(std::memory_order_acquire));
+            }
+            /// @brief Approximated when called concurrently with producers or consumers.
+            size_t size()
+            {
+                size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                size_t size = enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+
+                if(s_overflows && m_overflowing.load(std::memory_order_acquire)) {
+                    std::scoped_lock lock(m_overflow_mutex);
+                    size += m_overflow.size();
+                }
+
+                return size;
+            }
+            static constexpr size_t capacity()
+            {
+                return Capacity;
+            }
+            void wait()
+            {
+                for(size_t i = 0; i < s_spin_count; ++i) {
+                    if(!empty()) {
+                        return;
+                    }
+
+                    cpu_relax();
+                }
+
+                while(empty()) {
+                    uint32_t signal = m_signal.load();
+                    m_waiters.fetch_add(1);
+
+                    if(empty()) {
+                        m_signal.wait(signal);
+                    }
+
+                    m_waiters.fetch_sub(1);
+                }
             }
-        }
         };
         enum class run_mode
         {
             async,
+            /* one io_context per thread, connections spread across them */
+            async_pool,
             sync
         };
         enum class protocol
@@ -147,67 +597,352 @@ namespace uva
             https,
         };
         using error_code = asio::error_code;
+
+        /// @brief TLS stream whose SSL object reads and writes the socket itself, so OpenSSL can hand the record encryption to the kernel (kTLS).
+        /// asio::ssl::stream keeps its SSL object behind memory BIOs, where kTLS is never enabled. Models asio's AsyncReadStream and AsyncWriteStream.
+        class ktls_stream
+        {
+        public:
+            using executor_type = asio::ip::tcp::socket::executor_type;
+            using lowest_layer_type = asio::ip::tcp::socket::lowest_layer_type;
+
+            ktls_stream(asio::ip::tcp::socket&& __socket, asio::ssl::context& __context);
+            ktls_stream(const ktls_stream&) = delete;
+            ~ktls_stream();
+        private:
+            asio::ip::tcp::socket m_socket;
+            SSL* m_ssl = nullptr;
+        public:
+            executor_type get_executor() { return m_socket.get_executor(); }
+            lowest_layer_type& lowest_layer() { return m_socket.lowest_layer(); }
+            const lowest_layer_type& lowest_layer() const { return m_socket.lowest_layer(); }
+            asio::ip::tcp::socket& next_layer() { return m_socket; }
+            SSL* native_handle() { return m_ssl; }
+
+            /// @brief Whether the kernel encrypts what is written, only known after the handshake.
+            bool ktls_send() const;
+            /// @brief Whether the kernel decrypts what is read, only known after the handshake.
+            bool ktls_receive() const;
+
+            void handshake(asio::ssl::stream_base::handshake_type type, error_code& ec);
+            void async_handshake(asio::ssl::stream_base::handshake_type type, std::function<void(error_code)> completation);
+
+            /// @brief Asynchronous write size bytes of fd, starting at offset, with SSL_sendfile. Requires ktls_send().
+            void async_sendfile(int fd, uint64_t offset, size_t size, std::function<void(error_code&)> completation);
+
+            // Buffer sequences are written one buffer at time, asio's composed operations loop over the rest.
+            template<typename BufferSequence>
+            static auto first_buffer(const BufferSequence& buffers)
+            {
+                auto it = asio::buffer_sequence_begin(buffers);
+                auto end = asio::buffer_sequence_end(buffers);
+
+                for(; it != end; ++it) {
+                    if(asio::buffer_size(*it)) {
+                        return *it;
+                    }
+                }
+
+                return std::decay_t<decltype(*it)>();
+            }
+
+            template<typename MutableBufferSequence>
+            size_t read_some(const MutableBufferSequence& buffers, error_code& ec)
+            {
+                return ssl_read(asio::mutable_buffer(first_buffer(buffers)), ec);
+            }
+
+            template<typename MutableBufferSequence>
+            size_t read_some(const MutableBufferSequence& buffers)
+            {
+                error_code ec;
+                size_t read = read_some(buffers, ec);
+                asio::detail::throw_error(ec, "read_some");
+                return read;
+            }
+
+            template<typename ConstBufferSequence>
+            size_t write_some(const ConstBufferSequence& buffers, error_code& ec)
+            {
+                return ssl_write(asio::const_buffer(first_buffer(buffers)), ec);
+            }
+
+            template<typename ConstBufferSequence>
+            size_t write_some(const ConstBufferSequence& buffers)
+            {
+                error_code ec;
+                size_t written = write_some(buffers, ec);
+                asio::detail::throw_error(ec, "write_some");
+                return written;
+            }
+
+            // asio's handlers may be move-only, std::function needs them copyable.
+            template<typename MutableBufferSequence, typename ReadHandler>
+            void async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler)
+            {
+                auto shared_handler = std::make_shared<std::decay_t<ReadHandler>>(std::forward<ReadHandler>(handler));
+                async_ssl_read(asio::mutable_buffer(first_buffer(buffers)), [shared_handler](error_code ec, size_t read) {
+                    (*shared_handler)(ec, read);
+                });
+            }
+
+            template<typename ConstBufferSequence, typename WriteHandler>
+            void async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler)
+            {
+                auto shared_handler = std::make_shared<std::decay_t<WriteHandler>>(std::forward<WriteHandler>(handler));
+                async_ssl_write(asio::const_buffer(first_buffer(buffers)), [shared_handler](error_code ec, size_t written) {
+                    (*shared_handler)(ec, written);
+                });
+            }
+        private:
+            size_t ssl_read(asio::mutable_buffer buffer, error_code& ec);
+            size_t ssl_write(asio::const_buffer buffer, error_code& ec);
+            void async_ssl_read(asio::mutable_buffer buffer, std::function<void(error_code, size_t)> completation);
+            void async_ssl_write(asio::const_buffer buffer, std::function<void(error_code, size_t)> completation);
+            void async_ssl_operation(std::function<int(size_t&)> operation, std::function<void(error_code, size_t)> completation);
+        };
+
+        /// @brief A socket over a stream type known at compile time: asio::ip::tcp::socket, asio::ssl::stream or ktls_stream.
+        /// Every operation goes straight to the stream, with no runtime switch. The http functions are instantiated for each of them.
+        template<typename Stream>
+        class basic_stream_socket
+        {
+        public:
+            using stream_type = Stream;
+            static constexpr bool is_secure = !std::is_same_v<Stream, asio::ip::tcp::socket>;
+
+            /// @brief Takes over __socket. Secure streams use ssl_context.
+            basic_stream_socket(asio::ip::tcp::socket&& __socket);
+            /// @brief Takes over __socket. Secure streams use __context.
+            basic_stream_socket(asio::ip::tcp::socket&& __socket, asio::ssl::context& __context);
+            basic_stream_socket(const basic_stream_socket&) = delete;
+            ~basic_stream_socket();
+        private:
+            Stream m_stream;
+        public:
+            Stream& stream() { return m_stream; }
+            const Stream& stream() const { return m_stream; }
+            asio::ip::tcp::socket::lowest_layer_type& lowest_layer() { return m_stream.lowest_layer(); }
+            /// @brief The executor of the io_context the socket runs on, like basic_socket::get_executor.
+            asio::ip::tcp::socket::executor_type get_executor() { return m_stream.lowest_layer().get_executor(); }
+
+            bool is_open() const;
+            constexpr bool needs_handshake() const { return is_secure; }
+            size_t available() const;
+            size_t available(error_code& ec) const;
+            std::string remote_endpoint_string() const;
+
+            /// @brief Plain sockets have no handshake, they succeed right away. Successful handshakes are counted in tls_handshake_counters.
+            error_code server_handshake();
+            error_code client_handshake();
+            void async_client_handshake(std::function<void(error_code)> completation);
+            void async_server_handshake(std::function<void(error_code)> completation);
+            /// @brief Runs the handshake on the thread of context, where completation is called. The socket stays on its own io_context.
+            /// asio::ssl::stream binds its handshake steps to context, kTLS streams are rebound to context for the handshake and back.
+            void async_server_handshake(asio::io_context& context, std::function<void(error_code)> completation);
+
+            /// @brief Moves the socket to context, where its next operations complete. None may be pending.
+            /// Supported by plain and kTLS streams, asio::ssl::stream fails with operation_not_supported.
+            error_code rebind(asio::io_context& context);
+
+            void close();
+
+            void async_read_until(asio::streambuf& buffer, std::string_view delimiter, std::function<void(error_code, size_t)> completation);
+            /// @brief Reads whatever is available (at least one byte) into buffer.
+            void async_read_some(asio::streambuf& buffer, std::function<void(error_code, size_t)> completation);
+            void write(std::string_view sv);
+            void async_write(std::string_view sv, std::function<void(error_code&)> completation);
+            /// @brief Writes all buffers in a single gather operation. The buffers should be alive until completation is called.
+            void async_write(const std::vector<asio::const_buffer>& buffers, std::function<void(error_code&)> completation);
+
+            void read_exactly(char* buffer, size_t to_read);
+            void read_exactly(std::string& buffer, size_t to_read);
+            void async_read_exactly(asio::mutable_buffer buffer, size_t to_read, std::function<void(error_code, size_t)> completation);
+
+            uint8_t read_byte();
+
+            /// @brief Asynchronous write size bytes of the file at path. Plain sockets use sendfile(2) on Linux, and so do kTLS streams with send offload.
+            /// The others read and write the file in chunks.
+            void async_send_file(const std::filesystem::path& path, size_t size, std::function<void(error_code&)> completation);
+        };
+        using http_socket = basic_stream_socket<asio::ip::tcp::socket>;
+        using https_socket = basic_stream_socket<asio::ssl::stream<asio::ip::tcp::socket>>;
+        using ktls_socket = basic_stream_socket<ktls_stream>;
+
+        /// @brief Holds one of the stream sockets, for when the protocol is only known at runtime (like web_client, which connects to any url).
+        /// Each operation is a single dispatch to the socket in use. Servers know the protocol of each listener and use the stream sockets directly.
         class basic_socket
         {
         public:
             basic_socket(asio::ip::tcp::socket&& __socket, const protocol& __protocol);
-            basic_socket(basic_socket&& __socket);
+            basic_socket(basic_socket&& __socket) = default;
             operator bool();
             basic_socket() = default;
-            ~basic_socket();
         protected:
-            std::unique_ptr<asio::ssl::stream<asio::ip::tcp::socket>> m_ssl_socket = nullptr;
-            std::unique_ptr<asio::ip::tcp::socket> m_socket = nullptr;
-            protocol m_protocol;
+            std::variant<std::unique_ptr<http_socket>, std::unique_ptr<https_socket>, std::unique_ptr<ktls_socket>> m_socket;
+            protocol m_protocol = protocol::http;
+            /* the host connected to, its tls session is resumed on reconnect */
+            std::string m_host;
+
+            /// @brief Calls function with the socket in use, whichever it is. There must be one.
+            template<typename Function>
+            auto with_socket(Function&& function) const -> decltype(function(std::declval<http_socket&>()))
+            {
+                return std::visit([&function](auto& socket) {
+                    return function(*socket);
+                }, m_socket);
+            }
+
+            void set_connected_socket(asio::ip::tcp::socket&& __socket);
+            void resume_tls_session();
         public:
             bool is_open() const;
             bool needs_handshake() const;
             size_t available() const;
             size_t available(error_code& ec) const;
             std::string remote_endpoint_string() const;
+            /// @brief Whether an idle connection can carry another request: it is open, the peer did not close it and there is nothing unread,
+            /// in the socket or decrypted by TLS. Peeks the socket without blocking, so no read may be pending on it. Call it from get_executor().
+            bool is_reusable() const;
+            /// @brief The executor of the io_context the socket runs on. Operations on a connected socket should be started from it.
+            asio::ip::tcp::socket::executor_type get_executor() const;
 
             error_code server_handshake();
             error_code client_handshake();
             void async_client_handshake(std::function<void(error_code)> completation);
             void async_server_handshake(std::function<void(error_code)> completation);
 
+            /// @brief Tries the resolved addresses one after the other, IPv6 and IPv4 alternating.
             error_code connect(const std::string& protocol, const std::string& host);
+            /// @brief Races connections to the resolved addresses (RFC 8305 Happy Eyeballs), IPv6 and IPv4 alternating, each one started
+            /// 250ms after the previous or as soon as it fails. The first to connect is kept.
             void connect_async(const std::string& protocol, const std::string& host, std::function<void(error_code)> completation);
 
             void close();
 
             void read_until(std::string& buffer, std::string_view delimiter);
             void async_read_until(asio::streambuf& buffer, std::string_view delimiter, std::function<void(error_code, size_t)> completation);
+            /// @brief Reads whatever is available (at least one byte) into buffer.
+            void async_read_some(asio::streambuf& buffer, std::function<void(error_code, size_t)> completation);
             void write(std::string_view sv);
             void async_write(std::string_view sv, std::function<void(error_code&)> completation);
+            /// @brief Writes all buffers in a single gather operation. The buffers should be alive until completation is called.
+            void async_write(const std::vector<asio::const_buffer>& buffers, std::function<void(error_code&)> completation);
 
             void read_exactly(char* buffer, size_t to_read);
             void read_exactly(std::string& buffer, size_t to_read);
             void async_read_exactly(asio::mutable_buffer buffer, size_t to_read, std::function<void(error_code, size_t)> completation);
 
             uint8_t read_byte();
+
+            /// @brief Asynchronous write size bytes of the file at path. Plain http sockets use sendfile(2) on Linux, and so do https sockets with kTLS send offload.
+            /// The others read and write the file in chunks.
+            void async_send_file(const std::filesystem::path& path, size_t size, std::function<void(error_code&)> completation);
         };
 
-        extern std::unique_ptr<asio::io_context> io_context;
-        extern std::unique_ptr<asio::io_context::work> work;
         extern std::unique_ptr<asio::ssl::context> ssl_context;
+        /* used by the connections basic_socket makes, apart from the server ones */
+        extern std::unique_ptr<asio::ssl::context> client_ssl_context;
 
         extern const std::string version;
 
-        void init(const run_mode& mode);
+        /// @brief Enables kernel TLS offload (SSL_OP_ENABLE_KTLS) for the https connections accepted from now on. Must be called after init.
+        /// @return Whether OpenSSL and the running kernel support kTLS. When they do not, nothing changes.
+        bool enable_ktls();
+        bool ktls_enabled();
+        /// @brief Whether init loaded server.crt and server.key into ssl_context. Without them https connections cannot be accepted.
+        bool has_server_certificate();
+
+        /// @brief Initializes the networking runtime.
+        /// @param mode run_mode::async runs a single io_context in a background thread. run_mode::async_pool runs io_threads io_contexts, each one in its own thread.
+        /// @param io_threads Number of io_contexts for run_mode::async_pool. Zero means one per hardware thread.
+        void init(const run_mode& mode, size_t io_threads = 0);
         bool is_initialized();
         void cleanup();
 
-        void async_read_http_request(basic_socket &socket, http_message& request, asio::streambuf& buffer, std::function<void()> completation);
-        void async_write_http_response(basic_socket& socket, const std::string& body, const status_code& status, const content_type& content_type, std::function<void (uva::networking::error_code &)> completation);
+        /// @brief The number of io_contexts started by init.
+        size_t io_context_count();
+        /// @brief The first io_context. Acceptors are bound to it.
+        asio::io_context& main_io_context();
+        /// @brief Returns the io_contexts in a round-robin fashion. New sockets should be created on it.
+        asio::io_context& next_io_context();
+        /// @brief Stands in for the single io_context init used to create, so code written against it still builds. Forwards to main_io_context().
+        class main_io_context_alias
+        {
+        public:
+            asio::io_context* operator->() const { return &main_io_context(); }
+            asio::io_context& operator*() const { return main_io_context(); }
+            asio::io_context* get() const { return &main_io_context(); }
+            explicit operator bool() const { return is_initialized(); }
+        };
+        [[deprecated("use main_io_context(), or next_io_context() for new sockets")]]
+        extern main_io_context_alias io_context;
+        /// @brief Starts count threads, each one running its own io_context, for TLS handshakes. Must be called after init.
+        void start_handshake_threads(size_t count);
+        size_t handshake_thread_count();
+        /// @brief The handshake io_contexts in a round-robin fashion, or next_io_context when no handshake thread was started.
+        asio::io_context& next_handshake_context();
+        /// @brief Asynchronous resolve a query using the resolver owned by the thread which runs context. Successful resolutions are
+        /// cached, for every client, see set_resolve_cache_ttl.
+        void async_resolve(asio::io_context& context, const std::string& host, const std::string& service, std::function<void(error_code, asio::ip::tcp::resolver::results_type)> completation);
+        /// @brief How long resolutions are reused, 60 seconds by default. Zero disables the cache.
+        /// The system resolver does not report the record TTLs, so this bounds them. A host is resolved again after all its addresses failed to connect.
+        void set_resolve_cache_ttl(std::chrono::seconds ttl);
+        void clear_resolve_cache();
+        /// @brief Connects to the first of endpoints to accept, Happy Eyeballs style (RFC 8305): in order, each one 250ms after the previous
+        /// or right after it fails, the ones in flight kept going. The others are closed. Fails with the last error once all of them failed.
+        /// Runs on context, where completation is called. basic_socket::connect_async orders the resolved addresses, IPv6 and IPv4 alternating.
+        void async_connect_race(asio::io_context& context, std::vector<asio::ip::tcp::endpoint> endpoints, std::function<void(error_code, asio::ip::tcp::socket&&)> completation);
+
+        /// @brief The largest body the http functions below store, 8 MiB by default. Content-Length, chunk sizes and trailer fields count against it,
+        /// and a bigger message fails with std::errc::value_too_large. Bodies delivered to a chunk callback are not stored, only their trailers are bounded.
+        void set_max_body_size(size_t size);
+        size_t max_body_size();
+
+        // The http functions below take basic_socket or any of the stream sockets. They are instantiated for each one in networking.cpp.
+
+        /// @brief Asynchronous read an http request from the socket.
+        /// @param buffer The connection receive buffer. It may already contain pipelined requests.
+        /// @param parser The connection parser. Keeps the progress between partial reads.
+        /// @param on_error Is called instead of completation when reading fails, with std::errc::bad_message when the request is malformed,
+        /// or with std::errc::value_too_large when its body is bigger than max_body_size. The connection cannot be read any further then.
+        template<typename Socket>
+        void async_read_http_request(Socket& socket, http_message& request, asio::streambuf& buffer, http_message_parser& parser, std::function<void()> completation, std::function<void(error_code&)> on_error);
+        template<typename Socket>
+        void async_write_http_response(Socket& socket, const std::string& body, const status_code& status, const content_type& content_type, std::function<void (uva::networking::error_code &)> completation);
+        /// @brief Asynchronous write response into the socket. Head and body are written in a single gather write, or, when response.body_stream is set,
+        /// the head is followed by the chunks it generates. TLS sockets write each buffer as its own record, so there a body fitting in one record
+        /// with its head is copied after it. The response should not be destroyed untill completation is called.
+        template<typename Socket>
+        void async_write_http_response(Socket& socket, const http_message& response, std::function<void(error_code&)> completation);
+        /// @brief Asynchronous write responses, in order, in a single gather write. None of them may have body_stream or file_body set.
+        /// On TLS sockets, bodies fitting in one record with their head are copied next to the heads, so small responses share records.
+        /// @param max_batch_size The responses after this many bytes (heads and bodies) are left out. The first one is always written.
+        /// @return The number of responses written. The same number is passed to completation. They should not be destroyed untill completation is called.
+        template<typename Socket>
+        size_t async_write_http_responses(Socket& socket, const std::vector<const http_message*>& responses, size_t max_batch_size, std::function<void(error_code&, size_t)> completation);
+        /// @brief Appends the head of response to out. Status, Server, Date and Content-Type lines are pre-encoded, and Date is refreshed once per second.
+        void append_http_response_head(std::string& out, const http_message& response);
+        /// @brief Asynchronous write a single chunk. The chunk and size_line (at least 2 * sizeof(size_t) + 2 bytes) should be alive until completation is called.
+        template<typename Socket>
+        void async_write_chunk(Socket& socket, std::string_view chunk, char* size_line, std::function<void(error_code&)> completation);
+        /// @brief Asynchronous write the chunks produced by generator, followed by the last chunk.
+        template<typename Socket>
+        void async_write_chunked_body(Socket& socket, body_generator generator, std::function<void(error_code&)> completation);
 
         /// @brief Asynchronous write an http request into the socket. 
         /// @param socket The socket to write to.
         /// @param request The request to be written into socket. The request should not be destroyed untill completation is called. The request should not be used after calling this function.
         /// @param on_success Is called on success
         /// @param on_error  Is called on error
-        void async_write_http_request(basic_socket& socket, http_message& request, std::function<void()> on_success, std::function<void(error_code&)> on_error = nullptr);
-        void async_read_http_response(basic_socket& socket, http_message& response, asio::streambuf& buffer, std::function<void()> completation);
+        template<typename Socket>
+        void async_write_http_request(Socket& socket, http_message& request, std::function<void()> on_success, std::function<void(error_code&)> on_error = nullptr);
+        /// @brief Asynchronous read an http response from the socket.
+        /// @param on_body_chunk If set, the body is delivered to it as it arrives, instead of being stored in response.raw_body.
+        /// @param on_error Is called when reading fails, with std::errc::bad_message when the response is malformed, or with std::errc::value_too_large
+        /// when its body is bigger than max_body_size. Without it, a failed read never completes.
+        template<typename Socket>
+        void async_read_http_response(Socket& socket, http_message& response, asio::streambuf& buffer, http_message_parser& parser, std::function<void()> completation, std::function<void(std::string_view)> on_body_chunk = nullptr, std::function<void(error_code&)> on_error = nullptr);
 
         void decode_char_from_web(std::string_view& sv, std::string& buffer);
         std::map<var, var> query_to_params(std::string_view query);
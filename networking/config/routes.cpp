@@ -14,4 +14,6 @@ DECLARE_CONSOLE_APPLICATION(
 
     ROUTE("new-project", networking_controller::new_project);
     ROUTE("new-controller", networking_controller::new_controller);
+    ROUTE("compile-views", networking_controller::compile_views);
+    ROUTE("embed-assets", networking_controller::embed_assets);
 )
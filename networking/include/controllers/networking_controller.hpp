@@ -9,4 +9,6 @@ class networking_controller : public basic_controller
 public:
     void new_project();
     void new_controller();
+    void compile_views();
+    void embed_assets();
 };
@@ -1,9 +1,15 @@
 #include <networking_controller.hpp>
 
 #include <iostream>
+#include <algorithm>
+#include <fstream>
 
 #include <console.hpp>
 #include <file.hpp>
+#include <html_template.hpp>
+#include <asset_cache.hpp>
+
+using namespace uva::networking::web_application;
 
 void networking_controller::new_project()
 {
@@ -110,3 +116,236 @@ R"~~~(#include <{}_controller.hpp>
     uva::file::write_all_text(controller_include / (controller_name + "_controller.hpp"), std::format(controller_header_format, controller_name));
     uva::file::write_all_text(controller_source  / (controller_name + "_controller.cpp"), std::format(controller_source_format, controller_name));
 }
+
+//Octal escapes never take the following character, unlike hexadecimal ones.
+static std::string cpp_string_literal(std::string_view text)
+{
+    std::string literal;
+    literal.reserve(text.size() + 2);
+    literal.push_back('"');
+
+    for(char c : text) {
+        switch(c)
+        {
+            case '"':
+                literal += "\\\"";
+            break;
+            case '\\':
+                literal += "\\\\";
+            break;
+            case '\n':
+                literal += "\\n";
+            break;
+            case '\t':
+                literal += "\\t";
+            break;
+            case '\r':
+                literal += "\\r";
+            break;
+            case '?':
+                //Avoid trigraphs.
+                literal += "\\?";
+            break;
+            default:
+                if((unsigned char)c < 0x20 || (unsigned char)c >= 0x7f) {
+                    literal += std::format("\\{:03o}", (unsigned char)c);
+                } else {
+                    literal.push_back(c);
+                }
+            break;
+        }
+    }
+
+    literal.push_back('"');
+
+    return literal;
+}
+
+void networking_controller::compile_views()
+{
+    if(params.size() < 2) {
+        log_error("error: usage: compile-views <views folder> <output file> [helpers folder]");
+        return;
+    }
+
+    //MSVC limits string literals to 16KiB.
+    static constexpr size_t max_literal_size = 8 * 1024;
+
+    std::filesystem::path views_root = params[0].to_s();
+    std::filesystem::path output_path = params[1].to_s();
+
+    if(!std::filesystem::exists(views_root)) {
+        log_error("error: cannot find views folder '{}'", views_root.string());
+        return;
+    }
+
+    std::vector<std::filesystem::path> views;
+
+    for(const auto& entry : std::filesystem::recursive_directory_iterator(views_root)) {
+        if(entry.is_regular_file() && entry.path().extension() == ".html") {
+            views.push_back(entry.path());
+        }
+    }
+
+    //The output must not depend on the directory iteration order.
+    std::sort(views.begin(), views.end());
+
+    std::string output = "// Generated by 'networking compile-views', do not edit.\n"
+                         "#include <web_application.hpp>\n";
+
+    if(params.size() > 2) {
+        std::filesystem::path helpers_root = params[2].to_s();
+        std::vector<std::string> helpers;
+
+        if(std::filesystem::exists(helpers_root)) {
+            for(const auto& entry : std::filesystem::directory_iterator(helpers_root)) {
+                if(entry.path().string().ends_with("_helper.hpp")) {
+                    helpers.push_back(entry.path().filename().string());
+                }
+            }
+        }
+
+        std::sort(helpers.begin(), helpers.end());
+
+        for(const std::string& helper : helpers) {
+            output += std::format("#include <{}>\n", helper);
+        }
+    }
+
+    output += "\nusing namespace uva;\nusing namespace networking;\nusing namespace web_application;\n";
+
+    for(size_t i = 0; i < views.size(); ++i) {
+        const std::filesystem::path& path = views[i];
+
+        std::filesystem::path relative = std::filesystem::relative(path, views_root);
+        std::string controller = relative.parent_path().generic_string();
+        std::string name = relative.filename().string();
+        bool is_template = name.ends_with(".cpp.html");
+
+        name.erase(name.find('.'));
+
+        basic_compiled_html_template compiled(uva::file::read_all_text<char>(path.string()), is_template, nullptr);
+
+        size_t literal_size = 0;
+
+        for(const auto& node : compiled.nodes()) {
+            literal_size += node.size;
+        }
+
+        output += std::format("\n// {}\nstatic std::string view_{}(const var& locals)\n{{\n    std::string output;\n    output.reserve({});\n", relative.generic_string(), i, literal_size);
+
+        for(const auto& node : compiled.nodes()) {
+            switch(node.type)
+            {
+                case basic_compiled_html_template::node_type::literal: {
+                    std::string_view literal = compiled.literal(node);
+
+                    for(size_t offset = 0; offset < literal.size(); offset += max_literal_size) {
+                        std::string_view piece = literal.substr(offset, max_literal_size);
+                        output += std::format("    output.append({}, {});\n", cpp_string_literal(piece), piece.size());
+                    }
+                }
+                break;
+                case basic_compiled_html_template::node_type::variable:
+                    output += std::format("    {{\n        var value = locals.fetch({});\n        if(value) {{\n            output += value.to_s();\n        }}\n    }}\n", cpp_string_literal(node.name));
+                break;
+                case basic_compiled_html_template::node_type::function_call:
+                    //Called directly, so a function which does not exist fails the build.
+                    output += std::format("    {{\n        static const var arguments = parse_argument_list({});\n        output += {}(arguments);\n    }}\n", cpp_string_literal(node.arguments_text), node.name);
+                break;
+            }
+        }
+
+        output += std::format("    return output;\n}}\n\nstatic const bool view_{}_registered = register_compiled_view({}, {}, &view_{});\n", i, cpp_string_literal(controller), cpp_string_literal(name), i);
+    }
+
+    std::filesystem::create_directories(output_path.parent_path());
+    uva::file::write_all_text(output_path, output);
+
+    log_success("Compiled {} view(s) into {}", views.size(), output_path.string());
+}
+
+static std::string read_binary_file(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string content;
+
+    file.seekg(0, std::ios::end);
+    content.resize((size_t)file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read(content.data(), content.size());
+
+    return content;
+}
+
+void networking_controller::embed_assets()
+{
+    if(params.size() < 2) {
+        log_error("error: usage: embed-assets <app folder> <output file>");
+        return;
+    }
+
+    std::filesystem::path app_root = params[0].to_s();
+    std::filesystem::path output_path = params[1].to_s();
+
+    if(!std::filesystem::exists(app_root)) {
+        log_error("error: cannot find app folder '{}'", app_root.string());
+        return;
+    }
+
+    //Relative paths with '/' separators, which is what the archive is searched by.
+    std::vector<std::string> assets;
+
+    for(auto it = std::filesystem::recursive_directory_iterator(app_root); it != std::filesystem::recursive_directory_iterator(); ++it) {
+        //Views are compiled into the binary by compile-views.
+        if(it->is_directory() && it.depth() == 0 && it->path().filename() == "views") {
+            it.disable_recursion_pending();
+            continue;
+        }
+
+        if(it->is_regular_file()) {
+            assets.push_back(std::filesystem::relative(it->path(), app_root).generic_string());
+        }
+    }
+
+    //The archive is binary searched.
+    std::sort(assets.begin(), assets.end());
+
+    std::string output = "// Generated by 'networking embed-assets', do not edit.\n"
+                         "#include <asset_cache.hpp>\n"
+                         "\nusing namespace uva;\nusing namespace networking;\nusing namespace web_application;\n";
+
+    std::string archive = "\nstatic const embedded_asset archive[] = {\n";
+
+    for(size_t i = 0; i < assets.size(); ++i) {
+        std::filesystem::path path = app_root / assets[i];
+        std::string content = read_binary_file(path);
+
+        output += std::format("\n// {}\nstatic const unsigned char asset_{}[] = {{", assets[i], i);
+
+        for(size_t j = 0; j < content.size(); ++j) {
+            output += std::format("{}{},", j % 24 ? " " : "\n    ", (unsigned int)(unsigned char)content[j]);
+        }
+
+        //Arrays cannot be empty, the extra byte is not part of the asset.
+        output += std::format("{}0\n}};\n", content.size() % 24 ? " " : "\n    ");
+
+        content_type type = content_type_from_extension(path.extension().string());
+
+        archive += std::format("    {{ {}, std::string_view((const char*)asset_{}, {}), static_cast<content_type>({}), {}, {} }},\n",
+            cpp_string_literal(assets[i]), i, content.size(), (int)type,
+            cpp_string_literal(make_etag(content)), cpp_string_literal(http_date(std::filesystem::last_write_time(path))));
+    }
+
+    if(assets.empty()) {
+        archive += "    { }\n";
+    }
+
+    output += archive;
+    output += std::format("}};\n\nstatic const bool archive_registered = register_embedded_assets(archive, {});\n", assets.size());
+
+    std::filesystem::create_directories(output_path.parent_path());
+    uva::file::write_all_text(output_path, output);
+
+    log_success("Embedded {} asset(s) into {}", assets.size(), output_path.string());
+}
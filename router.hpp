@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <array>
+
+namespace uva
+{
+    namespace networking
+    {
+        namespace web_application
+        {
+            /// @brief What basic_router::find matched. Everything points into the router and the searched path, nothing is allocated.
+            struct route_match
+            {
+                static constexpr size_t max_params = 16;
+                /* the key the route was added with, like "GET /users/:id" */
+                const std::string* route = nullptr;
+                size_t param_count = 0;
+                /* name, value */
+                std::array<std::pair<std::string_view, std::string_view>, max_params> params;
+            };
+            /// @brief Per method radix trees of routes like "/users/:id/posts/*rest".
+            /// A ":name" segment matches up to the next '/', a "*name" segment matches the rest of the path. On conflicts,
+            /// static text wins over parameters, and parameters over splats. Lookup walks the path once, except where a static segment
+            /// and a parameter or splat compete at the same position: when the static branch fails further down, lookup backtracks
+            /// and tries the others. Only routes sharing such prefixes pay for it.
+            /// Routes are added during startup, finding is then safe from any thread.
+            class basic_router
+            {
+            private:
+                struct node
+                {
+                    /* static text matched by this node, empty for parameter and splat nodes */
+                    std::string label;
+                    /* their labels start with distinct characters */
+                    std::vector<std::unique_ptr<node>> children;
+                    std::unique_ptr<node> parameter;
+                    std::unique_ptr<node> splat;
+                    /* parameter and splat nodes */
+                    std::string name;
+                    /* not empty when a route ends here */
+                    std::string route;
+                };
+                struct method_tree
+                {
+                    method_tree(std::string_view __method)
+                        : method(__method)
+                    {
+                    }
+
+                    std::string method;
+                    node root;
+                };
+                std::vector<method_tree> m_trees;
+            public:
+                /// @brief Adds path for method. route is what find reports back. Throws if the path is ambiguous with an existing route.
+                void add(std::string_view method, std::string_view path, std::string route);
+                bool find(std::string_view method, std::string_view path, route_match& match) const;
+                size_t size() const;
+            private:
+                node* add_static(node* current, std::string_view text);
+                bool find(const node* current, std::string_view path, route_match& match) const;
+            };
+            /// @brief The router filled by the GET and POST macros.
+            basic_router& router();
+        }; // namespace web_application
+    }; // namespace networking
+}; // namespace uva
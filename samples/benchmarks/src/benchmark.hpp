@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+    #include <sys/resource.h>
+#endif
+
+#include <format.hpp>
+
+/// @brief Helpers shared by the benchmarks. Each benchmark is its own executable, prints one line per measurement
+/// and takes its parameters as --name=value arguments.
+namespace benchmark
+{
+    using clock = std::chrono::steady_clock;
+
+    /// @brief The value of --name=value in argv, or default_value when it is not there.
+    inline size_t argument(int argc, const char** argv, std::string_view name, size_t default_value)
+    {
+        for(int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+
+            if(arg.starts_with("--") && arg.substr(2).starts_with(name) && arg.size() > name.size() + 2 && arg[name.size() + 2] == '=') {
+                return std::strtoull(arg.data() + name.size() + 3, nullptr, 10);
+            }
+        }
+
+        return default_value;
+    }
+
+    inline double seconds_since(clock::time_point start)
+    {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    /// @brief Runs f once and returns how long it took, in seconds.
+    template<typename F>
+    double measure(F&& f)
+    {
+        clock::time_point start = clock::now();
+        f();
+        return seconds_since(start);
+    }
+
+    /// @brief The p-th percentile (0 to 100) of samples. Sorts samples.
+    inline double percentile(std::vector<double>& samples, double p)
+    {
+        if(samples.empty()) {
+            return 0;
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        size_t index = (size_t)((p / 100.0) * (samples.size() - 1) + 0.5);
+        return samples[index];
+    }
+
+    /// @brief Prints the throughput of operations done in seconds.
+    inline void report(std::string_view name, size_t operations, double seconds)
+    {
+        std::cout << std::format("{:<48} {:>12.0f} ops/s {:>10.1f} ns/op\n", name, operations / seconds, seconds * 1e9 / operations);
+    }
+
+    /// @brief Prints the p50, p99 and maximum of latency samples, in microseconds.
+    inline void report_latency(std::string_view name, std::vector<double> samples)
+    {
+        double max = samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+
+        std::cout << std::format("{:<48} p50 {:>9.1f} us  p99 {:>9.1f} us  max {:>9.1f} us\n", name,
+            percentile(samples, 50) * 1e6, percentile(samples, 99) * 1e6, max * 1e6);
+    }
+
+    struct usage
+    {
+        /* user plus system CPU time of the process, in seconds */
+        double cpu_seconds = 0;
+        /* peak resident set size, in kilobytes */
+        size_t max_rss_kb = 0;
+    };
+
+    inline usage process_usage()
+    {
+        usage u;
+#ifdef __linux__
+        rusage r;
+        getrusage(RUSAGE_SELF, &r);
+
+        u.cpu_seconds = r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1e6 + r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1e6;
+        u.max_rss_kb = r.ru_maxrss;
+#endif
+        return u;
+    }
+};
@@ -0,0 +1,101 @@
+#include <string>
+#include <vector>
+
+#include <compression.hpp>
+
+#include "benchmark.hpp"
+
+using namespace uva;
+using namespace networking;
+
+//An API response: an array of objects with repeated keys.
+static std::string json_body(size_t objects)
+{
+    std::string body = "[";
+
+    for(size_t i = 0; i < objects; ++i) {
+        body += std::format("{}{{\"id\":{},\"name\":\"User {}\",\"email\":\"user{}@example.com\",\"active\":{},\"created_at\":\"2026-01-{:02}T10:00:00Z\"}}",
+            i ? "," : "", i, i, i, i % 3 ? "true" : "false", i % 28 + 1);
+    }
+
+    body += "]";
+
+    return body;
+}
+
+//A rendered page: markup around a table.
+static std::string html_body(size_t rows)
+{
+    std::string body = "<!DOCTYPE html>\n<html>\n<head><title>Users</title></head>\n<body>\n<table>\n";
+
+    for(size_t i = 0; i < rows; ++i) {
+        body += std::format("<tr class=\"row\"><td class=\"name\">User {}</td><td class=\"email\">user{}@example.com</td></tr>\n", i, i);
+    }
+
+    body += "</table>\n</body>\n</html>\n";
+
+    return body;
+}
+
+static void run(std::string_view name, const std::string& body, size_t iterations, const std::vector<size_t>& link_mbps)
+{
+    std::cout << std::format("{}, {} bytes\n", name, body.size());
+
+    std::string header = std::format("  {:<14} {:>10} {:>7} {:>12}", "encoding", "bytes", "ratio", "compress");
+
+    for(size_t mbps : link_mbps) {
+        header += std::format(" {:>14}", std::format("total {}Mb/s", mbps));
+    }
+
+    std::cout << header << "\n";
+
+    struct variant
+    {
+        content_encoding encoding;
+        int level;
+        /* a .gz asset built ahead of time: the size of the level, no time spent per response */
+        bool precompressed = false;
+    };
+
+    for(variant v : { variant{ content_encoding::identity, 0 }, variant{ content_encoding::gzip, 1 }, variant{ content_encoding::gzip, 6 }, variant{ content_encoding::gzip, 9 }, variant{ content_encoding::deflate, 6 }, variant{ content_encoding::gzip, 9, true } }) {
+        size_t size = body.size();
+        double seconds = 0;
+
+        if(v.encoding != content_encoding::identity) {
+            seconds = benchmark::measure([&]() {
+                for(size_t i = 0; i < iterations; ++i) {
+                    size = compress(body, v.encoding, v.level).size();
+                }
+            }) / iterations;
+        }
+
+        if(v.precompressed) {
+            seconds = 0;
+        }
+
+        std::string label = v.encoding == content_encoding::identity ? std::string("identity") : std::format("{} {}{}", content_encoding_to_string(v.encoding), v.level, v.precompressed ? " .gz" : "");
+        std::string line = std::format("  {:<14} {:>10} {:>6.1f}% {:>9.1f} us", label, size, 100.0 * size / body.size(), seconds * 1e6);
+
+        //Time until the last byte is out: compressing, then sending what is left at the link speed.
+        for(size_t mbps : link_mbps) {
+            double total = seconds + size * 8.0 / (mbps * 1e6);
+            line += std::format(" {:>11.1f} us", total * 1e6);
+        }
+
+        std::cout << line << "\n";
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    size_t iterations = benchmark::argument(argc, argv, "iterations", 200);
+    size_t size = benchmark::argument(argc, argv, "size", 64 * 1024);
+
+    std::vector<size_t> link_mbps = { 10, 100, 1000 };
+
+    //About size bytes each.
+    run("JSON", json_body(size / 110), iterations, link_mbps);
+    run("HTML", html_body(size / 90), iterations, link_mbps);
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+
+using namespace uva;
+using namespace networking;
+
+//Accepts connections on a loopback port and closes them right away, from a thread of its own.
+class closing_listener
+{
+private:
+    asio::io_context m_context;
+    asio::ip::tcp::acceptor m_acceptor;
+    std::atomic<bool> m_stopped = false;
+    std::thread m_thread;
+public:
+    closing_listener()
+        : m_acceptor(m_context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0))
+    {
+        m_thread = std::thread([this]() {
+            while(!m_stopped) {
+                error_code ec;
+                asio::ip::tcp::socket socket(m_context);
+                m_acceptor.accept(socket, ec);
+            }
+        });
+    }
+    ~closing_listener()
+    {
+        m_stopped = true;
+
+        //Wakes up the blocking accept.
+        error_code ec;
+        asio::ip::tcp::socket socket(m_context);
+        socket.connect(endpoint(), ec);
+
+        m_thread.join();
+    }
+public:
+    asio::ip::tcp::endpoint endpoint() const
+    {
+        return m_acceptor.local_endpoint();
+    }
+};
+
+//A local stand-in for an address that never answers: its accept queue is full and nothing accepts, so new SYNs are dropped.
+struct unresponsive_listener
+{
+    asio::ip::tcp::acceptor acceptor;
+    asio::ip::tcp::socket queued;
+
+    unresponsive_listener(asio::io_context& context)
+        : acceptor(context), queued(context)
+    {
+        acceptor.open(asio::ip::tcp::v4());
+        acceptor.bind(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+        acceptor.listen(0);
+
+        queued.connect(acceptor.local_endpoint());
+    }
+};
+
+//Resolves host one time after the other, each one waiting for the previous, as reconnecting clients do.
+static void resolve(std::string_view name, const std::string& host, size_t count)
+{
+    std::vector<double> latencies;
+    latencies.reserve(count);
+
+    double seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < count; ++i) {
+            benchmark::clock::time_point start = benchmark::clock::now();
+            std::promise<void> resolved;
+
+            async_resolve(next_io_context(), host, "80", [&resolved](error_code ec, asio::ip::tcp::resolver::results_type results) {
+                resolved.set_value();
+            });
+
+            resolved.get_future().wait();
+            latencies.push_back(benchmark::seconds_since(start));
+        }
+    });
+
+    benchmark::report(std::format("{}: resolves", name), count, seconds);
+    benchmark::report_latency(std::format("{}: resolve", name), latencies);
+}
+
+//Connects a basic_socket to host count times, resolving it unless the resolution is cached.
+static void reconnect(std::string_view name, const std::string& host, size_t count)
+{
+    std::vector<double> latencies;
+    latencies.reserve(count);
+
+    basic_socket socket;
+
+    double seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < count; ++i) {
+            benchmark::clock::time_point start = benchmark::clock::now();
+            std::promise<error_code> connected;
+
+            socket.connect_async("http", host, [&connected](error_code ec) {
+                connected.set_value(ec);
+            });
+
+            if(error_code ec = connected.get_future().get()) {
+                throw std::runtime_error("error: connect failed: " + ec.message());
+            }
+
+            latencies.push_back(benchmark::seconds_since(start));
+        }
+    });
+
+    socket.close();
+
+    benchmark::report(std::format("{}: connects", name), count, seconds);
+    benchmark::report_latency(std::format("{}: connect", name), latencies);
+}
+
+//Races endpoints count times and reports how long it took to get a connection.
+static void race(std::string_view name, const std::vector<asio::ip::tcp::endpoint>& endpoints, size_t count)
+{
+    std::vector<double> latencies;
+
+    for(size_t i = 0; i < count; ++i) {
+        benchmark::clock::time_point start = benchmark::clock::now();
+        std::promise<error_code> connected;
+
+        async_connect_race(next_io_context(), endpoints, [&connected](error_code ec, asio::ip::tcp::socket&& socket) {
+            connected.set_value(ec);
+        });
+
+        if(error_code ec = connected.get_future().get()) {
+            throw std::runtime_error("error: connect failed: " + ec.message());
+        }
+
+        latencies.push_back(benchmark::seconds_since(start));
+    }
+
+    benchmark::report_latency(std::format("{}: connect", name), latencies);
+}
+
+int main(int argc, const char** argv)
+{
+    size_t resolves = benchmark::argument(argc, argv, "resolves", 2000);
+    size_t connects = benchmark::argument(argc, argv, "connects", 2000);
+    size_t races    = benchmark::argument(argc, argv, "races", 20);
+
+    networking::init(run_mode::async_pool, 2);
+
+    //The first resolve fills the cache, the others are served from it.
+    resolve("localhost, cached", "localhost", resolves);
+
+    {
+        closing_listener listener;
+        reconnect("localhost, cached", "localhost:" + std::to_string(listener.endpoint().port()), connects);
+    }
+
+    set_resolve_cache_ttl(std::chrono::seconds(0));
+
+    resolve("localhost, not cached", "localhost", resolves);
+
+    {
+        closing_listener listener;
+        reconnect("localhost, not cached", "localhost:" + std::to_string(listener.endpoint().port()), connects);
+    }
+
+    {
+        //The stand-ins are not run, the race runs on the networking io_contexts.
+        asio::io_context context;
+        closing_listener live;
+        unresponsive_listener unresponsive(context);
+
+        asio::ip::tcp::socket refusing(context);
+        refusing.open(asio::ip::tcp::v4());
+        refusing.bind(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+
+        race("live address", { live.endpoint() }, races);
+        race("refusing address, then live", { refusing.local_endpoint(), live.endpoint() }, races);
+        //A single connect to it would wait for the SYN retries to time out, over a minute on Linux.
+        race("unresponsive address, then live", { unresponsive.acceptor.local_endpoint(), live.endpoint() }, races);
+    }
+
+    networking::cleanup();
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+#include "loopback.hpp"
+
+namespace benchmark
+{
+    /// @brief A file of size bytes in the temporary directory, removed with the object.
+    class temporary_file
+    {
+    public:
+        std::filesystem::path path;
+        size_t size;
+    public:
+        temporary_file(std::string_view name, size_t __size)
+            : path(std::filesystem::temp_directory_path() / name), size(__size)
+        {
+            std::ofstream stream(path, std::ios::binary);
+            std::string block(64 * 1024, 'x');
+
+            for(size_t written = 0; written < size; written += block.size()) {
+                stream.write(block.data(), std::min(block.size(), size - written));
+            }
+        }
+        ~temporary_file()
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+    };
+
+    /// @brief The response made for each download. Called on the io thread, before the response is written.
+    using response_factory = std::function<std::shared_ptr<uva::networking::http_message>()>;
+
+    struct download_result
+    {
+        double seconds = 0;
+        /* of the whole process, the readers included */
+        double cpu_seconds = 0;
+        /* the peak of the process so far, it never goes down */
+        size_t max_rss_kb = 0;
+    };
+
+    //Writes remaining responses to socket, each one once the previous completed.
+    template<typename Socket>
+    void write_downloads(Socket& socket, const response_factory& make_response, size_t remaining, std::promise<void>& done)
+    {
+        if(!remaining) {
+            done.set_value();
+            return;
+        }
+
+        std::shared_ptr<uva::networking::http_message> response = make_response();
+
+        uva::networking::async_write_http_response(socket, *response, [&socket, &make_response, remaining, &done, response](uva::networking::error_code& ec) {
+            write_downloads(socket, make_response, ec ? 0 : remaining - 1, done);
+        });
+    }
+
+    /// @brief Downloads rounds responses on each connection at the same time. servers[i] writes to clients[i], read by a thread of its own.
+    template<typename Socket, typename Client>
+    download_result run_downloads(std::vector<std::unique_ptr<Socket>>& servers, std::vector<Client*>& clients, size_t rounds, size_t response_size, const response_factory& make_response)
+    {
+        usage before = process_usage();
+
+        std::vector<std::promise<void>> done(servers.size());
+        std::vector<std::thread> readers;
+
+        download_result result;
+
+        result.seconds = measure([&]() {
+            for(size_t i = 0; i < servers.size(); ++i) {
+                readers.push_back(drain(*clients[i], rounds * response_size));
+
+                Socket& socket = *servers[i];
+                std::promise<void>& socket_done = done[i];
+
+                asio::post(socket.lowest_layer().get_executor(), [&socket, &make_response, rounds, &socket_done]() {
+                    write_downloads(socket, make_response, rounds, socket_done);
+                });
+            }
+
+            for(size_t i = 0; i < servers.size(); ++i) {
+                done[i].get_future().wait();
+                readers[i].join();
+            }
+        });
+
+        usage after = process_usage();
+
+        result.cpu_seconds = after.cpu_seconds - before.cpu_seconds;
+        result.max_rss_kb = after.max_rss_kb;
+
+        return result;
+    }
+
+    inline void report_downloads(std::string_view name, size_t bytes, const download_result& result)
+    {
+        std::cout << std::format("{:<40} {:>8.1f} MB/s  cpu {:>6.2f} s  peak rss {:>8} kB\n", name, bytes / result.seconds / 1e6, result.cpu_seconds, result.max_rss_kb);
+    }
+};
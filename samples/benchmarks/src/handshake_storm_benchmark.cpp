@@ -0,0 +1,198 @@
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+#include "tls.hpp"
+
+using namespace uva;
+using namespace networking;
+
+//An established connection whose server echoes back whatever it reads, on the io thread of its socket.
+struct echo_connection
+{
+    benchmark::tls_pair<https_socket> pair;
+    asio::streambuf buffer;
+    std::string reply;
+    std::promise<void> closed;
+
+    void read()
+    {
+        pair.server->async_read_some(buffer, [this](error_code ec, size_t size) {
+            if(ec) {
+                closed.set_value();
+                return;
+            }
+
+            reply.assign(asio::buffers_begin(buffer.data()), asio::buffers_begin(buffer.data()) + size);
+            buffer.consume(size);
+
+            pair.server->async_write(reply, [this](error_code& ec) {
+                if(ec) {
+                    closed.set_value();
+                    return;
+                }
+
+                read();
+            });
+        });
+    }
+};
+
+//New clients connecting, handshaking and leaving as fast as they can, from threads of their own.
+class reconnect_storm
+{
+private:
+    std::atomic<bool> m_stopped = false;
+    std::atomic<size_t> m_handshakes = 0;
+    std::vector<std::thread> m_threads;
+public:
+    reconnect_storm(size_t threads, bool handshake_threads)
+    {
+        for(size_t i = 0; i < threads; ++i) {
+            m_threads.emplace_back([this, handshake_threads]() {
+                asio::io_context client_context;
+
+                while(!m_stopped) {
+                    auto [server_socket, client_socket] = benchmark::connected_pair(next_io_context(), client_context);
+
+                    https_socket server(std::move(server_socket), *ssl_context);
+                    benchmark::tls_client_stream client(std::move(client_socket), *client_ssl_context);
+
+                    //Started from the io thread of the socket, as web_connection does once accepted.
+                    std::promise<error_code> server_handshake;
+
+                    asio::post(server.lowest_layer().get_executor(), [&server, &server_handshake, handshake_threads]() {
+                        auto on_handshake = [&server_handshake](error_code ec) {
+                            server_handshake.set_value(ec);
+                        };
+
+                        if(handshake_threads) {
+                            server.async_server_handshake(next_handshake_context(), on_handshake);
+                        } else {
+                            server.async_server_handshake(on_handshake);
+                        }
+                    });
+
+                    error_code ec;
+                    client.handshake(asio::ssl::stream_base::client, ec);
+
+                    if(!server_handshake.get_future().get() && !ec) {
+                        ++m_handshakes;
+                    }
+                }
+            });
+        }
+    }
+    ~reconnect_storm()
+    {
+        stop();
+    }
+public:
+    /// @brief Stops and returns the handshakes done.
+    size_t stop()
+    {
+        m_stopped = true;
+
+        for(std::thread& thread : m_threads) {
+            thread.join();
+        }
+
+        m_threads.clear();
+
+        return m_handshakes;
+    }
+};
+
+//Sends one byte to each established connection in turn and waits for it to come back, for seconds.
+static std::vector<double> round_trips(std::vector<std::unique_ptr<echo_connection>>& connections, double seconds)
+{
+    std::vector<double> latencies;
+    benchmark::clock::time_point start = benchmark::clock::now();
+
+    while(benchmark::seconds_since(start) < seconds) {
+        for(auto& connection : connections) {
+            benchmark::clock::time_point sent = benchmark::clock::now();
+
+            char byte = 'x';
+            asio::write(*connection->pair.client, asio::buffer(&byte, 1));
+            asio::read(*connection->pair.client, asio::buffer(&byte, 1));
+
+            latencies.push_back(benchmark::seconds_since(sent));
+        }
+    }
+
+    return latencies;
+}
+
+static void run(std::string_view name, std::vector<std::unique_ptr<echo_connection>>& connections, double seconds, size_t storm_threads, bool handshake_threads)
+{
+    std::unique_ptr<reconnect_storm> storm;
+
+    if(storm_threads) {
+        storm = std::make_unique<reconnect_storm>(storm_threads, handshake_threads);
+    }
+
+    std::vector<double> latencies = round_trips(connections, seconds);
+
+    size_t handshakes = storm ? storm->stop() : 0;
+
+    benchmark::report_latency(std::format("{}: round trip", name), latencies);
+
+    if(storm) {
+        benchmark::report(std::format("{}: storm handshakes", name), handshakes, seconds);
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    size_t established     = benchmark::argument(argc, argv, "established", 16);
+    size_t storm_threads   = benchmark::argument(argc, argv, "storm-threads", 4);
+    size_t handshake_count = benchmark::argument(argc, argv, "handshake-threads", 2);
+    double seconds         = (double)benchmark::argument(argc, argv, "seconds", 3);
+
+    //A single io thread, so the storm and the established connections compete for it unless the handshakes move away.
+    networking::init(run_mode::async_pool, 1);
+
+    benchmark::use_self_signed_certificate(*ssl_context);
+
+    std::vector<std::unique_ptr<echo_connection>> connections;
+
+    for(size_t i = 0; i < established; ++i) {
+        auto connection = std::make_unique<echo_connection>();
+        connection->pair = benchmark::tls_connected_pair<https_socket>(*ssl_context, *client_ssl_context);
+
+        asio::post(connection->pair.server->lowest_layer().get_executor(), [connection = connection.get()]() {
+            connection->read();
+        });
+
+        connections.push_back(std::move(connection));
+    }
+
+    run("idle", connections, seconds, 0, false);
+
+    run("storm on the io thread", connections, seconds, storm_threads, false);
+
+    //Handshake threads can only be started once, this run goes last.
+    networking::start_handshake_threads(handshake_count);
+
+    run(std::format("storm, {} handshake threads", handshake_count), connections, seconds, storm_threads, true);
+
+    //The servers see the end of the stream and stop echoing before they are destroyed.
+    for(auto& connection : connections) {
+        error_code ec;
+        connection->pair.client->lowest_layer().close(ec);
+        connection->closed.get_future().wait();
+    }
+
+    connections.clear();
+
+    networking::cleanup();
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+
+#include <html_template.hpp>
+
+#include "benchmark.hpp"
+
+using namespace uva;
+using namespace networking;
+using namespace web_application;
+
+//What rendering a view did before the template cache: read the file again, then copy it byte by byte, checking
+//whether the output ends with <var> and the name with </var> after each one. Function calls are left out, the view has none.
+static std::string format_html_file(const std::string& path, const var& locals)
+{
+    static std::string var_tag = "<var>";
+    static std::string close_var_tag = "</var>";
+
+    std::ifstream stream(path, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    std::string formated_content;
+    formated_content.reserve(content.size());
+
+    std::string current_var_name;
+
+    for(char c : content) {
+        if(formated_content.ends_with(var_tag)) {
+            current_var_name.push_back(c);
+
+            if(current_var_name.ends_with(close_var_tag)) {
+                current_var_name.erase(current_var_name.end() - close_var_tag.size(), current_var_name.end());
+
+                var value = locals.fetch(current_var_name);
+
+                current_var_name.clear();
+                formated_content.erase(formated_content.end() - var_tag.size(), formated_content.end());
+
+                if(value) {
+                    formated_content += value.to_s();
+                }
+            }
+        } else {
+            formated_content.push_back(c);
+        }
+    }
+
+    return formated_content;
+}
+
+//A listing page: some markup around a table with a row per user, each row with two variables.
+static std::string listing_view(size_t rows)
+{
+    std::string view = "<!DOCTYPE html>\n<html>\n<head>\n<title><var>title</var></title>\n";
+
+    for(size_t i = 0; i < 20; ++i) {
+        view += "<meta name=\"description\" content=\"A page with a table of users, rendered by the template benchmark.\">\n";
+    }
+
+    view += "</head>\n<body>\n<h1><var>title</var></h1>\n<table>\n";
+
+    for(size_t i = 0; i < rows; ++i) {
+        view += std::format("<tr class=\"row\"><td class=\"name\"><var>name_{}</var></td><td class=\"email\"><var>email_{}</var></td></tr>\n", i, i);
+    }
+
+    view += "</table>\n</body>\n</html>\n";
+
+    return view;
+}
+
+int main(int argc, const char** argv)
+{
+    size_t iterations = benchmark::argument(argc, argv, "iterations", 20'000);
+    size_t rows = benchmark::argument(argc, argv, "rows", 100);
+
+    std::filesystem::path views_root = std::filesystem::temp_directory_path() / "uva-networking-template-benchmark";
+    std::filesystem::create_directories(views_root / "users");
+
+    std::filesystem::path view_path = views_root / "users" / "index.cpp.html";
+
+    std::string view = listing_view(rows);
+    std::ofstream(view_path, std::ios::binary) << view;
+
+    std::map<var, var> values;
+    values["title"] = "Users";
+
+    for(size_t i = 0; i < rows; ++i) {
+        values[std::format("name_{}", i)] = std::format("User {}", i);
+        values[std::format("email_{}", i)] = std::format("user{}@example.com", i);
+    }
+
+    var locals = var(std::move(values));
+
+    std::cout << std::format("Rendering a {} byte view with {} variables\n", view.size(), rows * 2 + 2);
+
+    size_t checksum = 0;
+
+    double seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            checksum += format_html_file(view_path.string(), locals).size();
+        }
+    });
+
+    benchmark::report("read and scan byte by byte", iterations, seconds);
+
+    exposed_function_map functions;
+
+    for(bool watch_files : { true, false }) {
+        basic_html_template_cache cache(views_root, functions, watch_files);
+
+        seconds = benchmark::measure([&]() {
+            for(size_t i = 0; i < iterations; ++i) {
+                checksum += cache.find("users", "index")->render(locals).size();
+            }
+        });
+
+        benchmark::report(watch_files ? "template cache, watching files" : "template cache", iterations, seconds);
+    }
+
+    basic_compiled_html_template compiled(view, true, &functions);
+
+    seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            checksum += compiled.render(locals).size();
+        }
+    });
+
+    benchmark::report("compiled template, render only", iterations, seconds);
+
+    if(checksum == 0) {
+        std::cout << "unexpected checksum\n";
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(views_root, ec);
+
+    return 0;
+}
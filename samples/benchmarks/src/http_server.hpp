@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+namespace benchmark
+{
+    /// @brief A blocking HTTP/1.1 server on a loopback port, standing in for a remote service. Each connection is served by its own thread,
+    /// one request after the other, and every request takes service_time before its response is written, like a backend doing some work.
+    class http_server
+    {
+    private:
+        asio::io_context m_context;
+        asio::ip::tcp::acceptor m_acceptor;
+        std::chrono::microseconds m_service_time;
+        std::string m_response;
+
+        std::atomic<bool> m_stopped = false;
+        std::atomic<size_t> m_accepted = 0;
+
+        std::mutex m_mutex;
+        std::vector<std::shared_ptr<asio::ip::tcp::socket>> m_sockets;
+        std::vector<std::thread> m_threads;
+        std::thread m_accept_thread;
+    public:
+        http_server(std::chrono::microseconds service_time, const std::string& body)
+            : m_acceptor(m_context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)), m_service_time(service_time)
+        {
+            m_response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+            //Polled, so the destructor does not have to interrupt a blocking accept.
+            m_acceptor.non_blocking(true);
+
+            m_accept_thread = std::thread([this]() {
+                while(!m_stopped) {
+                    asio::error_code ec;
+                    auto socket = std::make_shared<asio::ip::tcp::socket>(m_context);
+
+                    m_acceptor.accept(*socket, ec);
+
+                    if(ec) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        continue;
+                    }
+
+                    socket->set_option(asio::ip::tcp::no_delay(true));
+                    ++m_accepted;
+
+                    std::scoped_lock lock(m_mutex);
+                    m_sockets.push_back(socket);
+                    m_threads.emplace_back([this, socket]() { serve(*socket); });
+                }
+            });
+        }
+        ~http_server()
+        {
+            m_stopped = true;
+            m_accept_thread.join();
+
+            {
+                std::scoped_lock lock(m_mutex);
+
+                //Wakes up the threads blocked reading.
+                for(auto& socket : m_sockets) {
+                    asio::error_code ec;
+                    socket->shutdown(asio::socket_base::shutdown_both, ec);
+                }
+            }
+
+            for(std::thread& thread : m_threads) {
+                thread.join();
+            }
+        }
+    private:
+        void serve(asio::ip::tcp::socket& socket)
+        {
+            asio::streambuf buffer;
+
+            while(!m_stopped) {
+                asio::error_code ec;
+                size_t head_size = asio::read_until(socket, buffer, "\r\n\r\n", ec);
+
+                if(ec) {
+                    break;
+                }
+
+                buffer.consume(head_size);
+
+                if(m_service_time.count()) {
+                    std::this_thread::sleep_for(m_service_time);
+                }
+
+                asio::write(socket, asio::buffer(m_response), ec);
+
+                if(ec) {
+                    break;
+                }
+            }
+        }
+    public:
+        std::string url() const
+        {
+            return "http://127.0.0.1:" + std::to_string(m_acceptor.local_endpoint().port());
+        }
+        size_t accepted() const
+        {
+            return m_accepted;
+        }
+    };
+};
@@ -0,0 +1,88 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+#include "file_download.hpp"
+#include "tls.hpp"
+
+using namespace uva;
+using namespace networking;
+
+template<typename Socket>
+static void run(std::string_view name, asio::ssl::context& server_context, asio::ssl::context& client_context, const benchmark::temporary_file& file, size_t connections, size_t rounds)
+{
+    std::vector<benchmark::tls_pair<Socket>> pairs;
+    std::vector<std::unique_ptr<Socket>> servers;
+    std::vector<benchmark::tls_client_stream*> clients;
+
+    for(size_t i = 0; i < connections; ++i) {
+        benchmark::tls_pair<Socket> pair = benchmark::tls_connected_pair<Socket>(server_context, client_context);
+
+        servers.push_back(std::move(pair.server));
+        clients.push_back(pair.client.get());
+        pairs.push_back(std::move(pair));
+    }
+
+    http_message sample;
+    sample.status = status_code::ok;
+    sample.type = content_type::application_octet_stream;
+    sample.file_body = file.path;
+    sample.file_body_size = file.size;
+
+    std::string head;
+    append_http_response_head(head, sample);
+
+    size_t response_size = head.size() + file.size;
+
+    benchmark::download_result result = benchmark::run_downloads(servers, clients, rounds, response_size, [&file]() {
+        auto response = std::make_shared<http_message>();
+        response->status = status_code::ok;
+        response->type = content_type::application_octet_stream;
+        response->file_body = file.path;
+        response->file_body_size = file.size;
+
+        return response;
+    });
+
+    benchmark::report_downloads(name, connections * rounds * response_size, result);
+}
+
+int main(int argc, const char** argv)
+{
+    size_t file_size = benchmark::argument(argc, argv, "size", 50) * 1024 * 1024;
+    size_t connections = benchmark::argument(argc, argv, "connections", 4);
+    size_t rounds = benchmark::argument(argc, argv, "rounds", 4);
+
+    networking::init(run_mode::async_pool, 2);
+
+    benchmark::temporary_file file("uva-networking-ktls-benchmark.bin", file_size);
+
+    auto server_context = benchmark::self_signed_server_context();
+    auto client_context = benchmark::insecure_client_context();
+
+    std::cout << std::format("{} connection(s) downloading a {} MB file {} time(s) over TLS\n", connections, file_size / 1024 / 1024, rounds);
+
+    run<https_socket>("asio::ssl::stream", *server_context, *client_context, file, connections, rounds);
+    run<ktls_socket>("ktls_stream, userspace", *server_context, *client_context, file, connections, rounds);
+
+    //What enable_ktls does to ssl_context.
+    auto ktls_context = benchmark::self_signed_server_context();
+    SSL_CTX_set_options(ktls_context->native_handle(), SSL_OP_ENABLE_KTLS);
+
+    bool offloaded = benchmark::tls_connected_pair<ktls_socket>(*ktls_context, *client_context).server->stream().ktls_send();
+
+    if(!offloaded) {
+        std::cout << "Kernel TLS offload is not available here (OpenSSL built without it, tls module not loaded or cipher not supported)\n";
+    } else {
+        run<ktls_socket>("ktls_stream, kernel offload and sendfile", *ktls_context, *client_context, file, connections, rounds);
+    }
+
+    networking::cleanup();
+
+    return 0;
+}
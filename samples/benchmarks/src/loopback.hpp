@@ -0,0 +1,45 @@
+#pragma once
+
+#include <thread>
+#include <utility>
+
+#include <networking.hpp>
+
+namespace benchmark
+{
+    /// @brief A connected pair of loopback tcp sockets. The first is made on server_context, the second on client_context.
+    inline std::pair<asio::ip::tcp::socket, asio::ip::tcp::socket> connected_pair(asio::io_context& server_context, asio::io_context& client_context)
+    {
+        asio::ip::tcp::acceptor acceptor(client_context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+
+        asio::ip::tcp::socket client(client_context);
+        client.connect(acceptor.local_endpoint());
+
+        asio::ip::tcp::socket server(server_context);
+        acceptor.accept(server);
+
+        server.set_option(asio::ip::tcp::no_delay(true));
+        client.set_option(asio::ip::tcp::no_delay(true));
+
+        return { std::move(server), std::move(client) };
+    }
+
+    /// @brief Reads and drops expected bytes from socket in a thread of its own. Join it to wait for all of them.
+    template<typename SyncReadStream>
+    std::thread drain(SyncReadStream& socket, size_t expected)
+    {
+        return std::thread([&socket, expected]() {
+            static thread_local char buffer[64 * 1024];
+            size_t received = 0;
+
+            while(received < expected) {
+                asio::error_code ec;
+                received += socket.read_some(asio::buffer(buffer), ec);
+
+                if(ec) {
+                    break;
+                }
+            }
+        });
+    }
+};
@@ -0,0 +1,148 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+
+using namespace uva;
+using namespace networking;
+
+//The mutex and condition variable pipeline networking used before basic_lock_free_pipeline, kept here as the baseline.
+template<typename T>
+class basic_thread_safe_pipeline_waiter
+{
+private:
+    std::mutex m_deque_mutex;
+    std::deque<T> m_deque;
+
+    std::condition_variable m_wait_variable;
+    std::mutex m_wait_mutex;
+public:
+    void push_back(T&& t)
+    {
+        {
+            std::scoped_lock locker(m_deque_mutex);
+            m_deque.push_back(std::move(t));
+        }
+
+        {
+            //Avoids a lost wakeup between the waiter checking empty() and going to sleep. Taken after the deque
+            //lock is released, the waiter takes them in the opposite order.
+            std::scoped_lock wait_locker(m_wait_mutex);
+        }
+
+        m_wait_variable.notify_one();
+    }
+    bool try_pop_front(T& t)
+    {
+        std::scoped_lock locker(m_deque_mutex);
+
+        if(m_deque.empty()) {
+            return false;
+        }
+
+        t = std::move(m_deque.front());
+        m_deque.pop_front();
+
+        return true;
+    }
+    bool empty()
+    {
+        std::scoped_lock lock(m_deque_mutex);
+        return m_deque.empty();
+    }
+    void wait()
+    {
+        std::unique_lock<std::mutex> ul(m_wait_mutex);
+        m_wait_variable.wait(ul, [this]() { return !empty(); });
+    }
+};
+
+//Tells a consumer to stop.
+static constexpr size_t s_stop = std::numeric_limits<size_t>::max();
+
+//Moves items from producers to consumers the way the dispatch loop does: wait, then pop while there is something.
+template<typename Pipeline>
+static double run(size_t producers, size_t consumers, size_t items)
+{
+    Pipeline pipeline;
+    std::atomic<size_t> consumed = 0;
+
+    return benchmark::measure([&]() {
+        std::vector<std::thread> threads;
+
+        for(size_t i = 0; i < consumers; ++i) {
+            threads.emplace_back([&]() {
+                size_t value;
+
+                while(true) {
+                    pipeline.wait();
+
+                    while(pipeline.try_pop_front(value)) {
+                        if(value == s_stop) {
+                            return;
+                        }
+
+                        consumed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+
+        std::vector<std::thread> producer_threads;
+
+        for(size_t i = 0; i < producers; ++i) {
+            producer_threads.emplace_back([&, i]() {
+                for(size_t value = i; value < items; value += producers) {
+                    pipeline.push_back(size_t(value));
+                }
+            });
+        }
+
+        for(std::thread& thread : producer_threads) {
+            thread.join();
+        }
+
+        //Queued after every item, so each consumer stops once the items are gone.
+        for(size_t i = 0; i < consumers; ++i) {
+            pipeline.push_back(size_t(s_stop));
+        }
+
+        for(std::thread& thread : threads) {
+            thread.join();
+        }
+    });
+}
+
+int main(int argc, const char** argv)
+{
+    size_t items = benchmark::argument(argc, argv, "items", 4'000'000);
+    size_t max_threads = benchmark::argument(argc, argv, "threads", std::max<size_t>(2, std::thread::hardware_concurrency()));
+
+    std::cout << std::format("Moving {} items through each pipeline\n", items);
+
+    for(size_t threads = 1; threads <= max_threads; threads *= 2) {
+        //One producer like an io thread feeding the workers, then as many producers as consumers.
+        std::vector<size_t> producer_counts = { 1 };
+
+        if(threads > 1) {
+            producer_counts.push_back(threads);
+        }
+
+        for(size_t producers : producer_counts) {
+            double waiter = run<basic_thread_safe_pipeline_waiter<size_t>>(producers, threads, items);
+            double lock_free = run<basic_lock_free_pipeline<size_t>>(producers, threads, items);
+
+            benchmark::report(std::format("mutex waiter     {} producer(s) {} consumer(s)", producers, threads), items, waiter);
+            benchmark::report(std::format("lock-free        {} producer(s) {} consumer(s)", producers, threads), items, lock_free);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+#include "loopback.hpp"
+
+using namespace uva;
+using namespace networking;
+
+//Writes remaining rounds of responses, each response once the previous completed, like write_front_response did before batching.
+static void write_one_by_one(http_socket& socket, const std::vector<const http_message*>& responses, size_t remaining, size_t index, std::promise<void>& done)
+{
+    if(index == responses.size()) {
+        index = 0;
+        --remaining;
+    }
+
+    if(!remaining) {
+        done.set_value();
+        return;
+    }
+
+    async_write_http_response(socket, *responses[index], [&socket, &responses, remaining, index, &done](error_code& ec) {
+        write_one_by_one(socket, responses, ec ? 1 : remaining, ec ? responses.size() : index + 1, done);
+    });
+}
+
+//Writes remaining rounds of responses, all the ones of a round that fit in max_batch_size in each write.
+static void write_batched(http_socket& socket, const std::vector<const http_message*>& responses, size_t max_batch_size, size_t remaining, size_t index, std::promise<void>& done)
+{
+    if(index == responses.size()) {
+        index = 0;
+        --remaining;
+    }
+
+    if(!remaining) {
+        done.set_value();
+        return;
+    }
+
+    //A round is what a connection has queued: the responses after index.
+    auto pending = std::make_shared<std::vector<const http_message*>>(responses.begin() + index, responses.end());
+
+    async_write_http_responses(socket, *pending, max_batch_size, [&socket, &responses, max_batch_size, remaining, index, pending, &done](error_code& ec, size_t written) {
+        write_batched(socket, responses, max_batch_size, ec ? 1 : remaining, ec ? responses.size() : index + written, done);
+    });
+}
+
+template<typename Write>
+static double run(size_t bytes, Write write)
+{
+    auto [server, client] = benchmark::connected_pair(next_io_context(), main_io_context());
+    http_socket socket(std::move(server));
+
+    std::promise<void> done;
+
+    return benchmark::measure([&]() {
+        std::thread reader = benchmark::drain(client, bytes);
+
+        asio::post(socket.lowest_layer().get_executor(), [&socket, &write, &done]() {
+            write(socket, done);
+        });
+
+        done.get_future().wait();
+        reader.join();
+    });
+}
+
+int main(int argc, const char** argv)
+{
+    size_t rounds = benchmark::argument(argc, argv, "rounds", 20'000);
+    size_t depth = benchmark::argument(argc, argv, "depth", 16);
+    size_t body_size = benchmark::argument(argc, argv, "body", 64);
+
+    networking::init(run_mode::async_pool, 2);
+
+    std::vector<http_message> messages(depth);
+    std::vector<const http_message*> responses;
+
+    size_t round_size = 0;
+
+    for(http_message& message : messages) {
+        message.status = status_code::ok;
+        message.type = content_type::text_plain;
+        message.raw_body = std::string(body_size, 'x');
+
+        std::string head;
+        append_http_response_head(head, message);
+
+        round_size += head.size() + body_size;
+        responses.push_back(&message);
+    }
+
+    std::cout << std::format("{} rounds of {} pipelined responses, {} bytes each round\n", rounds, depth, round_size);
+
+    double seconds = run(rounds * round_size, [&](http_socket& socket, std::promise<void>& done) {
+        write_one_by_one(socket, responses, rounds, 0, done);
+    });
+
+    benchmark::report("one write per response", rounds * depth, seconds);
+
+    for(size_t max_batch_size : { size_t(1024), size_t(16 * 1024), size_t(256 * 1024) }) {
+        seconds = run(rounds * round_size, [&](http_socket& socket, std::promise<void>& done) {
+            write_batched(socket, responses, max_batch_size, rounds, 0, done);
+        });
+
+        benchmark::report(std::format("batched, at most {} bytes per write", max_batch_size), rounds * depth, seconds);
+    }
+
+    networking::cleanup();
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <networking.hpp>
+#include <web_client.hpp>
+
+#include "benchmark.hpp"
+#include "http_server.hpp"
+
+using namespace uva;
+using namespace networking;
+
+//Queues requests GETs at once and waits for all of them, then reports the throughput and how long each one took from get to its response.
+static void run(std::string_view name, const std::string& url, const web_client_pool_options& options, size_t requests)
+{
+    basic_web_client client(url, options);
+
+    std::atomic<size_t> failed = 0;
+    std::vector<double> latencies;
+
+    auto fire = [&client, &failed](size_t count) {
+        std::vector<double> latencies(count);
+        std::atomic<size_t> remaining = count;
+
+        std::promise<void> promise;
+        std::future<void> done = promise.get_future();
+
+        auto complete = [&remaining, &promise]() {
+            if(--remaining == 0) {
+                promise.set_value();
+            }
+        };
+
+        for(size_t i = 0; i < count; ++i) {
+            benchmark::clock::time_point start = benchmark::clock::now();
+
+            client.get("/", {}, {}, [&latencies, complete, i, start](http_message response) {
+                latencies[i] = benchmark::seconds_since(start);
+                complete();
+            }, [&failed, complete](error_code ec) {
+                ++failed;
+                complete();
+            });
+        }
+
+        done.wait();
+
+        return latencies;
+    };
+
+    //Opens the connections, so the measurement is the pool at its size and not the connects.
+    fire(options.max_connections * options.pipeline_depth);
+
+    double seconds = benchmark::measure([&]() {
+        latencies = fire(requests);
+    });
+
+    benchmark::report(std::format("{}: requests", name), requests, seconds);
+    benchmark::report_latency(std::format("{}: get to response", name), latencies);
+
+    if(failed) {
+        std::cout << std::format("{:<48} {} failed\n", name, failed.load());
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    size_t requests     = benchmark::argument(argc, argv, "requests", 4000);
+    size_t service_time = benchmark::argument(argc, argv, "service-us", 1000);
+
+    networking::init(run_mode::async_pool, 2);
+
+    {
+        //The server takes service_time per request on each connection, a single connection does at most 1s / service_time requests a second.
+        benchmark::http_server server(std::chrono::microseconds(service_time), "ok");
+
+        for(size_t connections : { 1, 2, 4, 8, 16, 32 }) {
+            web_client_pool_options options;
+            options.max_connections = connections;
+
+            run(std::format("max_connections {}", connections), server.url(), options, requests);
+        }
+    }
+
+    {
+        //With no service time, a connection waits on round trips only, which is what pipelining saves.
+        benchmark::http_server server(std::chrono::microseconds(0), "ok");
+
+        for(size_t depth : { 1, 4, 16 }) {
+            web_client_pool_options options;
+            options.max_connections = 1;
+            options.pipeline_depth = depth;
+
+            run(std::format("max_connections 1, pipeline_depth {}", depth), server.url(), options, requests);
+        }
+    }
+
+    networking::cleanup();
+
+    return 0;
+}
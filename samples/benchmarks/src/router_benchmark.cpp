@@ -0,0 +1,111 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include <router.hpp>
+
+#include "benchmark.hpp"
+
+using namespace uva;
+using namespace networking;
+using namespace web_application;
+
+//Each resource has the routes of a typical controller, eight of them.
+static constexpr size_t s_routes_per_resource = 8;
+
+static void add_resource(basic_router& router, std::map<std::string, std::string>& table, size_t resource)
+{
+    std::string base = std::format("/resource_{}", resource);
+
+    auto add = [&](std::string_view method, const std::string& path) {
+        std::string key = std::format("{} {}", method, path);
+
+        router.add(method, path, key);
+        table[key] = key;
+    };
+
+    add("GET", base);
+    add("GET", base + "/new");
+    add("GET", base + "/:id");
+    add("GET", base + "/:id/edit");
+    add("GET", base + "/:id/items/:item_id");
+    add("GET", "/api/v1" + base + "/:id");
+    add("POST", base);
+    add("POST", base + "/:id");
+}
+
+static void run(size_t resources, size_t iterations)
+{
+    basic_router router;
+    std::map<std::string, std::string> table;
+
+    for(size_t i = 0; i < resources; ++i) {
+        add_resource(router, table, i);
+    }
+
+    //Spread over the resources, so the lookups do not hit the same nodes every time.
+    std::vector<std::string> static_paths;
+    std::vector<std::string> parameter_paths;
+
+    for(size_t i = 0; i < 1024; ++i) {
+        size_t resource = (i * 7919) % resources;
+
+        static_paths.push_back(std::format("/resource_{}/new", resource));
+        parameter_paths.push_back(std::format("/resource_{}/{}/items/{}", resource, i, i * 3));
+    }
+
+    std::string method = "GET";
+    size_t found = 0;
+
+    //What dispatch did before the router: a new "METHOD path" string for every request, matched exactly.
+    double seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            std::string key = method + " " + static_paths[i & 1023];
+            found += table.find(key) != table.end();
+        }
+    });
+
+    benchmark::report(std::format("{:>5} routes, exact string map, static path", router.size()), iterations, seconds);
+
+    route_match match;
+
+    seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            found += router.find(method, static_paths[i & 1023], match);
+        }
+    });
+
+    benchmark::report(std::format("{:>5} routes, router, static path", router.size()), iterations, seconds);
+
+    seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            found += router.find(method, parameter_paths[i & 1023], match);
+        }
+    });
+
+    benchmark::report(std::format("{:>5} routes, router, two parameters", router.size()), iterations, seconds);
+
+    seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            found += router.find(method, "/resource_0/missing/route/here", match);
+        }
+    });
+
+    benchmark::report(std::format("{:>5} routes, router, not found", router.size()), iterations, seconds);
+
+    if(found == 0) {
+        std::cout << "unexpected: nothing found\n";
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    size_t iterations = benchmark::argument(argc, argv, "iterations", 2'000'000);
+    size_t max_routes = benchmark::argument(argc, argv, "routes", 4000);
+
+    for(size_t routes : { size_t(100), size_t(1000), max_routes }) {
+        run(std::max<size_t>(1, routes / s_routes_per_resource), iterations);
+    }
+
+    return 0;
+}
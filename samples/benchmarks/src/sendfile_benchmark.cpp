@@ -0,0 +1,88 @@
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+#include "file_download.hpp"
+#include "loopback.hpp"
+
+using namespace uva;
+using namespace networking;
+
+int main(int argc, const char** argv)
+{
+    size_t file_size = benchmark::argument(argc, argv, "size", 50) * 1024 * 1024;
+    size_t connections = benchmark::argument(argc, argv, "connections", 8);
+    size_t rounds = benchmark::argument(argc, argv, "rounds", 4);
+
+    networking::init(run_mode::async_pool, 2);
+
+    benchmark::temporary_file file("uva-networking-sendfile-benchmark.bin", file_size);
+
+    std::vector<std::unique_ptr<http_socket>> servers;
+    std::vector<asio::ip::tcp::socket> client_sockets;
+    std::vector<asio::ip::tcp::socket*> clients;
+
+    client_sockets.reserve(connections);
+
+    for(size_t i = 0; i < connections; ++i) {
+        auto [server, client] = benchmark::connected_pair(next_io_context(), main_io_context());
+
+        servers.push_back(std::make_unique<http_socket>(std::move(server)));
+        client_sockets.push_back(std::move(client));
+        clients.push_back(&client_sockets.back());
+    }
+
+    http_message sample;
+    sample.status = status_code::ok;
+    sample.type = content_type::application_octet_stream;
+    sample.file_body = file.path;
+    sample.file_body_size = file.size;
+
+    std::string head;
+    append_http_response_head(head, sample);
+
+    size_t response_size = head.size() + file.size;
+    size_t bytes = connections * rounds * response_size;
+
+    std::cout << std::format("{} connection(s) downloading a {} MB file {} time(s)\n", connections, file_size / 1024 / 1024, rounds);
+
+    //sendfile first: the peak RSS only goes up, so what the read path adds shows after it.
+    benchmark::download_result result = benchmark::run_downloads(servers, clients, rounds, response_size, [&file]() {
+        auto response = std::make_shared<http_message>();
+        response->status = status_code::ok;
+        response->type = content_type::application_octet_stream;
+        response->file_body = file.path;
+        response->file_body_size = file.size;
+
+        return response;
+    });
+
+    benchmark::report_downloads("file_body (sendfile)", bytes, result);
+
+    //What static files did before: the whole file read into raw_body, then written from there.
+    result = benchmark::run_downloads(servers, clients, rounds, response_size, [&file]() {
+        auto response = std::make_shared<http_message>();
+        response->status = status_code::ok;
+        response->type = content_type::application_octet_stream;
+
+        std::ifstream stream(file.path, std::ios::binary);
+        response->raw_body.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+        return response;
+    });
+
+    benchmark::report_downloads("raw_body (read, then write)", bytes, result);
+
+    //Before their io_contexts go away.
+    servers.clear();
+    client_sockets.clear();
+
+    networking::cleanup();
+
+    return 0;
+}
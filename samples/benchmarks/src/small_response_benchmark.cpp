@@ -0,0 +1,147 @@
+#include <ctime>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <networking.hpp>
+
+#include "benchmark.hpp"
+#include "loopback.hpp"
+
+using namespace uva;
+using namespace networking;
+
+static const std::string s_body = "{\"id\":42,\"name\":\"uva\"}";
+
+//What async_write_http_response did before the serializer: a map lookup for the reason phrase, strftime for every Date
+//and std::format for the head, which went out in its own write before the body.
+static const std::map<status_code, std::string> s_status_codes = {
+    { status_code::ok, "OK" },
+};
+
+static std::shared_ptr<std::string> format_head(const status_code& status, const content_type& type, size_t body_size)
+{
+    time_t now = time(nullptr);
+    char date[100];
+    std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", std::gmtime(&now));
+
+    return std::make_shared<std::string>(std::format(
+        "HTTP/1.1 {} {}\r\n"
+        "Server: uva::networking/{}\r\n"
+        "Date: {}\r\n"
+        "Content-Type: {}\r\n"
+        "Content-Length: {}\r\n"
+        "\r\n",
+        std::to_string((size_t)status), s_status_codes.at(status), "0.0.1", date, content_type_to_string(type), std::to_string(body_size)));
+}
+
+static void write_formatted(http_socket& socket, size_t remaining, std::promise<void>& done)
+{
+    if(!remaining) {
+        done.set_value();
+        return;
+    }
+
+    auto head = format_head(status_code::ok, content_type::application_json, s_body.size());
+
+    socket.async_write(*head, [&socket, head, remaining, &done](error_code& ec) {
+        socket.async_write(s_body, [&socket, remaining, &done](error_code& ec) {
+            write_formatted(socket, ec ? 0 : remaining - 1, done);
+        });
+    });
+}
+
+static void write_serialized(http_socket& socket, const http_message& response, size_t remaining, std::promise<void>& done)
+{
+    if(!remaining) {
+        done.set_value();
+        return;
+    }
+
+    async_write_http_response(socket, response, [&socket, &response, remaining, &done](error_code& ec) {
+        write_serialized(socket, response, ec ? 0 : remaining - 1, done);
+    });
+}
+
+//Writes responses one after the other, each one once the previous completed, to a loopback reader.
+template<typename Write>
+static double run(size_t responses, size_t response_size, Write write)
+{
+    auto [server, client] = benchmark::connected_pair(next_io_context(), main_io_context());
+    http_socket socket(std::move(server));
+
+    std::promise<void> done;
+
+    return benchmark::measure([&]() {
+        std::thread reader = benchmark::drain(client, responses * response_size);
+
+        asio::post(socket.lowest_layer().get_executor(), [&socket, &write, &done, responses]() {
+            write(socket, responses, done);
+        });
+
+        //The socket is not destroyed before the last completion handler returned.
+        done.get_future().wait();
+        reader.join();
+    });
+}
+
+int main(int argc, const char** argv)
+{
+    size_t iterations = benchmark::argument(argc, argv, "iterations", 1'000'000);
+    size_t responses = benchmark::argument(argc, argv, "responses", 200'000);
+
+    networking::init(run_mode::async_pool, 2);
+
+    http_message response;
+    response.status = status_code::ok;
+    response.type = content_type::application_json;
+    response.raw_body = s_body;
+
+    //Building the head alone.
+    size_t checksum = 0;
+
+    double seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            checksum += format_head(status_code::ok, content_type::application_json, s_body.size())->size();
+        }
+    });
+
+    benchmark::report("head: std::format, strftime every time", iterations, seconds);
+
+    std::string head;
+
+    seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < iterations; ++i) {
+            head.clear();
+            append_http_response_head(head, response);
+            checksum += head.size();
+        }
+    });
+
+    benchmark::report("head: append_http_response_head", iterations, seconds);
+
+    //Responses over loopback. The Date header is fixed width, so every response has the size of the first.
+    size_t formatted_size = format_head(status_code::ok, content_type::application_json, s_body.size())->size() + s_body.size();
+    size_t serialized_size = head.size() + s_body.size();
+
+    seconds = run(responses, formatted_size, [](http_socket& socket, size_t count, std::promise<void>& done) {
+        write_formatted(socket, count, done);
+    });
+
+    benchmark::report(std::format("{} byte responses: head and body writes", formatted_size), responses, seconds);
+
+    seconds = run(responses, serialized_size, [&response](http_socket& socket, size_t count, std::promise<void>& done) {
+        write_serialized(socket, response, count, done);
+    });
+
+    benchmark::report(std::format("{} byte responses: async_write_http_response", serialized_size), responses, seconds);
+
+    if(checksum == 0) {
+        std::cout << "unexpected checksum\n";
+    }
+
+    networking::cleanup();
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <networking.hpp>
+
+#include "loopback.hpp"
+
+namespace benchmark
+{
+    using tls_client_stream = asio::ssl::stream<asio::ip::tcp::socket>;
+
+    /// @brief Loads a new self-signed P-256 certificate for localhost into context, so the benchmarks need no server.crt.
+    inline void use_self_signed_certificate(asio::ssl::context& context)
+    {
+        EVP_PKEY* key = EVP_EC_gen("P-256");
+        X509* certificate = X509_new();
+
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+        X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+        X509_gmtime_adj(X509_getm_notAfter(certificate), 24 * 60 * 60);
+        X509_set_pubkey(certificate, key);
+
+        X509_NAME* name = X509_get_subject_name(certificate);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+        X509_set_issuer_name(certificate, name);
+        X509_sign(certificate, key, EVP_sha256());
+
+        SSL_CTX_use_certificate(context.native_handle(), certificate);
+        SSL_CTX_use_PrivateKey(context.native_handle(), key);
+
+        X509_free(certificate);
+        EVP_PKEY_free(key);
+    }
+
+    /// @brief A server context with a self-signed certificate, see use_self_signed_certificate.
+    inline std::unique_ptr<asio::ssl::context> self_signed_server_context()
+    {
+        auto context = std::make_unique<asio::ssl::context>(asio::ssl::context::tls_server);
+        use_self_signed_certificate(*context);
+
+        return context;
+    }
+
+    /// @brief A client context which accepts any certificate.
+    inline std::unique_ptr<asio::ssl::context> insecure_client_context()
+    {
+        auto context = std::make_unique<asio::ssl::context>(asio::ssl::context::tls_client);
+        context->set_verify_mode(asio::ssl::verify_none);
+
+        return context;
+    }
+
+    template<typename Socket>
+    struct tls_pair
+    {
+        std::unique_ptr<Socket> server;
+        std::unique_ptr<tls_client_stream> client;
+    };
+
+    /// @brief A loopback connection after its TLS handshake. The server socket runs on an io_context of the networking runtime,
+    /// the client stream is used with blocking calls. before_handshake may set up the client stream, like offering a session.
+    template<typename Socket>
+    tls_pair<Socket> tls_connected_pair(asio::ssl::context& server_context, asio::ssl::context& client_context, std::function<void(tls_client_stream&)> before_handshake = nullptr)
+    {
+        auto [server, client] = connected_pair(uva::networking::next_io_context(), uva::networking::main_io_context());
+
+        tls_pair<Socket> pair;
+        pair.server = std::make_unique<Socket>(std::move(server), server_context);
+        pair.client = std::make_unique<tls_client_stream>(std::move(client), client_context);
+
+        std::promise<uva::networking::error_code> server_handshake;
+        Socket& socket = *pair.server;
+
+        asio::post(socket.lowest_layer().get_executor(), [&socket, &server_handshake]() {
+            socket.async_server_handshake([&server_handshake](uva::networking::error_code ec) {
+                server_handshake.set_value(ec);
+            });
+        });
+
+        if(before_handshake) {
+            before_handshake(*pair.client);
+        }
+
+        pair.client->handshake(asio::ssl::stream_base::client);
+
+        if(uva::networking::error_code ec = server_handshake.get_future().get()) {
+            throw std::runtime_error("error: server handshake failed: " + ec.message());
+        }
+
+        return pair;
+    }
+};
@@ -0,0 +1,84 @@
+#include <string>
+#include <vector>
+
+#include <networking.hpp>
+#include <tls_sessions.hpp>
+
+#include "benchmark.hpp"
+#include "tls.hpp"
+
+using namespace uva;
+using namespace networking;
+
+//Connects, handshakes and reads a first response, as a short lived service call does, connections times.
+static void run(std::string_view name, size_t connections, bool resume)
+{
+    std::vector<double> latencies;
+    latencies.reserve(connections);
+
+    tls_handshake_stats before = tls_handshake_counters();
+    benchmark::usage usage_before = benchmark::process_usage();
+
+    double seconds = benchmark::measure([&]() {
+        for(size_t i = 0; i < connections; ++i) {
+            benchmark::clock::time_point start = benchmark::clock::now();
+
+            auto pair = benchmark::tls_connected_pair<https_socket>(*ssl_context, *client_ssl_context, [resume](benchmark::tls_client_stream& client) {
+                if(resume) {
+                    resume_tls_session(client.native_handle(), "localhost");
+                }
+            });
+
+            //TLS 1.3 tickets come after the handshake, the client takes them while reading.
+            std::promise<void> written;
+            https_socket& server = *pair.server;
+
+            asio::post(server.lowest_layer().get_executor(), [&server, &written]() {
+                server.async_write("ok", [&written](error_code& ec) {
+                    written.set_value();
+                });
+            });
+
+            char response[2];
+            asio::read(*pair.client, asio::buffer(response));
+            written.get_future().wait();
+
+            latencies.push_back(benchmark::seconds_since(start));
+        }
+    });
+
+    tls_handshake_stats after = tls_handshake_counters();
+    benchmark::usage usage_after = benchmark::process_usage();
+
+    benchmark::report(std::format("{}: connections", name), connections, seconds);
+    benchmark::report_latency(std::format("{}: connect to first byte", name), latencies);
+
+    std::cout << std::format("{:<48} {} full, {} resumed, cpu {:.1f} us per connection\n", std::format("{}: server handshakes", name),
+        after.server_full - before.server_full, after.server_resumed - before.server_resumed,
+        (usage_after.cpu_seconds - usage_before.cpu_seconds) * 1e6 / connections);
+}
+
+int main(int argc, const char** argv)
+{
+    size_t connections = benchmark::argument(argc, argv, "connections", 2000);
+
+    networking::init(run_mode::async_pool, 2);
+
+    //Both ends run here, the cpu time is the server's and the client's.
+    benchmark::use_self_signed_certificate(*ssl_context);
+
+    run("full handshakes", connections, false);
+
+    run("resumed with tickets", connections, true);
+
+    tls_session_options cache_only;
+    cache_only.tickets = false;
+    configure_tls_sessions(cache_only);
+
+    //The ticket of the previous run would not be accepted anymore, the first connection makes a new session.
+    run("resumed from the server cache", connections, true);
+
+    networking::cleanup();
+
+    return 0;
+}
@@ -0,0 +1,518 @@
+#include <asset_cache.hpp>
+#include <compression.hpp>
+
+#include <fstream>
+#include <algorithm>
+#include <vector>
+
+using namespace uva;
+using namespace networking;
+using namespace web_application;
+
+std::string uva::networking::web_application::http_date(std::filesystem::file_time_type write_time)
+{
+    auto system_time = std::chrono::file_clock::to_sys(write_time);
+    time_t time = std::chrono::system_clock::to_time_t(std::chrono::time_point_cast<std::chrono::system_clock::duration>(system_time));
+
+    std::tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &time);
+#else
+    gmtime_r(&time, &tm);
+#endif
+
+    char buffer[64];
+    size_t size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    return std::string(buffer, size);
+}
+
+//Rejects paths which could leave the root folder.
+static bool is_safe_url_path(std::string_view path)
+{
+    if(path.empty() || path.find('\0') != std::string_view::npos || path.find('\\') != std::string_view::npos) {
+        return false;
+    }
+
+    while(path.size()) {
+        size_t separator = path.find('/');
+        std::string_view segment = path.substr(0, separator);
+
+        if(segment == "..") {
+            return false;
+        }
+
+        if(separator == std::string_view::npos) {
+            break;
+        }
+
+        path.remove_prefix(separator + 1);
+    }
+
+    return true;
+}
+
+std::string uva::networking::web_application::make_etag(std::string_view content)
+{
+    //FNV-1a, 64 bits. Only has to change when the content changes.
+    uint64_t hash = 14695981039346656037ull;
+
+    for(char c : content) {
+        hash ^= (uint8_t)c;
+        hash *= 1099511628211ull;
+    }
+
+    return std::format("\"{:016x}\"", hash);
+}
+
+static size_t memory_size(const static_asset& asset)
+{
+    size_t size = asset.content ? asset.content->size() : 0;
+
+    if(asset.gzip && asset.gzip->content) {
+        size += asset.gzip->content->size();
+    }
+
+    return size;
+}
+
+struct embedded_archive
+{
+    const embedded_asset* assets = nullptr;
+    size_t count = 0;
+    /* built once at registration, parallel to assets */
+    std::vector<std::shared_ptr<const static_asset>> static_assets;
+};
+
+//Function local, the archive registers itself during static initialization.
+static embedded_archive& embedded_assets()
+{
+    static embedded_archive archive;
+    return archive;
+}
+
+bool uva::networking::web_application::register_embedded_assets(const embedded_asset* assets, size_t count)
+{
+    embedded_archive& archive = embedded_assets();
+
+    archive.assets = assets;
+    archive.count = count;
+    archive.static_assets.clear();
+    archive.static_assets.reserve(count);
+
+    std::vector<std::shared_ptr<static_asset>> static_assets;
+    static_assets.reserve(count);
+
+    for(size_t i = 0; i < count; ++i) {
+        auto asset = std::make_shared<static_asset>();
+        asset->static_content = assets[i].content;
+        asset->size = assets[i].content.size();
+        asset->type = assets[i].type;
+        asset->etag = assets[i].etag;
+        asset->last_modified = assets[i].last_modified;
+
+        static_assets.push_back(std::move(asset));
+    }
+
+    //Links every compressible asset to its .gz, if it was embedded too.
+    for(size_t i = 0; i < count; ++i) {
+        if(!is_compressible(assets[i].type)) {
+            continue;
+        }
+
+        std::string gzip_path = std::string(assets[i].path) + ".gz";
+
+        const embedded_asset* gzip = std::lower_bound(assets, assets + count, gzip_path, [](const embedded_asset& asset, const std::string& path) {
+            return asset.path < path;
+        });
+
+        if(gzip != assets + count && gzip->path == gzip_path) {
+            static_assets[i]->gzip = static_assets[gzip - assets];
+        }
+    }
+
+    archive.static_assets.assign(static_assets.begin(), static_assets.end());
+
+    return true;
+}
+
+std::shared_ptr<const static_asset> uva::networking::web_application::basic_asset_cache::find_embedded(std::string_view path) const
+{
+    const embedded_archive& archive = embedded_assets();
+    const embedded_asset* end = archive.assets + archive.count;
+
+    const embedded_asset* it = std::lower_bound(archive.assets, end, path, [](const embedded_asset& asset, std::string_view path) {
+        return asset.path < path;
+    });
+
+    if(it == end || it->path != path) {
+        return nullptr;
+    }
+
+    return archive.static_assets[it - archive.assets];
+}
+
+uva::networking::web_application::basic_asset_cache::basic_asset_cache(std::filesystem::path __root, size_t __memory_budget, size_t __file_body_threshold)
+    : m_root(std::move(__root)), m_memory_budget(__memory_budget), m_file_body_threshold(__file_body_threshold)
+{
+
+}
+
+std::shared_ptr<const static_asset> uva::networking::web_application::basic_asset_cache::find(std::string_view url)
+{
+    while(url.starts_with('/')) {
+        url.remove_prefix(1);
+    }
+
+    if(!is_safe_url_path(url)) {
+        return nullptr;
+    }
+
+    if(embedded_assets().count) {
+        return find_embedded(url);
+    }
+
+    std::string key(url);
+    auto now = std::chrono::steady_clock::now();
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        auto it = m_entries.find(key);
+
+        if(it != m_entries.end()) {
+            entry& e = it->second;
+
+            m_lru.splice(m_lru.begin(), m_lru, e.lru_position);
+
+            if(now - e.checked_at < revalidate_interval) {
+                return e.asset;
+            }
+
+            std::error_code ec;
+            auto write_time = std::filesystem::last_write_time(m_root / key, ec);
+
+            if(!ec && write_time == e.asset->write_time) {
+                e.checked_at = now;
+                return e.asset;
+            }
+
+            //Changed or removed, load it again.
+            erase(it);
+        }
+    }
+
+    std::error_code ec;
+    std::shared_ptr<const static_asset> asset = load(m_root / key, ec);
+
+    if(!asset) {
+        return nullptr;
+    }
+
+    size_t size = memory_size(*asset);
+
+    //Files bigger than the whole budget are served, but not kept.
+    if(size > m_memory_budget) {
+        return asset;
+    }
+
+    std::scoped_lock lock(m_mutex);
+
+    //Another thread may have loaded it meanwhile.
+    auto it = m_entries.find(key);
+
+    if(it != m_entries.end()) {
+        erase(it);
+    }
+
+    m_lru.push_front(key);
+
+    entry e;
+    e.asset = asset;
+    e.lru_position = m_lru.begin();
+    e.checked_at = now;
+
+    m_entries.insert({ std::move(key), std::move(e) });
+    m_memory_usage += size;
+
+    evict();
+
+    return asset;
+}
+
+size_t uva::networking::web_application::basic_asset_cache::memory_usage()
+{
+    std::scoped_lock lock(m_mutex);
+    return m_memory_usage;
+}
+
+void uva::networking::web_application::basic_asset_cache::set_memory_budget(size_t budget)
+{
+    std::scoped_lock lock(m_mutex);
+
+    m_memory_budget = budget;
+    evict();
+}
+
+std::shared_ptr<const static_asset> uva::networking::web_application::basic_asset_cache::load(const std::filesystem::path& path, std::error_code& ec)
+{
+    std::shared_ptr<static_asset> asset = load_file(path, ec);
+
+    //The .gz is only looked for when the asset itself is (re)loaded.
+    if(asset && is_compressible(asset->type)) {
+        std::error_code gzip_ec;
+        asset->gzip = load_file(path.string() + ".gz", gzip_ec);
+    }
+
+    return asset;
+}
+
+std::shared_ptr<static_asset> uva::networking::web_application::basic_asset_cache::load_file(const std::filesystem::path& path, std::error_code& ec)
+{
+    if(!std::filesystem::is_regular_file(path, ec)) {
+        return nullptr;
+    }
+
+    auto write_time = std::filesystem::last_write_time(path, ec);
+
+    if(ec) {
+        return nullptr;
+    }
+
+    size_t file_size = (size_t)std::filesystem::file_size(path, ec);
+
+    if(ec) {
+        return nullptr;
+    }
+
+    if(file_size >= m_file_body_threshold) {
+        auto asset = std::make_shared<static_asset>();
+        asset->path = path;
+        asset->size = file_size;
+        asset->type = content_type_from_extension(path.extension().string());
+        //Hashing would read the whole file, size and modification time change with it.
+        asset->etag = std::format("\"{:x}-{:x}\"", file_size, (uint64_t)write_time.time_since_epoch().count());
+        asset->last_modified = http_date(write_time);
+        asset->write_time = write_time;
+
+        return asset;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+
+    if(!file.is_open()) {
+        return nullptr;
+    }
+
+    auto content = std::make_shared<std::string>();
+
+    file.seekg(0, std::ios::end);
+    content->resize((size_t)file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read(content->data(), content->size());
+
+    auto asset = std::make_shared<static_asset>();
+    asset->path = path;
+    asset->size = content->size();
+    asset->type = content_type_from_extension(path.extension().string());
+    asset->etag = make_etag(*content);
+    asset->last_modified = http_date(write_time);
+    asset->write_time = write_time;
+    asset->content = std::move(content);
+
+    return asset;
+}
+
+void uva::networking::web_application::basic_asset_cache::erase(std::unordered_map<std::string, entry>::iterator it)
+{
+    m_memory_usage -= memory_size(*it->second.asset);
+    m_lru.erase(it->second.lru_position);
+    m_entries.erase(it);
+}
+
+void uva::networking::web_application::basic_asset_cache::evict()
+{
+    while(m_memory_usage > m_memory_budget && m_lru.size()) {
+        erase(m_entries.find(m_lru.back()));
+    }
+}
+
+void uva::networking::web_application::basic_asset_cache::build_manifest()
+{
+    m_fingerprinted_urls.clear();
+    m_fingerprinted_paths.clear();
+
+    const embedded_archive& archive = embedded_assets();
+
+    if(archive.count) {
+        for(size_t i = 0; i < archive.count; ++i) {
+            add_to_manifest(std::string(archive.assets[i].path), *archive.static_assets[i]);
+        }
+
+        return;
+    }
+
+    std::error_code ec;
+
+    if(!std::filesystem::is_directory(m_root, ec)) {
+        return;
+    }
+
+    for(auto it = std::filesystem::recursive_directory_iterator(m_root, ec); it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if(ec) {
+            break;
+        }
+
+        //Views are rendered, never served.
+        if(it->is_directory() && it.depth() == 0 && it->path().filename() == "views") {
+            it.disable_recursion_pending();
+            continue;
+        }
+
+        if(!it->is_regular_file()) {
+            continue;
+        }
+
+        std::string path = std::filesystem::relative(it->path(), m_root).generic_string();
+        std::shared_ptr<const static_asset> asset = find(path);
+
+        if(asset) {
+            add_to_manifest(path, *asset);
+        }
+    }
+}
+
+void uva::networking::web_application::basic_asset_cache::add_to_manifest(const std::string& path, const static_asset& asset)
+{
+    //The ETag is already a hash of the content (or of its size and modification time, for big files).
+    std::string fingerprint;
+
+    for(char c : asset.etag) {
+        if(isxdigit((unsigned char)c)) {
+            fingerprint.push_back(c);
+        }
+    }
+
+    size_t separator = path.rfind('/');
+    size_t extension = path.rfind('.');
+
+    std::string url = "/";
+
+    if(extension == std::string::npos || (separator != std::string::npos && extension < separator)) {
+        url += path + "-" + fingerprint;
+    } else {
+        url += path.substr(0, extension) + "-" + fingerprint + path.substr(extension);
+    }
+
+    m_fingerprinted_paths[url] = path;
+    m_fingerprinted_urls[path] = std::move(url);
+}
+
+std::string_view uva::networking::web_application::basic_asset_cache::fingerprinted_url(std::string_view path) const
+{
+    while(path.starts_with('/')) {
+        path.remove_prefix(1);
+    }
+
+    auto it = m_fingerprinted_urls.find(std::string(path));
+
+    if(it == m_fingerprinted_urls.end()) {
+        return std::string_view();
+    }
+
+    return it->second;
+}
+
+std::shared_ptr<const static_asset> uva::networking::web_application::basic_asset_cache::find_fingerprinted(std::string_view url)
+{
+    if(m_fingerprinted_paths.empty()) {
+        return nullptr;
+    }
+
+    auto it = m_fingerprinted_paths.find(std::string(url));
+
+    if(it == m_fingerprinted_paths.end()) {
+        return nullptr;
+    }
+
+    return find(it->second);
+}
+
+//If-None-Match is a list of entity tags, compared weakly (RFC 9110, 13.1.2).
+static bool none_match(std::string_view if_none_match, std::string_view etag)
+{
+    while(if_none_match.size()) {
+        size_t separator = if_none_match.find(',');
+        std::string_view tag = if_none_match.substr(0, separator);
+
+        while(tag.size() && (tag.front() == ' ' || tag.front() == '\t')) {
+            tag.remove_prefix(1);
+        }
+
+        while(tag.size() && (tag.back() == ' ' || tag.back() == '\t')) {
+            tag.remove_suffix(1);
+        }
+
+        if(tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+
+        if(tag == "*" || tag == etag) {
+            return false;
+        }
+
+        if(separator == std::string_view::npos) {
+            break;
+        }
+
+        if_none_match.remove_prefix(separator + 1);
+    }
+
+    return true;
+}
+
+void uva::networking::web_application::set_asset_body(http_message& response, const static_asset& asset)
+{
+    response.raw_body.clear();
+    response.shared_body.reset();
+    response.static_body = std::string_view();
+    response.file_body.clear();
+
+    if(asset.content) {
+        response.shared_body = asset.content;
+    } else if(asset.path.empty()) {
+        response.static_body = asset.static_content;
+    } else {
+        response.file_body = asset.path;
+        response.file_body_size = asset.size;
+    }
+}
+
+void uva::networking::web_application::respond_with_asset(const http_message& request, http_message& response, std::shared_ptr<const static_asset> asset)
+{
+    response.type = asset->type;
+    response.raw_body.clear();
+    response.shared_body.reset();
+    response.static_body = std::string_view();
+    response.file_body.clear();
+    response.headers.set("ETag", asset->etag);
+    response.headers.set("Last-Modified", asset->last_modified);
+
+    std::string_view if_none_match = request.headers.get(known_header::if_none_match);
+    bool not_modified = false;
+
+    if(if_none_match.size()) {
+        not_modified = !none_match(if_none_match, asset->etag);
+    } else {
+        //Clients send back the Last-Modified they got, so an exact match is enough.
+        std::string_view if_modified_since = request.headers.get(known_header::if_modified_since);
+        not_modified = if_modified_since.size() && if_modified_since == asset->last_modified;
+    }
+
+    if(not_modified) {
+        response.status = status_code::not_modified;
+    } else {
+        response.status = status_code::ok;
+        set_asset_body(response, *asset);
+    }
+}
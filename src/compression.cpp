@@ -0,0 +1,274 @@
+#include <compression.hpp>
+
+#include <stdexcept>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+
+#include <zlib.h>
+
+using namespace uva;
+using namespace networking;
+
+std::string_view uva::networking::content_encoding_to_string(const content_encoding& encoding)
+{
+    switch(encoding)
+    {
+        case content_encoding::gzip:
+            return "gzip";
+        case content_encoding::deflate:
+            return "deflate";
+        default:
+            return std::string_view();
+    }
+}
+
+static std::string_view trim(std::string_view s)
+{
+    while(s.size() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+
+    while(s.size() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+
+    return s;
+}
+
+//Accept-Encoding is a list of codings with optional weights: "gzip;q=1.0, deflate;q=0.5, *;q=0" (RFC 9110, 12.5.3).
+content_encoding uva::networking::negotiate_content_encoding(std::string_view accept_encoding)
+{
+    double gzip_weight = -1;
+    double deflate_weight = -1;
+    double any_weight = -1;
+
+    while(accept_encoding.size()) {
+        size_t separator = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, separator);
+
+        size_t parameters = item.find(';');
+        std::string_view coding = trim(item.substr(0, parameters));
+        double weight = 1;
+
+        if(parameters != std::string_view::npos) {
+            std::string_view parameter = trim(item.substr(parameters + 1));
+
+            if(parameter.starts_with("q=") || parameter.starts_with("Q=")) {
+                weight = std::strtod(std::string(parameter.substr(2)).c_str(), nullptr);
+            }
+        }
+
+        if(case_insensitive_equals(coding, "gzip") || case_insensitive_equals(coding, "x-gzip")) {
+            gzip_weight = weight;
+        } else if(case_insensitive_equals(coding, "deflate")) {
+            deflate_weight = weight;
+        } else if(coding == "*") {
+            any_weight = weight;
+        }
+
+        if(separator == std::string_view::npos) {
+            break;
+        }
+
+        accept_encoding.remove_prefix(separator + 1);
+    }
+
+    if(gzip_weight < 0) {
+        gzip_weight = any_weight;
+    }
+
+    if(deflate_weight < 0) {
+        deflate_weight = any_weight;
+    }
+
+    if(gzip_weight > 0 && gzip_weight >= deflate_weight) {
+        return content_encoding::gzip;
+    }
+
+    if(deflate_weight > 0) {
+        return content_encoding::deflate;
+    }
+
+    return content_encoding::identity;
+}
+
+bool uva::networking::is_compressible(const content_type& type)
+{
+    switch(type)
+    {
+        case content_type::application_json:
+        case content_type::text_html:
+        case content_type::text_css:
+        case content_type::text_csv:
+        case content_type::text_plain:
+        case content_type::text_javascript:
+        case content_type::image_svg:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static constexpr size_t chunk_size = 16 * 1024;
+
+static void init_deflate(z_stream& stream, const content_encoding& encoding, int level)
+{
+    //15 is the largest window, +16 writes a gzip wrapper instead of a zlib one.
+    int window_bits = encoding == content_encoding::gzip ? 15 + 16 : 15;
+
+    if(deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("error: failed to initialize zlib");
+    }
+}
+
+std::string uva::networking::compress(std::string_view input, const content_encoding& encoding, int level)
+{
+    if(encoding == content_encoding::identity) {
+        return std::string(input);
+    }
+
+    z_stream stream = {};
+    init_deflate(stream, encoding, level);
+
+    std::string output;
+    output.reserve(deflateBound(&stream, (uLong)input.size()));
+
+    int result = Z_OK;
+
+    do {
+        size_t to_feed = std::min(input.size(), chunk_size);
+
+        stream.next_in = (Bytef*)input.data();
+        stream.avail_in = (uInt)to_feed;
+        input.remove_prefix(to_feed);
+
+        int flush = input.empty() ? Z_FINISH : Z_NO_FLUSH;
+
+        do {
+            size_t written = output.size();
+            output.resize(written + chunk_size);
+
+            stream.next_out = (Bytef*)output.data() + written;
+            stream.avail_out = (uInt)chunk_size;
+
+            result = deflate(&stream, flush);
+
+            output.resize(written + chunk_size - stream.avail_out);
+        } while(stream.avail_out == 0);
+    } while(result != Z_STREAM_END && result != Z_STREAM_ERROR);
+
+    deflateEnd(&stream);
+
+    if(result != Z_STREAM_END) {
+        throw std::runtime_error("error: zlib failed to compress");
+    }
+
+    return output;
+}
+
+//The z_stream of a compressed body_generator, ended with it.
+struct deflate_stream
+{
+    z_stream stream = {};
+    /* the chunk of the wrapped generator being compressed */
+    std::string input;
+    bool finished = false;
+
+    deflate_stream(const content_encoding& encoding, int level)
+    {
+        init_deflate(stream, encoding, level);
+    }
+    ~deflate_stream()
+    {
+        deflateEnd(&stream);
+    }
+};
+
+body_generator uva::networking::compress_body(body_generator generator, const content_encoding& encoding, int level)
+{
+    if(encoding == content_encoding::identity) {
+        return generator;
+    }
+
+    auto state = std::make_shared<deflate_stream>(encoding, level);
+
+    return [generator = std::move(generator), state](std::string& chunk) {
+        if(state->finished) {
+            return false;
+        }
+
+        //zlib keeps small inputs until it has a block worth writing, the generator is called until there is output.
+        while(chunk.empty()) {
+            state->input.clear();
+
+            bool more = generator(state->input);
+            int flush = more ? Z_NO_FLUSH : Z_FINISH;
+
+            z_stream& stream = state->stream;
+
+            stream.next_in = (Bytef*)state->input.data();
+            stream.avail_in = (uInt)state->input.size();
+
+            int result = Z_OK;
+
+            do {
+                size_t written = chunk.size();
+                chunk.resize(written + chunk_size);
+
+                stream.next_out = (Bytef*)chunk.data() + written;
+                stream.avail_out = (uInt)chunk_size;
+
+                result = deflate(&stream, flush);
+
+                chunk.resize(written + chunk_size - stream.avail_out);
+            } while(stream.avail_out == 0 || (flush == Z_FINISH && result == Z_OK));
+
+            if(result == Z_STREAM_ERROR) {
+                throw std::runtime_error("error: zlib failed to compress");
+            }
+
+            if(!more) {
+                state->finished = true;
+                break;
+            }
+        }
+
+        return true;
+    };
+}
+
+void uva::networking::compress_response(http_message& response, const content_encoding& encoding, const compression_options& options)
+{
+    if(!options.level || !is_compressible(response.type)) {
+        return;
+    }
+
+    if(response.shared_body || response.static_body.data() || !response.file_body.empty()) {
+        return;
+    }
+
+    //Caches must keep a response per encoding, even when this one goes uncompressed.
+    response.headers.set("Vary", "Accept-Encoding");
+
+    //Its size is not known up front, so min_size does not apply. It is compressed on the io thread, as it is generated.
+    if(response.body_stream) {
+        if(encoding != content_encoding::identity && !response.headers.contains("Content-Encoding")) {
+            response.body_stream = compress_body(std::move(response.body_stream), encoding, options.level);
+            response.headers.set("Content-Encoding", content_encoding_to_string(encoding));
+        }
+
+        return;
+    }
+
+    if(encoding == content_encoding::identity || response.raw_body.size() < options.min_size) {
+        return;
+    }
+
+    if(response.headers.contains("Content-Encoding")) {
+        return;
+    }
+
+    response.raw_body = compress(response.raw_body, encoding, options.level);
+    response.headers.set("Content-Encoding", content_encoding_to_string(encoding));
+}
@@ -0,0 +1,212 @@
+#include <html_template.hpp>
+
+#include <routing.hpp>
+#include <file.hpp>
+
+using namespace uva;
+using namespace networking;
+using namespace web_application;
+
+uva::networking::web_application::basic_compiled_html_template::basic_compiled_html_template(std::string __source, bool __is_template, const exposed_function_map* functions)
+    : m_source(std::move(__source))
+{
+    static constexpr std::string_view var_tag = "<var>";
+    static constexpr std::string_view close_var_tag = "</var>";
+
+    std::string_view source = m_source;
+    size_t index = 0;
+
+    auto add_literal = [&](size_t offset, size_t size) {
+        if(!size) {
+            return;
+        }
+
+        node literal;
+        literal.type = node_type::literal;
+        literal.offset = offset;
+        literal.size = size;
+
+        m_nodes.push_back(std::move(literal));
+        m_literal_size += size;
+    };
+
+    while(__is_template && index < source.size())
+    {
+        size_t open = source.find(var_tag, index);
+
+        if(open == std::string_view::npos) {
+            break;
+        }
+
+        size_t content_start = open + var_tag.size();
+        size_t close = source.find(close_var_tag, content_start);
+
+        //An unclosed tag is kept as text.
+        if(close == std::string_view::npos) {
+            break;
+        }
+
+        add_literal(index, open - index);
+
+        std::string_view content = source.substr(content_start, close - content_start);
+        size_t parentheses_index = content.find('(');
+
+        node n;
+
+        if(parentheses_index == std::string_view::npos) {
+            n.type = node_type::variable;
+            n.name = std::string(content);
+        } else {
+            std::string_view params = content.substr(parentheses_index);
+            n.type = node_type::function_call;
+            n.name = std::string(content.substr(0, parentheses_index));
+
+            while(params.size() && isspace(params.back())) {
+                params.remove_suffix(1);
+            }
+
+            if(!params.ends_with(')')) {
+                throw std::runtime_error("failed to parse HTML template: missing ')' at end of function call.");
+            }
+
+            params.remove_prefix(1);
+            params.remove_suffix(1);
+
+            n.arguments_text = std::string(params);
+            n.arguments = parse_argument_list(n.arguments_text);
+
+            if(functions) {
+                auto it = functions->find(n.name);
+
+                if(it == functions->end()) {
+                    throw std::runtime_error(std::format("error: function '{}' not found", n.name));
+                }
+
+                n.function = &it->second;
+            }
+        }
+
+        m_nodes.push_back(std::move(n));
+
+        index = close + close_var_tag.size();
+    }
+
+    add_literal(index, source.size() - index);
+}
+
+std::string uva::networking::web_application::basic_compiled_html_template::render(const var& locals) const
+{
+    std::string output;
+    output.reserve(std::max(m_literal_size, m_render_size_hint.load(std::memory_order_relaxed)));
+
+    for(const node& n : m_nodes)
+    {
+        switch(n.type)
+        {
+            case node_type::literal:
+                output.append(m_source, n.offset, n.size);
+            break;
+            case node_type::variable: {
+                var value = locals.fetch(n.name);
+
+                if(value) {
+                    output += value.to_s();
+                }
+            }
+            break;
+            case node_type::function_call:
+                if(!n.function) {
+                    throw std::runtime_error(std::format("error: function '{}' not found", n.name));
+                }
+
+                output += (*n.function)(n.arguments);
+            break;
+        }
+    }
+
+    if(output.size() > m_render_size_hint.load(std::memory_order_relaxed)) {
+        m_render_size_hint.store(output.size(), std::memory_order_relaxed);
+    }
+
+    return output;
+}
+
+uva::networking::web_application::basic_html_template_cache::basic_html_template_cache(std::filesystem::path __views_root, const exposed_function_map& __functions, bool __watch_files)
+    : m_views_root(std::move(__views_root)), m_functions(__functions), m_watch_files(__watch_files)
+{
+
+}
+
+std::filesystem::path uva::networking::web_application::basic_html_template_cache::find_view_file(const std::string& controller, const std::string& name) const
+{
+    static std::vector<std::string> extensions = { "cpp.html", "html" };
+
+    std::filesystem::path possibility = m_views_root / controller / name;
+
+    for(const std::string& extension : extensions) {
+        possibility = possibility.replace_extension(extension);
+        if(std::filesystem::exists(possibility)) {
+            return possibility;
+        }
+    }
+
+    return {};
+}
+
+std::shared_ptr<const basic_compiled_html_template> uva::networking::web_application::basic_html_template_cache::find(const std::string& controller, const std::string& name)
+{
+    std::string key = controller + '/' + name;
+    auto now = std::chrono::steady_clock::now();
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        auto it = m_entries.find(key);
+
+        if(it != m_entries.end()) {
+            entry& e = it->second;
+
+            if(!m_watch_files || now - e.checked_at < revalidate_interval) {
+                return e.compiled;
+            }
+
+            std::error_code ec;
+            auto write_time = std::filesystem::last_write_time(e.path, ec);
+
+            if(!ec && write_time == e.write_time) {
+                e.checked_at = now;
+                return e.compiled;
+            }
+
+            //Changed or removed, compile it again.
+            m_entries.erase(it);
+        }
+    }
+
+    std::filesystem::path path = find_view_file(controller, name);
+
+    if(path.empty()) {
+        return nullptr;
+    }
+
+    entry e;
+    e.path = path;
+    e.write_time = std::filesystem::last_write_time(path);
+    e.checked_at = now;
+    e.compiled = std::make_shared<basic_compiled_html_template>(uva::file::read_all_text<char>(path.string()), path.string().ends_with(".cpp.html"), &m_functions);
+
+    std::shared_ptr<const basic_compiled_html_template> compiled = e.compiled;
+
+    std::scoped_lock lock(m_mutex);
+
+    //Another thread may have compiled it meanwhile, both are the same.
+    m_entries.insert_or_assign(std::move(key), std::move(e));
+
+    return compiled;
+}
+
+void uva::networking::web_application::basic_html_template_cache::clear()
+{
+    std::scoped_lock lock(m_mutex);
+    m_entries.clear();
+}
@@ -1,6 +1,36 @@
 #include <networking.hpp>
+#include <tls_sessions.hpp>
 
 #include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef __linux__
+    #include <sys/sendfile.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__) && OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS)
+    #define UVA_NETWORKING_KTLS
+    #ifndef TCP_ULP
+        #define TCP_ULP 31
+    #endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define UVA_NETWORKING_SSE2
+    #include <emmintrin.h>
+#endif
 
 #include <console.hpp>
 #include <json.hpp>
@@ -10,82 +40,403 @@ using namespace uva;
 using namespace networking;
 using namespace console;
 
+static std::atomic<bool> s_ktls_enabled = false;
+static bool s_has_server_certificate = false;
+
 //STATIC PUBLIC VARIABLES
-std::unique_ptr<asio::io_context> uva::networking::io_context;
-std::unique_ptr<asio::io_context::work> uva::networking::work;
+uva::networking::main_io_context_alias uva::networking::io_context;
 std::unique_ptr<asio::ssl::context> uva::networking::ssl_context;
+std::unique_ptr<asio::ssl::context> uva::networking::client_ssl_context;
 const std::string uva::networking::version = "1.0.0";
 
 //STATIC PRIVATE VARIABLES
-std::unique_ptr<std::thread> work_thread;
-std::unique_ptr<asio::ip::tcp::resolver> resolver;
+struct io_worker
+{
+    std::unique_ptr<asio::io_context> context;
+    std::unique_ptr<asio::io_context::work> work;
+    //Only touched from the thread running context.
+    std::unique_ptr<asio::ip::tcp::resolver> resolver;
+    std::unique_ptr<std::thread> thread;
+};
 
-void asio_thread_loop()
+std::vector<io_worker> io_workers;
+std::atomic<size_t> next_io_worker = 0;
+
+//TLS handshakes run here when started, apart from the established connections.
+std::vector<io_worker> handshake_workers;
+std::atomic<size_t> next_handshake_worker = 0;
+
+void asio_thread_loop(asio::io_context& context, size_t index, size_t count)
 {
-    std::cout << "Running ASIO..." << std::endl;
+    std::cout << std::format("Running ASIO ({}/{})...", index+1, count) << std::endl;
     try {
-        io_context->run();
+        context.run();
     } catch(std::exception e)
     {
-        log_error("Exception caught at ASIO thread: {}", e.what());
-        asio_thread_loop();
+        log_error("Exception caught at ASIO thread {}: {}", index, e.what());
+        asio_thread_loop(context, index, count);
     }
     catch(...)
     {
-        log_error("Unknown exception caught at ASIO thread.");
-        asio_thread_loop();
+        log_error("Unknown exception caught at ASIO thread {}.", index);
+        asio_thread_loop(context, index, count);
     }
     std::cout << "Exiting ASIO thread" << std::endl; 
 }
 
-void uva::networking::init(const run_mode &mode)
+void uva::networking::init(const run_mode &mode, size_t io_threads)
 {
-    io_context = std::make_unique<asio::io_context>();
-    
+    size_t io_context_count = 1;
+
     switch (mode)
     {
-        case uva::networking::run_mode::async: {
-            work = std::make_unique<asio::io_context::work>(*io_context);
-            work_thread = std::make_unique<std::thread>(&asio_thread_loop);
+        case uva::networking::run_mode::async:
+        break;
+        case uva::networking::run_mode::async_pool: {
+            io_context_count = io_threads ? io_threads : std::thread::hardware_concurrency();
+
+            if(!io_context_count) {
+                io_context_count = 1;
+            }
         }
         break;
-    
     default:
         throw std::runtime_error("undefined value for rum_mode in init");
         break;
     }
 
+    io_workers.resize(io_context_count);
+
+    for(io_worker& worker : io_workers) {
+        worker.context  = std::make_unique<asio::io_context>(1);
+        worker.work     = std::make_unique<asio::io_context::work>(*worker.context);
+        worker.resolver = std::make_unique<asio::ip::tcp::resolver>(*worker.context);
+    }
+
+    for(size_t i = 0; i < io_workers.size(); ++i) {
+        io_workers[i].thread = std::make_unique<std::thread>(&asio_thread_loop, std::ref(*io_workers[i].context), i, io_workers.size());
+    }
+
+    log_success("Started {} io_context(s) in {} thread(s)", io_workers.size(), io_workers.size());
+
     ssl_context = std::make_unique<asio::ssl::context>(asio::ssl::context::sslv23);
 
     ssl_context->set_options(asio::ssl::context::default_workarounds | asio::ssl::context::no_sslv2 | asio::ssl::context::single_dh_use);
 
     ssl_context->set_password_callback([](size_t, asio::ssl::context::password_purpose){ return "teste"; });
 
-    ssl_context->use_certificate_chain_file("server.crt");
-    ssl_context->use_private_key_file("server.key", asio::ssl::context::pem);
-    ssl_context->use_tmp_dh_file("dh2048.pem");
+    //Only accepting https connections needs a certificate. Plain http servers and clients run without one.
+    try {
+        ssl_context->use_certificate_chain_file("server.crt");
+        ssl_context->use_private_key_file("server.key", asio::ssl::context::pem);
+        s_has_server_certificate = true;
+    } catch(std::exception e) {
+        s_has_server_certificate = false;
+    }
+
+    //Ephemeral elliptic curve key exchanges do not need it.
+    try {
+        ssl_context->use_tmp_dh_file("dh2048.pem");
+    } catch(std::exception e) {
+    }
+
+    //A separate context, so client and server sessions are cached apart.
+    client_ssl_context = std::make_unique<asio::ssl::context>(asio::ssl::context::sslv23);
+    client_ssl_context->set_options(asio::ssl::context::default_workarounds | asio::ssl::context::no_sslv2);
 
-    resolver = std::make_unique<asio::ip::tcp::resolver>(*io_context);
+    configure_tls_sessions(tls_session_options());
 }
 
 bool uva::networking::is_initialized()
 {
-    return io_context ? true : false;
+    return io_workers.size() ? true : false;
 }
 
 void uva::networking::cleanup()
 {
-    io_context->stop();
+    for(io_worker& worker : handshake_workers) {
+        worker.context->stop();
+    }
 
-    if(work_thread && work_thread->joinable())
-    {
-        work_thread->join();
+    for(io_worker& worker : handshake_workers) {
+        if(worker.thread && worker.thread->joinable())
+        {
+            worker.thread->join();
+        }
+
+        worker.work.reset();
+    }
+
+    handshake_workers.clear();
+
+    for(io_worker& worker : io_workers) {
+        worker.context->stop();
+    }
+
+    for(io_worker& worker : io_workers) {
+        if(worker.thread && worker.thread->joinable())
+        {
+            worker.thread->join();
+        }
     }
 
-    work.reset();
-    io_context.reset();
+    //The resolvers must be destroyed before their contexts.
+    for(io_worker& worker : io_workers) {
+        worker.resolver.reset();
+        worker.work.reset();
+    }
+
+    io_workers.clear();
     ssl_context.reset();
-    work_thread.reset();
+    client_ssl_context.reset();
+    s_ktls_enabled = false;
+    s_has_server_certificate = false;
+}
+
+static bool kernel_supports_ktls()
+{
+#ifdef UVA_NETWORKING_KTLS
+    //Attaching the tls ULP loads its module on demand. On an unconnected socket it then fails with ENOTCONN, or with ENOENT when there is no such ULP.
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    if(fd < 0) {
+        return false;
+    }
+
+    int result = ::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls"));
+    int error = errno;
+
+    ::close(fd);
+
+    return result == 0 || error == ENOTCONN;
+#else
+    return false;
+#endif
+}
+
+bool uva::networking::enable_ktls()
+{
+    if(!ssl_context) {
+        throw std::runtime_error("error: enable_ktls called before init");
+    }
+
+#ifdef UVA_NETWORKING_KTLS
+    if(!kernel_supports_ktls()) {
+        return false;
+    }
+
+    //OpenSSL still falls back to userspace encryption per connection when the kernel does not support the negotiated cipher.
+    SSL_CTX_set_options(ssl_context->native_handle(), SSL_OP_ENABLE_KTLS);
+    s_ktls_enabled = true;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool uva::networking::ktls_enabled()
+{
+    return s_ktls_enabled;
+}
+
+bool uva::networking::has_server_certificate()
+{
+    return s_has_server_certificate;
+}
+
+size_t uva::networking::io_context_count()
+{
+    return io_workers.size();
+}
+
+asio::io_context& uva::networking::main_io_context()
+{
+    if(io_workers.empty()) {
+        throw std::runtime_error("error: networking is not initialized");
+    }
+
+    return *io_workers.front().context;
+}
+
+asio::io_context& uva::networking::next_io_context()
+{
+    if(io_workers.empty()) {
+        throw std::runtime_error("error: networking is not initialized");
+    }
+
+    size_t index = next_io_worker.fetch_add(1, std::memory_order_relaxed) % io_workers.size();
+    return *io_workers[index].context;
+}
+
+void uva::networking::start_handshake_threads(size_t count)
+{
+    if(io_workers.empty()) {
+        throw std::runtime_error("error: networking is not initialized");
+    }
+
+    if(handshake_workers.size()) {
+        throw std::runtime_error("error: handshake threads are already started");
+    }
+
+    handshake_workers.resize(count);
+
+    for(io_worker& worker : handshake_workers) {
+        worker.context  = std::make_unique<asio::io_context>(1);
+        worker.work     = std::make_unique<asio::io_context::work>(*worker.context);
+    }
+
+    for(size_t i = 0; i < handshake_workers.size(); ++i) {
+        handshake_workers[i].thread = std::make_unique<std::thread>(&asio_thread_loop, std::ref(*handshake_workers[i].context), i, handshake_workers.size());
+    }
+
+    log_success("Started {} handshake thread(s)", handshake_workers.size());
+}
+
+size_t uva::networking::handshake_thread_count()
+{
+    return handshake_workers.size();
+}
+
+asio::io_context& uva::networking::next_handshake_context()
+{
+    if(handshake_workers.empty()) {
+        return next_io_context();
+    }
+
+    size_t index = next_handshake_worker.fetch_add(1, std::memory_order_relaxed) % handshake_workers.size();
+    return *handshake_workers[index].context;
+}
+
+struct resolve_cache_entry
+{
+    asio::ip::tcp::resolver::results_type results;
+    std::chrono::steady_clock::time_point expires;
+};
+
+static std::mutex s_resolve_cache_mutex;
+static std::unordered_map<std::string, resolve_cache_entry> s_resolve_cache;
+static std::chrono::seconds s_resolve_cache_ttl = std::chrono::seconds(60);
+static constexpr size_t s_resolve_cache_max_entries = 1024;
+
+static std::string resolve_cache_key(const std::string& host, const std::string& service)
+{
+    return host + ':' + service;
+}
+
+static bool find_resolved(const std::string& key, asio::ip::tcp::resolver::results_type& results)
+{
+    std::scoped_lock lock(s_resolve_cache_mutex);
+
+    auto it = s_resolve_cache.find(key);
+
+    if(it == s_resolve_cache.end()) {
+        return false;
+    }
+
+    if(std::chrono::steady_clock::now() >= it->second.expires) {
+        s_resolve_cache.erase(it);
+        return false;
+    }
+
+    results = it->second.results;
+
+    return true;
+}
+
+static void store_resolved(const std::string& key, const asio::ip::tcp::resolver::results_type& results)
+{
+    std::scoped_lock lock(s_resolve_cache_mutex);
+
+    if(!s_resolve_cache_ttl.count() || results.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if(s_resolve_cache.size() >= s_resolve_cache_max_entries) {
+        std::erase_if(s_resolve_cache, [now](const auto& entry) {
+            return now >= entry.second.expires;
+        });
+
+        if(s_resolve_cache.size() >= s_resolve_cache_max_entries) {
+            s_resolve_cache.erase(s_resolve_cache.begin());
+        }
+    }
+
+    s_resolve_cache[key] = { results, now + s_resolve_cache_ttl };
+}
+
+//After every address failed, they may have changed.
+static void forget_resolved(const std::string& key)
+{
+    std::scoped_lock lock(s_resolve_cache_mutex);
+    s_resolve_cache.erase(key);
+}
+
+void uva::networking::set_resolve_cache_ttl(std::chrono::seconds ttl)
+{
+    std::scoped_lock lock(s_resolve_cache_mutex);
+
+    s_resolve_cache_ttl = ttl;
+
+    if(!ttl.count()) {
+        s_resolve_cache.clear();
+    }
+}
+
+static std::atomic<size_t> s_max_body_size = 8 * 1024 * 1024;
+
+void uva::networking::set_max_body_size(size_t size)
+{
+    s_max_body_size = size;
+}
+
+size_t uva::networking::max_body_size()
+{
+    return s_max_body_size;
+}
+
+void uva::networking::clear_resolve_cache()
+{
+    std::scoped_lock lock(s_resolve_cache_mutex);
+    s_resolve_cache.clear();
+}
+
+void uva::networking::async_resolve(asio::io_context& context, const std::string& host, const std::string& service, std::function<void(error_code, asio::ip::tcp::resolver::results_type)> completation)
+{
+    std::string key = resolve_cache_key(host, service);
+    asio::ip::tcp::resolver::results_type cached;
+
+    if(find_resolved(key, cached)) {
+        //Completes from context all the same.
+        asio::post(context, [completation, cached]() {
+            completation(error_code(), cached);
+        });
+
+        return;
+    }
+
+    auto it = std::find_if(io_workers.begin(), io_workers.end(), [&context](const io_worker& worker) {
+        return worker.context.get() == &context;
+    });
+
+    if(it == io_workers.end()) {
+        throw std::runtime_error("error: io_context is not owned by networking");
+    }
+
+    asio::ip::tcp::resolver* resolver = it->resolver.get();
+
+    //The resolver is not thread safe, so it is only used from the thread running its context.
+    asio::post(context, [resolver, host, service, key, completation]() {
+        resolver->async_resolve(host, service, [key, completation](error_code ec, asio::ip::tcp::resolver::results_type results) {
+            if(!ec) {
+                store_resolved(key, results);
+            }
+
+            completation(ec, results);
+        });
+    });
 }
 
 static std::map<status_code, std::string> s_status_codes
@@ -93,6 +444,7 @@ static std::map<status_code, std::string> s_status_codes
     { (status_code)200, "OK" },
     { (status_code)204, "No Content" },
     { (status_code)302, "Moved" },
+    { (status_code)304, "Not Modified" },
     { (status_code)400, "Bad Request" },
     { (status_code)401, "Unauthorized" },
     { (status_code)404, "Not Found" },
@@ -107,6 +459,35 @@ static std::map<content_type, std::string> s_content_types
     { content_type::image_jpeg,       "image/jpeg" },
     { content_type::text_css,         "text/css" },
     { content_type::application_json, "application/json" },
+    { content_type::text_csv,         "text/csv" },
+    { content_type::text_plain,       "text/plain" },
+    { content_type::text_javascript,  "text/javascript" },
+    { content_type::image_png,        "image/png" },
+    { content_type::image_gif,        "image/gif" },
+    { content_type::image_svg,        "image/svg+xml" },
+    { content_type::image_x_icon,     "image/x-icon" },
+    { content_type::font_woff,        "font/woff" },
+    { content_type::font_woff2,       "font/woff2" },
+    { content_type::application_octet_stream, "application/octet-stream" },
+};
+
+static std::map<std::string_view, content_type> s_extension_content_types
+{
+    { ".html",  content_type::text_html },
+    { ".htm",   content_type::text_html },
+    { ".css",   content_type::text_css },
+    { ".csv",   content_type::text_csv },
+    { ".txt",   content_type::text_plain },
+    { ".js",    content_type::text_javascript },
+    { ".json",  content_type::application_json },
+    { ".jpg",   content_type::image_jpeg },
+    { ".jpeg",  content_type::image_jpeg },
+    { ".png",   content_type::image_png },
+    { ".gif",   content_type::image_gif },
+    { ".svg",   content_type::image_svg },
+    { ".ico",   content_type::image_x_icon },
+    { ".woff",  content_type::font_woff },
+    { ".woff2", content_type::font_woff2 },
 };
 
 static std::string s_server_version = "0.0.1";
@@ -155,550 +536,2536 @@ content_type uva::networking::content_type_from_string(const std::string &conten
     throw std::runtime_error(std::format("error: {} is not a valid content_type.", actual_content_type));
 }
 
-const char* standard_time_format()
+static std::string s_known_headers[(size_t)known_header::count]
 {
-    return "%a, %d %b %Y %X GMT";
-}
+    "Content-Length",
+    "Content-Type",
+    "Connection",
+    "Transfer-Encoding",
+    "Host",
+    "Accept-Encoding",
+    "If-None-Match",
+    "If-Modified-Since",
+};
 
-std::string time_to_string(const char* format, const time_t& time)
+static char ascii_to_lower(char c)
 {
-    std::tm* tm = std::gmtime(&time);
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
 
-    char buffer[100];
+bool uva::networking::case_insensitive_equals(std::string_view a, std::string_view b)
+{
+    if(a.size() != b.size()) {
+        return false;
+    }
 
-    std::strftime(buffer, 100, standard_time_format(), tm);
-    std::string now_str = buffer;
+    for(size_t i = 0; i < a.size(); ++i) {
+        if(ascii_to_lower(a[i]) != ascii_to_lower(b[i])) {
+            return false;
+        }
+    }
 
-    return now_str;
+    return true;
 }
 
-std::string time_to_standard_string(const time_t& time)
+static size_t known_header_from_string(std::string_view name)
 {
-    const char* format = standard_time_format();
-    return time_to_string(format, time);
+    for(size_t i = 0; i < (size_t)known_header::count; ++i) {
+        if(case_insensitive_equals(s_known_headers[i], name)) {
+            return i;
+        }
+    }
+
+    return (size_t)known_header::count;
 }
 
-std::string time_now_to_string(const char* format)
+const std::string& uva::networking::known_header_to_string(const known_header& header)
 {
-    time_t now = time(nullptr);
-    return time_to_string(format, now);
+    if(header >= known_header::count) {
+        throw std::runtime_error(std::format("error: {} is not a valid known_header code.", (size_t)header));
+    }
+
+    return s_known_headers[(size_t)header];
 }
 
-std::string time_now_to_standard_string()
+uva::networking::http_headers::http_headers(const std::map<var, var>& headers)
 {
-    return time_now_to_string(standard_time_format());
+    *this = headers;
 }
 
-std::map<var, var> parse_headers(std::istream &headers_stream)
+http_headers& uva::networking::http_headers::operator=(const std::map<var, var>& headers)
 {
-    std::map<var, var> headers;
-    std::string header;
-
-    while (std::getline(headers_stream, header) && header != "\r")
-    {
-        if (!header.size()) continue;
-        size_t separator = header.find(':');
-        if (separator == std::string::npos) continue;
-        std::string h = header.substr(0, separator);
-        header.erase(0, h.size() + 1);
-        while (header.size() && header.starts_with(' ') || header.starts_with('\t') || header.starts_with("'") || header.starts_with("\"")) {
-            header.erase(0, 1);
-        }
-        while (header.size() && header.ends_with(' ') || header.ends_with('\t') || header.ends_with("'") || header.ends_with("\"") || header.ends_with("\r") || header.ends_with("\n")) {
-            header.erase(header.size() - 1, 1);
-        }
+    clear();
 
-        headers[h] = header;
+    for(const auto& header : headers) {
+        add(header.first.to_s(), header.second.to_s());
     }
 
-    return headers;
+    return *this;
 }
 
-// void chunked_loop(basic_socket &socket, asio::streambuf& buffer)
-// {
-//     size_t to_read;
-//     std::string line;
-//     //\r\n NUMBER \r\n
-//     line.reserve(2 + 8 + 2);
-//     socket.read_until(line, );
+size_t uva::networking::http_headers::size() const
+{
+    return m_size;
+}
 
-//     socket.async_read_until(buffer, "\r\n", [&buffer](uva::networking::error_code ec, size_t len){
-//         if(!ec) {
-//             buffer.
-//         }
-//     });
-// }
+bool uva::networking::http_headers::empty() const
+{
+    return !m_size;
+}
 
-void async_read_body(basic_socket &socket, asio::streambuf& buffer, size_t already_read, std::string& body, const var& headers, std::function<void(error_code, size_t)> completation)
+void uva::networking::http_headers::clear()
 {
-    var transfer_encoding = headers.fetch("Transfer-Encoding");
+    m_storage.clear();
+    m_overflow_entries.clear();
+    m_size = 0;
 
-    if (transfer_encoding != null) {
-        //if (transfer_encoding != "chunked") {
-            throw std::runtime_error(std::format("Transfer-Encoding '{}' currently are not supported.", transfer_encoding));
-        //}
+    std::fill(std::begin(m_known_slots), std::end(m_known_slots), 0);
+}
+
+void uva::networking::http_headers::reserve(size_t storage_size)
+{
+    m_storage.reserve(storage_size);
+}
 
-        // socket.async_read_until(buffer, "\r\n", [&buffer, &body, &socket](error_code ec, size_t) {
-        //     std::string line;
-        //     {
-        //         std::istream stream(&buffer);
-        //         std::getline(stream, line);
-        //     }
+std::string_view uva::networking::http_headers::name(size_t index) const
+{
+    const entry& e = at(index);
+    return std::string_view(m_storage.data() + e.name_offset, e.name_size);
+}
 
-        //     if(line.ends_with('\n')) {
-        //         line.pop_back(); 
-        //     }
+std::string_view uva::networking::http_headers::value(size_t index) const
+{
+    const entry& e = at(index);
+    return std::string_view(m_storage.data() + e.value_offset, e.value_size);
+}
 
-        //     size_t chunk_size = std::stoi(line, nullptr, 16);
+void uva::networking::http_headers::add(std::string_view name, std::string_view value)
+{
+    entry e;
+    e.name_offset  = (uint32_t)m_storage.size();
+    e.name_size    = (uint32_t)name.size();
+    e.value_offset = (uint32_t)(e.name_offset + name.size());
+    e.value_size   = (uint32_t)value.size();
 
-        //     if(chunk_size) {
-        //         size_t old_size = body.size();
-        //         body.resize(old_size+chunk_size);
+    m_storage.append(name);
+    m_storage.append(value);
 
-        //         socket.async_read_exactly(buffer, chunk_size, [](error_code ec, size_t){
+    if(m_size < inline_capacity) {
+        m_inline_entries[m_size] = e;
+    } else {
+        m_overflow_entries.push_back(e);
+    }
 
-        //         });
-        //     }
+    ++m_size;
 
-        // });
+    size_t known = known_header_from_string(name);
 
-        // std::string buffer;
+    //The first one wins, as it was with var maps.
+    if(known < (size_t)known_header::count && !m_known_slots[known]) {
+        m_known_slots[known] = (uint16_t)m_size;
     }
-    else {
-        var content_lenght = headers.fetch("Content-Length");
+}
 
-        if (content_lenght == null) {
-            completation(error_code(), 0);
-        } else {
-            size_t body_size = content_lenght.to_i();
-            body.resize(body_size);
+void uva::networking::http_headers::set(std::string_view name, std::string_view value)
+{
+    size_t index = find(name);
 
-            size_t available_size = buffer.data().size();
-            size_t remaining_size = body_size - available_size;
+    if(index == m_size) {
+        add(name, value);
+        return;
+    }
 
-            if(available_size) {
-                std::istream stream(&buffer);
-                stream.read(body.data(), available_size);
-            }
+    //The old value is left unused in storage.
+    entry& e = at(index);
+    e.value_offset = (uint32_t)m_storage.size();
+    e.value_size   = (uint32_t)value.size();
 
-            if(remaining_size) {
-                socket.async_read_exactly(asio::buffer(body.data()+available_size, remaining_size), remaining_size, completation);
-            } else {
-                completation(error_code(), body_size);
-            }
-        }
-    }
+    m_storage.append(value);
 }
 
-void uva::networking::async_read_http_request(basic_socket &socket, http_message& request, asio::streambuf& buffer, std::function<void()> completation)
+std::string_view uva::networking::http_headers::get(const known_header& header) const
 {
-    socket.async_read_until(buffer, "\r\n\r\n", [&socket, &buffer, &request, completation](uva::networking::error_code ec, size_t s){
-        {
-            std::istream request_stream(&buffer);
-            std::string url;
-
-            request_stream >> request.method;
-            request_stream >> url;
-            request_stream >> request.version;
-
-            std::string_view url_view;
-            url_view = url;
-
-            request.url.reserve(url.size());
-            
-            while(url_view.size()) {
-                char c = url_view.front();
-                url_view.remove_prefix(1);
-                if(c == '?') {
-                    break;
-                }
-                else {
-                    request.url.push_back(c);
-                }
-            }
+    uint16_t slot = m_known_slots[(size_t)header];
 
-            if(url_view.size()) {
-                request.params = query_to_params(url_view);
-            } else {
-                request.params = empty_map;
-            }
+    if(!slot) {
+        return std::string_view();
+    }
 
-            std::string endpoint = socket.remote_endpoint_string();
-            request.endpoint = endpoint;
+    return value(slot - 1);
+}
 
-            static std::string version_start = "HTTP/";
+std::string_view uva::networking::http_headers::get(std::string_view name) const
+{
+    size_t index = find(name);
 
-            if (!request.version.starts_with(version_start)) {
-                throw std::runtime_error(std::format("Unrecognized HTTP version: {} ({} {})", request.version, request.method, request.url));
-            }
+    if(index == m_size) {
+        return std::string_view();
+    }
 
-            std::string empty_line;
-            std::getline(request_stream, empty_line);
-            request.headers = parse_headers(request_stream);
-        }
+    return value(index);
+}
 
-        async_read_body(socket, buffer, s, request.raw_body, request.headers, [&request, completation](error_code ec, size_t) {
-            if(request.method == "POST") {
+bool uva::networking::http_headers::contains(const known_header& header) const
+{
+    return m_known_slots[(size_t)header];
+}
 
-                std::string content_type = request.headers["Content-Type"];
-                if(content_type == "application/json") {
-                    request.params = json::decode(request.raw_body);
+bool uva::networking::http_headers::contains(std::string_view name) const
+{
+    return find(name) != m_size;
+}
+
+var uva::networking::http_headers::fetch(std::string_view name) const
+{
+    size_t index = find(name);
+
+    if(index == m_size) {
+        return null;
+    }
+
+    return var(std::string(value(index)));
+}
+
+var uva::networking::http_headers::to_var() const
+{
+    std::map<var, var> headers;
+
+    for(size_t i = 0; i < m_size; ++i) {
+        headers[std::string(name(i))] = std::string(value(i));
+    }
+
+    return var(std::move(headers));
+}
+
+const http_headers::entry& uva::networking::http_headers::at(size_t index) const
+{
+    return index < inline_capacity ? m_inline_entries[index] : m_overflow_entries[index - inline_capacity];
+}
+
+http_headers::entry& uva::networking::http_headers::at(size_t index)
+{
+    return index < inline_capacity ? m_inline_entries[index] : m_overflow_entries[index - inline_capacity];
+}
+
+size_t uva::networking::http_headers::find(std::string_view name) const
+{
+    size_t known = known_header_from_string(name);
+
+    if(known < (size_t)known_header::count) {
+        uint16_t slot = m_known_slots[known];
+        return slot ? slot - 1 : m_size;
+    }
+
+    for(size_t i = 0; i < m_size; ++i) {
+        if(case_insensitive_equals(this->name(i), name)) {
+            return i;
+        }
+    }
+
+    return m_size;
+}
+
+content_type uva::networking::content_type_from_extension(std::string_view extension)
+{
+    auto it = s_extension_content_types.find(extension);
+
+    if(it == s_extension_content_types.end()) {
+        return content_type::application_octet_stream;
+    }
+
+    return it->second;
+}
+
+const char* standard_time_format()
+{
+    return "%a, %d %b %Y %X GMT";
+}
+
+std::string time_to_string(const char* format, const time_t& time)
+{
+    //std::gmtime shares its result between threads
+    std::tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &time);
+#else
+    gmtime_r(&time, &tm);
+#endif
+
+    char buffer[100];
+
+    std::strftime(buffer, 100, standard_time_format(), &tm);
+    std::string now_str = buffer;
+
+    return now_str;
+}
+
+std::string time_to_standard_string(const time_t& time)
+{
+    const char* format = standard_time_format();
+    return time_to_string(format, time);
+}
+
+std::string time_now_to_string(const char* format)
+{
+    time_t now = time(nullptr);
+    return time_to_string(format, now);
+}
+
+std::string time_now_to_standard_string()
+{
+    return time_now_to_string(standard_time_format());
+}
+
+//Finds the first c in [begin, end), or end. 16 bytes are compared at once when SSE2 is available.
+static const char* find_byte(const char* begin, const char* end, char c)
+{
+#ifdef UVA_NETWORKING_SSE2
+    const __m128i needle = _mm_set1_epi8(c);
+
+    while(end - begin >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)begin);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+
+        if(mask) {
+            return begin + std::countr_zero(mask);
+        }
+
+        begin += 16;
+    }
+#endif
+    const void* found = std::memchr(begin, c, end - begin);
+
+    return found ? (const char*)found : end;
+}
+
+static bool is_optional_white_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+bool uva::networking::http_message_parser::parse(std::string_view data)
+{
+    if(m_state == state::done) {
+        return true;
+    }
+
+    m_data = data;
+
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+
+    while(true) {
+        const char* line_feed = find_byte(begin + m_scan_offset, end, '\n');
+
+        if(line_feed == end) {
+            //Next call continues from here, nothing is scanned twice.
+            m_scan_offset = data.size();
+
+            if(data.size() > max_head_size) {
+                throw std::runtime_error(std::format("error: http message head is bigger than {} bytes", max_head_size));
+            }
+
+            return false;
+        }
+
+        size_t line_end = line_feed - begin;
+        size_t content_end = line_end;
+
+        if(content_end > m_line_offset && data[content_end-1] == '\r') {
+            --content_end;
+        }
+
+        bool empty_line = content_end == m_line_offset;
+
+        switch(m_state)
+        {
+            case state::start_line:
+                //Empty lines before the start line should be ignored (RFC 9112, 2.2).
+                if(!empty_line) {
+                    parse_start_line(m_line_offset, content_end);
+                    m_state = state::headers;
+                }
+            break;
+            case state::headers:
+                if(empty_line) {
+                    m_state = state::done;
+                } else {
+                    parse_header_line(m_line_offset, content_end);
+                }
+            break;
+            default:
+            break;
+        }
+
+        m_line_offset = line_end + 1;
+        m_scan_offset = m_line_offset;
+
+        if(m_state == state::done) {
+            return true;
+        }
+    }
+}
+
+void uva::networking::http_message_parser::reset()
+{
+    m_state = state::start_line;
+    m_data = {};
+    m_line_offset = 0;
+    m_scan_offset = 0;
+    m_headers.clear();
+}
+
+bool uva::networking::http_message_parser::is_done() const
+{
+    return m_state == state::done;
+}
+
+size_t uva::networking::http_message_parser::head_size() const
+{
+    return m_line_offset;
+}
+
+std::string_view uva::networking::http_message_parser::start_line(size_t index) const
+{
+    return view(m_start_line[index]);
+}
+
+size_t uva::networking::http_message_parser::header_count() const
+{
+    return m_headers.size();
+}
+
+std::string_view uva::networking::http_message_parser::header_name(size_t index) const
+{
+    return view(m_headers[index].name);
+}
+
+std::string_view uva::networking::http_message_parser::header_value(size_t index) const
+{
+    return view(m_headers[index].value);
+}
+
+std::string_view uva::networking::http_message_parser::view(const span& s) const
+{
+    return m_data.substr(s.offset, s.size);
+}
+
+void uva::networking::http_message_parser::parse_start_line(size_t begin, size_t end)
+{
+    const char* data = m_data.data();
+
+    const char* first_space = find_byte(data + begin, data + end, ' ');
+
+    if(first_space == data + end) {
+        throw std::runtime_error(std::format("error: invalid http start line '{}'", m_data.substr(begin, end - begin)));
+    }
+
+    const char* second_space = find_byte(first_space + 1, data + end, ' ');
+
+    //Both the request line and the status line have three parts, even with an empty reason phrase (RFC 9112, 3 and 4).
+    if(second_space == data + end) {
+        throw std::runtime_error(std::format("error: invalid http start line '{}'", m_data.substr(begin, end - begin)));
+    }
+
+    size_t first  = first_space - data;
+    size_t second = second_space - data;
+
+    m_start_line[0] = { (uint32_t)begin, (uint32_t)(first - begin) };
+    m_start_line[1] = { (uint32_t)(first + 1), (uint32_t)(second - first - 1) };
+
+    //The reason phrase of a response may be empty and may contain spaces.
+    m_start_line[2] = { (uint32_t)(second + 1), (uint32_t)(end - second - 1) };
+}
+
+void uva::networking::http_message_parser::parse_header_line(size_t begin, size_t end)
+{
+    const char* data = m_data.data();
+
+    //A line starting with whitespace continues the previous one (obs-fold), which must be rejected (RFC 9112, 5.2).
+    if(is_optional_white_space(data[begin])) {
+        throw std::runtime_error("error: obsolete line folding in http header");
+    }
+
+    const char* colon = find_byte(data + begin, data + end, ':');
+
+    //No whitespace is allowed between the name and the colon, it must be rejected (RFC 9112, 5.1).
+    if(colon == data + end || colon == data + begin || is_optional_white_space(colon[-1])) {
+        throw std::runtime_error(std::format("error: invalid http header line '{}'", m_data.substr(begin, end - begin)));
+    }
+
+    size_t name_end = colon - data;
+    size_t value_begin = name_end + 1;
+    size_t value_end = end;
+
+    while(value_begin < value_end && is_optional_white_space(data[value_begin])) {
+        ++value_begin;
+    }
+
+    while(value_end > value_begin && is_optional_white_space(data[value_end-1])) {
+        --value_end;
+    }
+
+    header_span header;
+    header.name  = { (uint32_t)begin, (uint32_t)(name_end - begin) };
+    header.value = { (uint32_t)value_begin, (uint32_t)(value_end - value_begin) };
+
+    m_headers.push_back(header);
+}
+
+static std::string_view streambuf_view(const asio::streambuf& buffer)
+{
+    auto data = buffer.data();
+    return std::string_view((const char*)data.data(), data.size());
+}
+
+static void parsed_headers(const http_message_parser& parser, http_headers& headers)
+{
+    headers.clear();
+    //Names and values are never bigger than the head, so storage is allocated once.
+    headers.reserve(parser.head_size());
+
+    for(size_t i = 0; i < parser.header_count(); ++i) {
+        headers.add(parser.header_name(i), parser.header_value(i));
+    }
+}
+
+//What the read functions report for a malformed message. Nothing is thrown out of the io handlers.
+static void fail_bad_message(const std::function<void(error_code&)>& on_error)
+{
+    error_code ec = std::make_error_code(std::errc::bad_message);
+
+    if(on_error) {
+        on_error(ec);
+    }
+}
+
+enum class head_parse
+{
+    incomplete,
+    done,
+    /* an invalid start line or a head too big */
+    failed
+};
+
+static head_parse parse_http_head(const asio::streambuf& buffer, http_message_parser& parser)
+{
+    try {
+        return parser.parse(streambuf_view(buffer)) ? head_parse::done : head_parse::incomplete;
+    } catch(std::exception e)
+    {
+        return head_parse::failed;
+    }
+}
+
+template<typename Socket>
+static void async_read_more_http_head(Socket& socket, asio::streambuf& buffer, http_message_parser& parser, std::function<void()> completation, std::function<void(error_code&)> on_error)
+{
+    socket.async_read_some(buffer, [&socket, &buffer, &parser, completation, on_error](error_code ec, size_t) {
+        if(ec) {
+            if(on_error) {
+                on_error(ec);
+            }
+            return;
+        }
+
+        switch(parse_http_head(buffer, parser))
+        {
+            case head_parse::done:
+                completation();
+            break;
+            case head_parse::incomplete:
+                async_read_more_http_head(socket, buffer, parser, completation, on_error);
+            break;
+            case head_parse::failed:
+                fail_bad_message(on_error);
+            break;
+        }
+    });
+}
+
+//Reads until parser has a complete head. Bytes already in buffer (pipelined messages) are parsed first, and when they hold the head
+//it completes from a posted handler: the caller may hold locks, and a client pipelining many requests in one segment would otherwise
+//grow the stack by one read per request. Once read from the socket, it completes right away, it is in a handler already.
+template<typename Socket>
+static void async_read_http_head(Socket& socket, asio::streambuf& buffer, http_message_parser& parser, std::function<void()> completation, std::function<void(error_code&)> on_error)
+{
+    head_parse result = parse_http_head(buffer, parser);
+
+    if(result == head_parse::incomplete) {
+        async_read_more_http_head(socket, buffer, parser, completation, on_error);
+        return;
+    }
+
+    asio::post(socket.get_executor(), [result, completation, on_error]() {
+        if(result == head_parse::done) {
+            completation();
+        } else {
+            fail_bad_message(on_error);
+        }
+    });
+}
+
+enum class body_state
+{
+    chunk_size_line,
+    chunk_data,
+    chunk_data_end,
+    chunk_trailer,
+    fixed_length
+};
+
+static constexpr size_t s_max_chunk_line_size = 4096;
+
+static bool is_empty_line(std::string_view line)
+{
+    return line.empty() || line == "\r";
+}
+
+//The size is hex digits, optionally followed by whitespace and ';' extensions. Returns std::errc::value_too_large when it does not fit in size_t.
+static std::errc parse_chunk_size(std::string_view line, size_t& chunk_size)
+{
+    auto result = std::from_chars(line.data(), line.data() + line.size(), chunk_size, 16);
+
+    if(result.ec == std::errc::result_out_of_range) {
+        return std::errc::value_too_large;
+    }
+
+    if(result.ec != std::errc() || result.ptr == line.data()) {
+        return std::errc::bad_message;
+    }
+
+    std::string_view rest = line.substr(result.ptr - line.data());
+
+    while(rest.size() && is_optional_white_space(rest.front())) {
+        rest.remove_prefix(1);
+    }
+
+    if(rest.size() && rest != "\r" && rest.front() != ';') {
+        return std::errc::bad_message;
+    }
+
+    return std::errc();
+}
+
+//Delivers the body as it arrives in buffer, without copying it into a contiguous string.
+//state and remaining are kept in the arguments between reads, so nothing is parsed twice.
+//limit is what is left of the bytes allowed for the chunks and the trailer fields.
+//A malformed chunked body completes with std::errc::bad_message, or std::errc::value_too_large for a chunk size overflowing size_t or over limit.
+template<typename Socket>
+static void async_read_streamed_body(Socket& socket, asio::streambuf& buffer, body_state state, size_t remaining, size_t total, size_t limit, std::function<void(std::string_view)> on_chunk, std::function<void(error_code, size_t)> completation)
+{
+    while(true) {
+        std::string_view data = streambuf_view(buffer);
+
+        if(state == body_state::chunk_data || state == body_state::fixed_length) {
+            if(!remaining) {
+                if(state == body_state::fixed_length) {
+                    completation(error_code(), total);
+                    return;
+                }
+
+                state = body_state::chunk_data_end;
+                continue;
+            }
+
+            if(data.empty()) {
+                break;
+            }
+
+            size_t size = std::min(remaining, data.size());
+
+            on_chunk(data.substr(0, size));
+            buffer.consume(size);
+
+            remaining -= size;
+            total += size;
+
+            continue;
+        }
+
+        //The other states are line based.
+        size_t line_end = data.find('\n');
+
+        if(line_end == std::string_view::npos) {
+            if(data.size() > s_max_chunk_line_size) {
+                completation(std::make_error_code(std::errc::bad_message), total);
+                return;
+            }
+
+            break;
+        }
+
+        std::string_view line = data.substr(0, line_end);
+
+        switch(state)
+        {
+            case body_state::chunk_size_line: {
+                size_t chunk_size = 0;
+                std::errc error = parse_chunk_size(line, chunk_size);
+
+                if(error != std::errc()) {
+                    completation(std::make_error_code(error), total);
+                    return;
+                }
+
+                if(chunk_size > limit) {
+                    completation(std::make_error_code(std::errc::value_too_large), total);
+                    return;
+                }
+
+                limit -= chunk_size;
+
+                //Chunk extensions (after ';') are ignored.
+                if(chunk_size) {
+                    state = body_state::chunk_data;
+                    remaining = chunk_size;
+                } else {
+                    state = body_state::chunk_trailer;
+                    //Trailer fields are header fields, also when the body itself is not bounded.
+                    limit = std::min(limit, http_message_parser::max_head_size);
+                }
+            }
+            break;
+            case body_state::chunk_data_end:
+                if(!is_empty_line(line)) {
+                    //Missing CRLF after chunk data
+                    completation(std::make_error_code(std::errc::bad_message), total);
+                    return;
+                }
+
+                state = body_state::chunk_size_line;
+            break;
+            case body_state::chunk_trailer:
+                //Trailer fields are ignored.
+                if(is_empty_line(line)) {
+                    buffer.consume(line_end + 1);
+                    completation(error_code(), total);
+                    return;
+                }
+
+                if(line_end + 1 > limit) {
+                    completation(std::make_error_code(std::errc::value_too_large), total);
+                    return;
+                }
+
+                limit -= line_end + 1;
+            break;
+            default:
+            break;
+        }
+
+        buffer.consume(line_end + 1);
+    }
+
+    socket.async_read_some(buffer, [&socket, &buffer, state, remaining, total, limit, on_chunk, completation](error_code ec, size_t) {
+        if(ec) {
+            completation(ec, total);
+            return;
+        }
+
+        async_read_streamed_body(socket, buffer, state, remaining, total, limit, on_chunk, completation);
+    });
+}
+
+template<typename Socket>
+static void read_body(Socket& socket, asio::streambuf& buffer, std::string& body, const http_headers& headers, std::function<void(std::string_view)> on_chunk, std::function<void(error_code, size_t)> completation)
+{
+    std::string_view transfer_encoding = headers.get(known_header::transfer_encoding);
+
+    if (transfer_encoding.size()) {
+        //Any other coding would leave the message boundary unknown.
+        if (!case_insensitive_equals(transfer_encoding, "chunked")) {
+            completation(std::make_error_code(std::errc::bad_message), 0);
+            return;
+        }
+
+        //Only a stored body is bounded, a chunk callback does not keep what it gets.
+        size_t limit = SIZE_MAX;
+
+        if(!on_chunk) {
+            limit = max_body_size();
+
+            body.clear();
+            on_chunk = [&body](std::string_view chunk) {
+                body.append(chunk);
+            };
+        }
+
+        async_read_streamed_body(socket, buffer, body_state::chunk_size_line, 0, 0, limit, on_chunk, completation);
+    }
+    else {
+        std::string_view content_lenght = headers.get(known_header::content_length);
+
+        if (content_lenght.empty()) {
+            completation(error_code(), 0);
+        } else {
+            size_t body_size = 0;
+
+            auto result = std::from_chars(content_lenght.data(), content_lenght.data() + content_lenght.size(), body_size);
+
+            if(result.ec != std::errc() || result.ptr != content_lenght.data() + content_lenght.size()) {
+                completation(std::make_error_code(std::errc::bad_message), 0);
+                return;
+            }
+
+            if(on_chunk) {
+                async_read_streamed_body(socket, buffer, body_state::fixed_length, body_size, 0, SIZE_MAX, on_chunk, completation);
+                return;
+            }
+
+            //Refused before allocating it.
+            if(body_size > max_body_size()) {
+                completation(std::make_error_code(std::errc::value_too_large), 0);
+                return;
+            }
+
+            body.resize(body_size);
+
+            //The buffer may also contain the next pipelined message.
+            size_t available_size = std::min(buffer.data().size(), body_size);
+            size_t remaining_size = body_size - available_size;
+
+            if(available_size) {
+                std::istream stream(&buffer);
+                stream.read(body.data(), available_size);
+            }
+
+            if(remaining_size) {
+                socket.async_read_exactly(asio::buffer(body.data()+available_size, remaining_size), remaining_size, completation);
+            } else {
+                completation(error_code(), body_size);
+            }
+        }
+    }
+}
+
+/// @brief Reads the body described by headers.
+/// @param on_chunk If set, the body is delivered to it piece by piece and body is left untouched. Otherwise the body is stored in body.
+template<typename Socket>
+void async_read_body(Socket& socket, asio::streambuf& buffer, std::string& body, const http_headers& headers, std::function<void(std::string_view)> on_chunk, std::function<void(error_code, size_t)> completation)
+{
+    //Completing before returning, from a body already in buffer, is posted instead. Same as async_read_http_head.
+    auto initiating = std::make_shared<std::atomic<bool>>(true);
+
+    completation = [&socket, initiating, completation = std::move(completation)](error_code ec, size_t size) {
+        if(*initiating) {
+            asio::post(socket.get_executor(), [completation, ec, size]() {
+                completation(ec, size);
+            });
+        } else {
+            completation(ec, size);
+        }
+    };
+
+    read_body(socket, buffer, body, headers, std::move(on_chunk), completation);
+
+    *initiating = false;
+}
+
+struct chunked_body_writer
+{
+    body_generator generator;
+    std::string chunk;
+    char size_line[sizeof(size_t) * 2 + 2];
+};
+
+template<typename Socket>
+static void async_write_chunked_body(Socket& socket, std::shared_ptr<chunked_body_writer> writer, std::function<void(error_code&)> completation)
+{
+    //An empty chunk would end the body, so they are skipped.
+    bool more = false;
+
+    try {
+        do {
+            writer->chunk.clear();
+            more = writer->generator(writer->chunk);
+        } while(more && writer->chunk.empty());
+    } catch(std::exception e)
+    {
+        //The head is already gone, so the body is cut by closing the connection without the last chunk.
+        log_error("Exception caught while generating body: {}", e.what());
+
+        socket.close();
+
+        error_code ec = asio::error::operation_aborted;
+        completation(ec);
+
+        return;
+    }
+
+    if(!more) {
+        static const std::string_view last_chunk = "0\r\n\r\n";
+
+        socket.async_write(last_chunk, [writer, completation](error_code& ec) {
+            completation(ec);
+        });
+
+        return;
+    }
+
+    uva::networking::async_write_chunk(socket, writer->chunk, writer->size_line, [&socket, writer, completation](error_code& ec) {
+        if(ec) {
+            completation(ec);
+            return;
+        }
+
+        async_write_chunked_body(socket, writer, completation);
+    });
+}
+
+template<typename Socket>
+void uva::networking::async_write_chunk(Socket& socket, std::string_view chunk, char* size_line, std::function<void(error_code&)> completation)
+{
+    static const std::string_view crlf = "\r\n";
+
+    char* size_line_end = std::to_chars(size_line, size_line + sizeof(size_t) * 2, chunk.size(), 16).ptr;
+    *size_line_end++ = '\r';
+    *size_line_end++ = '\n';
+
+    std::vector<asio::const_buffer> buffers = {
+        asio::buffer(size_line, size_line_end - size_line),
+        asio::buffer(chunk.data(), chunk.size()),
+        asio::buffer(crlf.data(), crlf.size()),
+    };
+
+    socket.async_write(buffers, completation);
+}
+
+template<typename Socket>
+void uva::networking::async_write_chunked_body(Socket& socket, body_generator generator, std::function<void(error_code&)> completation)
+{
+    auto writer = std::make_shared<chunked_body_writer>();
+    writer->generator = std::move(generator);
+
+    ::async_write_chunked_body(socket, writer, completation);
+}
+
+template<typename Socket>
+void uva::networking::async_read_http_request(Socket& socket, http_message& request, asio::streambuf& buffer, http_message_parser& parser, std::function<void()> completation, std::function<void(error_code&)> on_error)
+{
+    async_read_http_head(socket, buffer, parser, [&socket, &buffer, &request, &parser, completation, on_error](){
+        size_t head_size = parser.head_size();
+
+        try {
+            std::string_view target = parser.start_line(1);
+
+            request.method  = parser.start_line(0);
+            request.version = parser.start_line(2);
+
+            size_t query_index = target.find('?');
+
+            request.url = target.substr(0, query_index);
+
+            if(query_index != std::string_view::npos && query_index + 1 < target.size()) {
+                request.params = query_to_params(target.substr(query_index + 1));
+            } else {
+                request.params = empty_map;
+            }
+
+            std::string endpoint = socket.remote_endpoint_string();
+            request.endpoint = endpoint;
+
+            static std::string version_start = "HTTP/";
+
+            if (!request.version.starts_with(version_start)) {
+                fail_bad_message(on_error);
+                return;
+            }
+
+            parsed_headers(parser, request.headers);
+
+            //The views into buffer are no longer used.
+            buffer.consume(head_size);
+            parser.reset();
+        } catch(std::exception e)
+        {
+            //Invalid escapes in the query.
+            fail_bad_message(on_error);
+            return;
+        }
+
+        async_read_body(socket, buffer, request.raw_body, request.headers, nullptr, [&request, completation, on_error](error_code ec, size_t) {
+            if(ec) {
+                if(on_error) {
+                    on_error(ec);
+                }
+                return;
+            }
+
+            if(request.method == "POST") {
+
+                std::string_view content_type = request.headers.get(known_header::content_type);
+                if(content_type.starts_with("application/json")) {
+                    try {
+                        request.params = json::decode(request.raw_body);
+                    } catch(std::exception e)
+                    {
+                        fail_bad_message(on_error);
+                        return;
+                    }
+                }
+            }
+
+            completation();
+        });
+        
+    }, on_error);
+}
+
+template<typename Socket>
+void uva::networking::async_write_http_request(Socket& socket, http_message& request, std::function<void()> on_success, std::function<void(error_code&)> on_error)
+{
+    //Kept alive until the write completes.
+    auto head = std::make_shared<std::string>();
+    std::string& buffer = *head;
+    buffer.reserve(512+(50*request.params.size())+(50*request.headers.size()));
+
+    buffer += request.method;
+    buffer.push_back(' ');
+
+    if(!request.url.starts_with('/')) {
+        buffer += "/";
+    }
+
+    buffer += request.url;
+
+    if (!request.params.empty()) {
+        buffer.push_back('?');
+
+#if __UVA_DEBUG_LEVEL__ > 0
+        if(request.params.type != var::var_type::map)
+        {
+            throw std::runtime_error(std::format("error: request params invalid type '{}'", request.params.type));
+        }
+#endif
+        for (const auto& param : request.params.as<var::var_type::map>())
+        {
+            param.first.append_to(buffer);
+            buffer.push_back('=');
+            param.second.append_to(buffer);
+            buffer.push_back('&');
+        }
+
+        buffer.pop_back();
+    }
+    
+    buffer += " HTTP/1.1\r\n";
+
+    buffer += "Host: ";
+    buffer += request.host;
+    buffer += "\r\n";
+    buffer += "User-Agent: uva::networking/";
+    buffer += version;
+    buffer += "\r\n";
+    buffer += "Accept: */*\r\n";
+    buffer += "Content-Type: ";
+    buffer += content_type_to_string(request.type);
+    buffer += "\r\n";
+    buffer += "Connection: keep-alive\r\n";
+
+    for(size_t i = 0; i < request.headers.size(); ++i)
+    {
+        buffer += request.headers.name(i);
+        buffer += ": ";
+        buffer += request.headers.value(i);
+        buffer += "\r\n";
+    }
+
+    if(request.body_stream) {
+        buffer += "Transfer-Encoding: chunked\r\n\r\n";
+    } else if(request.raw_body.size()) {
+        buffer += "Content-Length: ";
+        buffer += std::to_string(request.raw_body.size());
+        buffer += "\r\n\r\n";
+    } else {
+        buffer += "\r\n";
+    }
+
+#if __UVA_DEBUG_LEVEL__ >= 2
+    log(buffer);
+#endif
+
+    socket.async_write(buffer, [head, on_success, on_error, &request, &socket](error_code& ec) {
+        if(ec) {
+            if(on_error) {
+                on_error(ec);
+            }
+        } else {
+            if(request.body_stream) {
+                async_write_chunked_body(socket, request.body_stream, [on_success, on_error](error_code& ec) {
+                    if(ec) {
+                        if(on_error) {
+                            on_error(ec);
+                        }
+                    } else {
+                        on_success();
+                    };
+                });
+            } else if(request.raw_body.size()) {
+                socket.async_write(request.raw_body, [on_success, on_error](error_code& ec) {
+                    if(ec) {
+                        if(on_error) {
+                            on_error(ec);
+                        }
+                    } else {
+                        on_success();
+                    };
+                });
+            }
+            else {
+                on_success();
+            };
+        }
+    });
+}
+
+template<typename Socket>
+void uva::networking::async_read_http_response(Socket& socket, http_message& response, asio::streambuf& buffer, http_message_parser& parser, std::function<void()> completation, std::function<void(std::string_view)> on_body_chunk, std::function<void(error_code&)> on_error)
+{
+    async_read_http_head(socket, buffer, parser, [&buffer, &response, &socket, &parser, completation, on_body_chunk, on_error]() {
+        size_t head_size = parser.head_size();
+
+        std::string_view version = parser.start_line(0);
+
+        static std::string_view version_start = "HTTP/";
+
+        if(!version.starts_with(version_start)) {
+            fail_bad_message(on_error);
+            return;
+        }
+
+        response.version = version.substr(version_start.size());
+
+        std::string_view status = parser.start_line(1);
+        int status_number = 0;
+
+        if(std::from_chars(status.data(), status.data() + status.size(), status_number).ec != std::errc()) {
+            fail_bad_message(on_error);
+            return;
+        }
+
+        response.status = (status_code)status_number;
+        response.status_msg = parser.start_line(2);
+        parsed_headers(parser, response.headers);
+        response.params = {};
+
+        buffer.consume(head_size);
+        parser.reset();
+
+        std::string_view content_type = response.headers.get(known_header::content_type);
+
+        if(content_type.size()) {
+            try {
+                response.type = content_type_from_string(std::string(content_type));
+            } catch(std::exception e)
+            {
+                //Not one of content_type, the header still has it.
+            }
+        }
+
+        response.raw_body.clear();
+
+        async_read_body(socket, buffer, response.raw_body, response.headers, on_body_chunk, [&response, completation, on_body_chunk, on_error](uva::networking::error_code ec, size_t){
+            if(ec) {
+                if(on_error) {
+                    on_error(ec);
+                }
+                return;
+            }
+
+            std::string_view content_type = response.headers.get(known_header::content_type);
+
+            if(!on_body_chunk && content_type.starts_with("application/json")) {
+                try {
+                    response.params = uva::json::decode(response.raw_body);
+                } catch(std::exception e)
+                {
+                    fail_bad_message(on_error);
+                    return;
+                }
+            }
+
+            if(completation) {
+                completation();
+            }
+        });
+    }, on_error);
+}
+
+static const std::string& status_line(const status_code& status)
+{
+    static constexpr size_t max_status_code = 600;
+
+    //"HTTP/1.1 200 OK\r\n" for each status in s_status_codes, indexed by its number.
+    static const std::vector<std::string> lines = []() {
+        std::vector<std::string> lines(max_status_code);
+
+        for(const auto& status : s_status_codes) {
+            lines[(size_t)status.first] = std::format("HTTP/1.1 {} {}\r\n", (size_t)status.first, status.second);
+        }
+
+        return lines;
+    }();
+
+    size_t index = (size_t)status;
+
+    if(index >= lines.size() || lines[index].empty()) {
+        throw std::runtime_error(std::format("error: {} is not a valid status_code code.", index));
+    }
+
+    return lines[index];
+}
+
+static const std::string& content_type_line(const content_type& type)
+{
+    //"Content-Type: text/html\r\n" for each type in s_content_types, indexed by its value.
+    static const std::vector<std::string> lines = []() {
+        std::vector<std::string> lines(s_content_types.size());
+
+        for(const auto& type : s_content_types) {
+            if((size_t)type.first >= lines.size()) {
+                lines.resize((size_t)type.first + 1);
+            }
+
+            lines[(size_t)type.first] = std::format("Content-Type: {}\r\n", type.second);
+        }
+
+        return lines;
+    }();
+
+    size_t index = (size_t)type;
+
+    if(index >= lines.size() || lines[index].empty()) {
+        throw std::runtime_error(std::format("error: {} is not a valid content_type code.", index));
+    }
+
+    return lines[index];
+}
+
+static const std::string& server_line()
+{
+    static const std::string line = std::format("Server: uva::networking/{}\r\n", s_server_version);
+    return line;
+}
+
+//The Date header has a resolution of one second, so it is formatted once per second per thread.
+static const std::string& date_line()
+{
+    struct date_cache
+    {
+        time_t time = 0;
+        std::string line;
+    };
+
+    thread_local date_cache cache;
+
+    time_t now = time(nullptr);
+
+    if(now != cache.time || cache.line.empty()) {
+        cache.time = now;
+        cache.line = "Date: " + time_to_standard_string(now) + "\r\n";
+    }
+
+    return cache.line;
+}
+
+static bool status_has_body(const status_code& status)
+{
+    return status != status_code::no_content && status != status_code::not_modified;
+}
+
+static std::string_view response_body(const http_message& response)
+{
+    if(!status_has_body(response.status)) {
+        return std::string_view();
+    }
+
+    if(response.static_body.data()) {
+        return response.static_body;
+    }
+
+    if(response.shared_body) {
+        return *response.shared_body;
+    }
+
+    return response.raw_body;
+}
+
+/// @param content_length The size of the body, or nullptr for chunked Transfer-Encoding.
+static void append_http_response_head(std::string& out, const status_code& status, const content_type& type, const http_headers* headers, const size_t* content_length)
+{
+    out += status_line(status);
+    out += server_line();
+    out += date_line();
+    out += content_type_line(type);
+
+    if(headers) {
+        for(size_t i = 0; i < headers->size(); ++i) {
+            std::string_view name = headers->name(i);
+
+            //Framing headers are written from the body.
+            if(case_insensitive_equals(name, known_header_to_string(known_header::content_length))
+            || case_insensitive_equals(name, known_header_to_string(known_header::transfer_encoding))
+            || case_insensitive_equals(name, known_header_to_string(known_header::content_type))) {
+                continue;
+            }
+
+            out += name;
+            out += ": ";
+            out += headers->value(i);
+            out += "\r\n";
+        }
+    }
+
+    if(!status_has_body(status)) {
+        //No framing at all.
+    } else if(content_length) {
+        char length[24];
+        char* length_end = std::to_chars(length, length + sizeof(length), *content_length).ptr;
+
+        out += "Content-Length: ";
+        out.append(length, length_end);
+        out += "\r\n";
+    } else {
+        out += "Transfer-Encoding: chunked\r\n";
+    }
+
+    out += "\r\n";
+}
+
+void uva::networking::append_http_response_head(std::string& out, const http_message& response)
+{
+    if(response.body_stream) {
+        ::append_http_response_head(out, response.status, response.type, &response.headers, nullptr);
+    } else {
+        size_t content_length = response.file_body.empty() ? response_body(response).size() : response.file_body_size;
+        ::append_http_response_head(out, response.status, response.type, &response.headers, &content_length);
+    }
+}
+
+//The largest TLS record payload. TLS streams hand each buffer of a gather write to its own SSL_write, so each one
+//becomes at least one record. Bodies which fit in a record with their head are copied after it instead.
+static constexpr size_t s_max_tls_record_size = 16 * 1024;
+
+//Whether body is copied after its head, in out, rather than written as a buffer of its own.
+template<typename Socket>
+static bool copy_body_after_head(Socket& socket, size_t head_size, size_t body_size)
+{
+    return body_size && socket.needs_handshake() && head_size + body_size <= s_max_tls_record_size;
+}
+
+//Head and body go out in a single gather write. On TLS sockets, a small body is copied after the head, so the response is a single record.
+template<typename Socket>
+static void async_write_http_response_with_head(Socket& socket, std::shared_ptr<std::string> head, std::string_view body, std::function<void(error_code&)> completation)
+{
+    if(copy_body_after_head(socket, head->size(), body.size())) {
+        head->append(body);
+        body = std::string_view();
+    }
+
+    std::vector<asio::const_buffer> buffers;
+    buffers.reserve(2);
+    buffers.push_back(asio::buffer(*head));
+
+    if(body.size()) {
+        buffers.push_back(asio::buffer(body.data(), body.size()));
+    }
+
+    socket.async_write(buffers, [head, completation](error_code& ec) {
+        completation(ec);
+    });
+}
+
+template<typename Socket>
+void uva::networking::async_write_http_response(Socket& socket, const std::string &body, const status_code &status, const content_type &content_type, std::function<void (uva::networking::error_code &)> completation)
+{
+    size_t content_length = body.size();
+
+    //Kept alive until the write completes.
+    auto head = std::make_shared<std::string>();
+    head->reserve(256);
+
+    ::append_http_response_head(*head, status, content_type, nullptr, &content_length);
+
+    async_write_http_response_with_head(socket, head, status_has_body(status) ? std::string_view(body) : std::string_view(), completation);
+}
+
+template<typename Socket>
+size_t uva::networking::async_write_http_responses(Socket& socket, const std::vector<const http_message*>& responses, size_t max_batch_size, std::function<void(error_code&, size_t)> completation)
+{
+    struct head_span
+    {
+        size_t offset;
+        /* including the body, when it was copied after the head */
+        size_t size;
+        bool body_copied;
+    };
+
+    //All heads share one string, so they are kept as offsets until it stops growing.
+    auto heads = std::make_shared<std::string>();
+    heads->reserve(256 * responses.size());
+
+    std::vector<head_span> head_spans;
+    head_spans.reserve(responses.size());
+
+    size_t batch_size = 0;
+
+    for(const http_message* response : responses) {
+        if(response->body_stream || !response->file_body.empty()) {
+            throw std::runtime_error("error: streamed and file responses cannot be written in a batch");
+        }
+
+        size_t head_offset = heads->size();
+        append_http_response_head(*heads, *response);
+
+        size_t head_size = heads->size() - head_offset;
+        size_t body_size = response_body(*response).size();
+
+        //The first response always goes, no matter its size.
+        if(head_spans.size() && batch_size + head_size + body_size > max_batch_size) {
+            heads->resize(head_offset);
+            break;
+        }
+
+        bool body_copied = copy_body_after_head(socket, head_size, body_size);
+
+        if(body_copied) {
+            heads->append(response_body(*response));
+        }
+
+        head_spans.push_back({ head_offset, heads->size() - head_offset, body_copied });
+        batch_size += head_size + body_size;
+    }
+
+    size_t count = head_spans.size();
+
+    std::vector<asio::const_buffer> buffers;
+    buffers.reserve(count * 2);
+
+    //Adjacent spans of heads are contiguous, they are merged into one buffer up to the next body not copied.
+    size_t merged_offset = 0;
+    size_t merged_size = 0;
+
+    for(size_t i = 0; i < count; ++i) {
+        merged_size += head_spans[i].size;
+
+        std::string_view body = head_spans[i].body_copied ? std::string_view() : response_body(*responses[i]);
+
+        if(body.size()) {
+            buffers.push_back(asio::buffer(heads->data() + merged_offset, merged_size));
+            buffers.push_back(asio::buffer(body.data(), body.size()));
+
+            merged_offset += merged_size;
+            merged_size = 0;
+        }
+    }
+
+    if(merged_size) {
+        buffers.push_back(asio::buffer(heads->data() + merged_offset, merged_size));
+    }
+
+    socket.async_write(buffers, [heads, count, completation](error_code& ec) {
+        completation(ec, count);
+    });
+
+    return count;
+}
+
+template<typename Socket>
+void uva::networking::async_write_http_response(Socket& socket, const http_message& response, std::function<void(error_code&)> completation)
+{
+    auto head = std::make_shared<std::string>();
+    head->reserve(256 + response.headers.size() * 64);
+
+    append_http_response_head(*head, response);
+
+    if(!status_has_body(response.status)) {
+        async_write_http_response_with_head(socket, head, std::string_view(), completation);
+        return;
+    }
+
+    if(!response.file_body.empty()) {
+        socket.async_write(*head, [head, &socket, &response, completation](uva::networking::error_code& ec) {
+            if(ec) {
+                completation(ec);
+                return;
+            }
+
+            socket.async_send_file(response.file_body, response.file_body_size, completation);
+        });
+
+        return;
+    }
+
+    if(!response.body_stream) {
+        async_write_http_response_with_head(socket, head, response_body(response), completation);
+        return;
+    }
+
+    //The head goes out before the first chunk is generated.
+    socket.async_write(*head, [head, &socket, &response, completation](uva::networking::error_code& ec) {
+        if(ec) {
+            completation(ec);
+            return;
+        }
+
+        async_write_chunked_body(socket, response.body_stream, completation);
+    });
+}
+
+void uva::networking::decode_char_from_web(std::string_view& sv, std::string &buffer)
+{
+    if(sv.starts_with('%')) {
+        sv.remove_prefix(1);
+
+        if(sv.size() <= 1) {
+            if(!isdigit(sv.front())) {
+                throw std::runtime_error("invalid character following hex scape sequence");
+            }
+
+            buffer.push_back(uva::binary::nibble_from_hex_string(sv.front()));
+            sv.remove_prefix(1);
+        } else if(sv.size() >= 2) {
+            if(isdigit(sv[0])) {
+                if(isdigit(sv[1])) {
+                    buffer.push_back(uva::binary::byte_from_hex_string(sv.data()));
+                    sv.remove_prefix(2);
+                } else {
+                    buffer.push_back(uva::binary::nibble_from_hex_string(sv.front()));
+                    sv.remove_prefix(1);
                 }
+            } else
+            {
+                throw std::runtime_error("invalid character following hex scape sequence");
+            }
+
+        }
+    } else {
+        buffer.push_back(sv.front());
+        sv.remove_prefix(1);
+    }
+}
+
+std::map<var, var> uva::networking::query_to_params(std::string_view query)
+{
+    std::map<var, var> params;
+
+    std::string current_param_key;
+    std::string current_param_value;
+
+    while(query.size()) {
+
+        while(query.size())
+        {
+            if(query.starts_with('=')) {
+                query.remove_prefix(1);
+                break;
+            }
+
+            decode_char_from_web(query, current_param_key);
+        }
+
+        while(query.size())
+        {
+            if(query.starts_with('&')) {
+                query.remove_prefix(1);
+                break;
+            }
+
+            decode_char_from_web(query, current_param_value);
+        }
+
+        params.insert({std::move(current_param_key), std::move(current_param_value)});
+
+        current_param_key.clear();
+        current_param_key.reserve(20);
+
+        current_param_value.clear();
+        current_param_value.reserve(20);
+    }
+
+    return params;
+}
+
+static error_code ssl_error_code(int error)
+{
+    switch(error)
+    {
+        case SSL_ERROR_ZERO_RETURN:
+            return asio::error::eof;
+        case SSL_ERROR_SYSCALL:
+            if(errno) {
+                return error_code(errno, asio::error::get_system_category());
+            }
+            return asio::error::eof;
+        default:
+            return error_code((int)ERR_get_error(), asio::error::get_ssl_category());
+    }
+}
+
+uva::networking::ktls_stream::ktls_stream(asio::ip::tcp::socket&& __socket, asio::ssl::context& __context)
+    : m_socket(std::move(__socket)), m_ssl(SSL_new(__context.native_handle()))
+{
+    if(!m_ssl) {
+        throw std::runtime_error("error: failed to create SSL object");
+    }
+
+    //OpenSSL reads and writes the descriptor itself, asio only waits for readiness.
+    m_socket.native_non_blocking(true);
+
+    SSL_set_fd(m_ssl, (int)m_socket.native_handle());
+    SSL_set_mode(m_ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    SSL_set_options(m_ssl, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+}
+
+uva::networking::ktls_stream::~ktls_stream()
+{
+    SSL_free(m_ssl);
+}
+
+bool uva::networking::ktls_stream::ktls_send() const
+{
+#ifdef UVA_NETWORKING_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+#else
+    return false;
+#endif
+}
+
+bool uva::networking::ktls_stream::ktls_receive() const
+{
+#ifdef UVA_NETWORKING_KTLS
+    return BIO_get_ktls_recv(SSL_get_rbio(m_ssl));
+#else
+    return false;
+#endif
+}
+
+void uva::networking::ktls_stream::async_ssl_operation(std::function<int(size_t&)> operation, std::function<void(error_code, size_t)> completation)
+{
+    size_t transferred = 0;
+
+    ERR_clear_error();
+    int result = operation(transferred);
+
+    if(result > 0) {
+        asio::post(m_socket.get_executor(), [completation, transferred]() {
+            completation(error_code(), transferred);
+        });
+
+        return;
+    }
+
+    int error = SSL_get_error(m_ssl, result);
+
+    if(error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        auto wait_type = error == SSL_ERROR_WANT_READ ? asio::ip::tcp::socket::wait_read : asio::ip::tcp::socket::wait_write;
+
+        m_socket.async_wait(wait_type, [this, operation, completation](error_code ec) {
+            if(ec) {
+                completation(ec, 0);
+                return;
+            }
+
+            async_ssl_operation(operation, completation);
+        });
+
+        return;
+    }
+
+    error_code ec = ssl_error_code(error);
+
+    asio::post(m_socket.get_executor(), [completation, ec]() {
+        completation(ec, 0);
+    });
+}
+
+void uva::networking::ktls_stream::handshake(asio::ssl::stream_base::handshake_type type, error_code& ec)
+{
+    if(type == asio::ssl::stream_base::server) {
+        SSL_set_accept_state(m_ssl);
+    } else {
+        SSL_set_connect_state(m_ssl);
+    }
+
+    while(true) {
+        ERR_clear_error();
+        int result = SSL_do_handshake(m_ssl);
+
+        if(result > 0) {
+            ec = error_code();
+            return;
+        }
+
+        int error = SSL_get_error(m_ssl, result);
+
+        if(error == SSL_ERROR_WANT_READ) {
+            m_socket.wait(asio::ip::tcp::socket::wait_read, ec);
+        } else if(error == SSL_ERROR_WANT_WRITE) {
+            m_socket.wait(asio::ip::tcp::socket::wait_write, ec);
+        } else {
+            ec = ssl_error_code(error);
+        }
+
+        if(ec) {
+            return;
+        }
+    }
+}
+
+void uva::networking::ktls_stream::async_handshake(asio::ssl::stream_base::handshake_type type, std::function<void(error_code)> completation)
+{
+    if(type == asio::ssl::stream_base::server) {
+        SSL_set_accept_state(m_ssl);
+    } else {
+        SSL_set_connect_state(m_ssl);
+    }
+
+    async_ssl_operation([this](size_t&) {
+        return SSL_do_handshake(m_ssl);
+    }, [completation](error_code ec, size_t) {
+        completation(ec);
+    });
+}
+
+size_t uva::networking::ktls_stream::ssl_read(asio::mutable_buffer buffer, error_code& ec)
+{
+    while(true) {
+        size_t read = 0;
+
+        ERR_clear_error();
+        int result = SSL_read_ex(m_ssl, buffer.data(), buffer.size(), &read);
+
+        if(result > 0) {
+            ec = error_code();
+            return read;
+        }
+
+        int error = SSL_get_error(m_ssl, result);
+
+        if(error == SSL_ERROR_WANT_READ) {
+            m_socket.wait(asio::ip::tcp::socket::wait_read, ec);
+        } else if(error == SSL_ERROR_WANT_WRITE) {
+            m_socket.wait(asio::ip::tcp::socket::wait_write, ec);
+        } else {
+            ec = ssl_error_code(error);
+        }
+
+        if(ec) {
+            return 0;
+        }
+    }
+}
+
+size_t uva::networking::ktls_stream::ssl_write(asio::const_buffer buffer, error_code& ec)
+{
+    while(true) {
+        size_t written = 0;
+
+        ERR_clear_error();
+        int result = SSL_write_ex(m_ssl, buffer.data(), buffer.size(), &written);
+
+        if(result > 0) {
+            ec = error_code();
+            return written;
+        }
+
+        int error = SSL_get_error(m_ssl, result);
+
+        if(error == SSL_ERROR_WANT_READ) {
+            m_socket.wait(asio::ip::tcp::socket::wait_read, ec);
+        } else if(error == SSL_ERROR_WANT_WRITE) {
+            m_socket.wait(asio::ip::tcp::socket::wait_write, ec);
+        } else {
+            ec = ssl_error_code(error);
+        }
+
+        if(ec) {
+            return 0;
+        }
+    }
+}
+
+void uva::networking::ktls_stream::async_ssl_read(asio::mutable_buffer buffer, std::function<void(error_code, size_t)> completation)
+{
+    async_ssl_operation([this, buffer](size_t& read) {
+        return SSL_read_ex(m_ssl, buffer.data(), buffer.size(), &read);
+    }, completation);
+}
+
+void uva::networking::ktls_stream::async_ssl_write(asio::const_buffer buffer, std::function<void(error_code, size_t)> completation)
+{
+    async_ssl_operation([this, buffer](size_t& written) {
+        return SSL_write_ex(m_ssl, buffer.data(), buffer.size(), &written);
+    }, completation);
+}
+
+void uva::networking::ktls_stream::async_sendfile(int fd, uint64_t offset, size_t size, std::function<void(error_code&)> completation)
+{
+#ifdef UVA_NETWORKING_KTLS
+    static constexpr size_t max_sendfile_size = 1 << 30;
+
+    if(!size) {
+        error_code ec;
+        completation(ec);
+        return;
+    }
+
+    size_t to_send = std::min(size, max_sendfile_size);
+
+    async_ssl_operation([this, fd, offset, to_send](size_t& sent) {
+        ossl_ssize_t result = SSL_sendfile(m_ssl, fd, (off_t)offset, to_send, 0);
+
+        if(result > 0) {
+            sent = (size_t)result;
+            return 1;
+        }
+
+        return (int)result;
+    }, [this, fd, offset, size, completation](error_code ec, size_t sent) {
+        if(!ec && !sent) {
+            //The file is smaller than announced.
+            ec = asio::error::eof;
+        }
+
+        if(ec) {
+            completation(ec);
+            return;
+        }
+
+        async_sendfile(fd, offset + sent, size - sent, completation);
+    });
+#else
+    error_code ec = asio::error::operation_not_supported;
+    completation(ec);
+#endif
+}
+
+// Stream sockets
+
+template<typename Stream>
+static Stream make_stream(asio::ip::tcp::socket&& socket, asio::ssl::context* context)
+{
+    if constexpr(std::is_same_v<Stream, asio::ip::tcp::socket>) {
+        return std::move(socket);
+    } else {
+        return Stream(std::move(socket), *context);
+    }
+}
+
+template<typename Stream>
+uva::networking::basic_stream_socket<Stream>::basic_stream_socket(asio::ip::tcp::socket&& __socket)
+    : m_stream(make_stream<Stream>(std::move(__socket), ssl_context.get()))
+{
+
+}
+
+template<typename Stream>
+uva::networking::basic_stream_socket<Stream>::basic_stream_socket(asio::ip::tcp::socket&& __socket, asio::ssl::context& __context)
+    : m_stream(make_stream<Stream>(std::move(__socket), &__context))
+{
+
+}
+
+//Connections are closed without a TLS shutdown, and OpenSSL removes the session of a server connection freed so from the session cache.
+//Abrupt closes do not forbid resumption since TLS 1.1 (RFC 5246, 7.2.1), so the connection is marked as shut down and clients resuming
+//by session id, like when tickets are disabled, still can.
+static void keep_server_session(SSL* ssl)
+{
+    if(ssl && SSL_is_server(ssl) && SSL_is_init_finished(ssl)) {
+        SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+}
+
+template<typename Stream>
+uva::networking::basic_stream_socket<Stream>::~basic_stream_socket()
+{
+    if constexpr(is_secure) {
+        keep_server_session(m_stream.native_handle());
+    }
+
+    if(m_stream.lowest_layer().is_open()) {
+        error_code ec;
+        m_stream.lowest_layer().close(ec);
+    }
+}
+
+template<typename Stream>
+bool uva::networking::basic_stream_socket<Stream>::is_open() const
+{
+    return m_stream.lowest_layer().is_open();
+}
+
+template<typename Stream>
+size_t uva::networking::basic_stream_socket<Stream>::available() const
+{
+    return m_stream.lowest_layer().available();
+}
+
+template<typename Stream>
+size_t uva::networking::basic_stream_socket<Stream>::available(error_code& ec) const
+{
+    return m_stream.lowest_layer().available(ec);
+}
+
+template<typename Stream>
+std::string uva::networking::basic_stream_socket<Stream>::remote_endpoint_string() const
+{
+    error_code ec;
+    asio::ip::tcp::endpoint endpoint = m_stream.lowest_layer().remote_endpoint(ec);
+
+    if(ec) {
+        return "[Invalid Address]";
+    }
+
+    return endpoint.address().to_string();
+}
+
+template<typename Stream>
+error_code uva::networking::basic_stream_socket<Stream>::server_handshake()
+{
+    error_code ec;
+
+    if constexpr(is_secure) {
+        m_stream.handshake(asio::ssl::stream_base::server, ec);
+
+        if(!ec) {
+            count_tls_handshake(m_stream.native_handle());
+        }
+    }
+
+    return ec;
+}
+
+template<typename Stream>
+error_code uva::networking::basic_stream_socket<Stream>::client_handshake()
+{
+    error_code ec;
+
+    if constexpr(is_secure) {
+        m_stream.handshake(asio::ssl::stream_base::client, ec);
+
+        if(!ec) {
+            count_tls_handshake(m_stream.native_handle());
+        }
+    }
+
+    return ec;
+}
+
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_client_handshake(std::function<void(error_code)> completation)
+{
+    if constexpr(is_secure) {
+        m_stream.async_handshake(asio::ssl::stream_base::client, [this, completation](error_code ec) {
+            if(!ec) {
+                count_tls_handshake(m_stream.native_handle());
             }
 
-            completation();
+            completation(ec);
         });
-        
-    });
+    } else {
+        completation(error_code());
+    }
 }
 
-void uva::networking::async_write_http_request(basic_socket& socket, http_message& request, std::function<void()> on_success, std::function<void(error_code&)> on_error)
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_server_handshake(std::function<void(error_code)> completation)
 {
-    std::string buffer;
-    buffer.reserve(512+request.raw_body.size()+(50*request.params.size())+(50*request.headers.size()));
-
-    buffer += request.method;
-    buffer.push_back(' ');
+    if constexpr(is_secure) {
+        m_stream.async_handshake(asio::ssl::stream_base::server, [this, completation](error_code ec) {
+            if(!ec) {
+                count_tls_handshake(m_stream.native_handle());
+            }
 
-    if(!request.url.starts_with('/')) {
-        buffer += "/";
+            completation(ec);
+        });
+    } else {
+        completation(error_code());
     }
+}
 
-    buffer += request.url;
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_server_handshake(asio::io_context& context, std::function<void(error_code)> completation)
+{
+    if constexpr(std::is_same_v<Stream, asio::ssl::stream<asio::ip::tcp::socket>>) {
+        //The stream cannot be rebound. Its intermediate handlers run on the executor of the completion handler instead,
+        //so every SSL_do_handshake call runs on context while the descriptor stays registered where it is.
+        asio::post(context, [this, &context, completation]() {
+            m_stream.async_handshake(asio::ssl::stream_base::server, asio::bind_executor(context, [this, completation](error_code ec) {
+                if(!ec) {
+                    count_tls_handshake(m_stream.native_handle());
+                }
 
-    if (!request.params.empty()) {
-        buffer.push_back('?');
+                completation(ec);
+            }));
+        });
+    } else if constexpr(std::is_same_v<Stream, ktls_stream>) {
+        asio::io_context& home = static_cast<asio::io_context&>(asio::query(lowest_layer().get_executor(), asio::execution::context));
+        error_code ec = rebind(context);
 
-#if __UVA_DEBUG_LEVEL__ > 0
-        if(request.params.type != var::var_type::map)
-        {
-            throw std::runtime_error(std::format("error: request params invalid type '{}'", request.params.type));
-        }
-#endif
-        for (const auto& param : request.params.as<var::var_type::map>())
-        {
-            param.first.append_to(buffer);
-            buffer.push_back('=');
-            param.second.append_to(buffer);
-            buffer.push_back('&');
+        if(ec) {
+            completation(ec);
+            return;
         }
 
-        buffer.pop_back();
+        asio::post(context, [this, &home, completation]() {
+            async_server_handshake([this, &home, completation](error_code ec) {
+                //Nothing is pending on the socket, it goes back to where it is served.
+                error_code rebind_ec = rebind(home);
+                completation(ec ? ec : rebind_ec);
+            });
+        });
+    } else {
+        completation(error_code());
     }
-    
-    buffer += " HTTP/1.1\r\n";
+}
 
-    buffer += "Host: ";
-    buffer += request.host;
-    buffer += "\r\n";
-    buffer += "User-Agent: uva::networking/";
-    buffer += version;
-    buffer += "\r\n";
-    buffer += "Accept: */*\r\n";
-    buffer += "Content-Type: ";
-    buffer += content_type_to_string(request.type);
-    buffer += "\r\n";
-    buffer += "Connection: keep-alive\r\n";
+//The descriptor is taken from the reactor of its io_context and registered in the one of context.
+static error_code rebind_socket(asio::ip::tcp::socket& socket, asio::io_context& context)
+{
+    error_code ec;
+    asio::ip::tcp::endpoint endpoint = socket.local_endpoint(ec);
 
-    for(const auto& header : request.headers.as<var::var_type::map>())
-    {
-        header.first.append_to(buffer);
-        buffer += ": ";
-        header.second.append_to(buffer);
-        buffer += "\r\n";
+    if(ec) {
+        return ec;
     }
 
-    if(request.raw_body.size()) {
-        buffer += "Content-Length: ";
-        buffer += std::to_string(request.raw_body.size());
-        buffer += "\r\n\r\n";
-    } else {
-        buffer += "\r\n";
+    bool non_blocking = socket.native_non_blocking();
+    asio::ip::tcp::socket::native_handle_type handle = socket.release(ec);
+
+    if(ec) {
+        return ec;
     }
 
-#if __UVA_DEBUG_LEVEL__ >= 2
-    log(buffer);
+    socket = asio::ip::tcp::socket(context);
+    socket.assign(endpoint.protocol(), handle, ec);
+
+    if(ec) {
+#ifdef __linux__
+        ::close(handle);
 #endif
+        return ec;
+    }
 
-    socket.async_write(buffer, [on_success, on_error, &request, &socket](error_code& ec) {
-        if(ec) {
-            if(on_error) {
-                on_error(ec);
-            }
-        } else {
-            if(request.raw_body.size()) {
-                socket.async_write(request.raw_body, [on_success, on_error](error_code& ec) {
-                    if(ec) {
-                        if(on_error) {
-                            on_error(ec);
-                        }
-                    } else {
-                        on_success();
-                    };
-                });
-            }
-            else {
-                on_success();
-            };
-        }
-    });
+    if(non_blocking) {
+        socket.native_non_blocking(true, ec);
+    }
+
+    return ec;
 }
 
-void uva::networking::async_read_http_response(basic_socket& socket, http_message& response, asio::streambuf& buffer, std::function<void()> completation)
+template<typename Stream>
+error_code uva::networking::basic_stream_socket<Stream>::rebind(asio::io_context& context)
 {
-    socket.async_read_until(buffer, "\r\n\r\n", [&buffer, &response, &socket, completation](uva::networking::error_code ec, size_t s) {
-        if(!ec) {
-            std::istream request_stream(&buffer);
-
-            request_stream >> response.version;
+    if constexpr(std::is_same_v<Stream, asio::ip::tcp::socket>) {
+        return rebind_socket(m_stream, context);
+    } else if constexpr(std::is_same_v<Stream, ktls_stream>) {
+        //The SSL object reads and writes the descriptor itself, it does not see the move.
+        return rebind_socket(m_stream.next_layer(), context);
+    } else {
+        //asio::ssl::stream keeps timers made on the io_context of its socket.
+        return asio::error::operation_not_supported;
+    }
+}
 
-            char version_start[] = "HTTP/";
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::close()
+{
+    m_stream.lowest_layer().close();
+}
 
-            if(!response.version.starts_with(version_start)) {
-                throw std::runtime_error("invalid response: invalid http response (1)");
-            }
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_read_until(asio::streambuf& buffer, std::string_view delimiter, std::function<void(error_code, size_t)> completation)
+{
+    asio::async_read_until(m_stream, buffer, delimiter, completation);
+}
 
-            response.version = response.version.substr(sizeof(version_start)-1);
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_read_some(asio::streambuf& buffer, std::function<void(error_code, size_t)> completation)
+{
+    static constexpr size_t read_size = 4096;
 
-            int status;
+    m_stream.async_read_some(buffer.prepare(read_size), [&buffer, completation](error_code ec, size_t read) {
+        buffer.commit(read);
+        completation(ec, read);
+    });
+}
 
-            request_stream >> status;
-            std::getline(request_stream, response.status_msg);
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::write(std::string_view sv)
+{
+    asio::write(m_stream, asio::buffer(sv, sv.size()));
+}
 
-            if(response.status_msg.ends_with('\r')) {
-                response.status_msg.pop_back();
-            }
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_write(std::string_view sv, std::function<void(error_code&)> completation)
+{
+    asio::async_write(m_stream, asio::buffer(sv, sv.size()), [completation](error_code ec, size_t bytes_written) {
+        completation(ec);
+    });
+}
 
-            response.status = (status_code)status;
-            response.headers = parse_headers(request_stream);
-            response.params = {};
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_write(const std::vector<asio::const_buffer>& buffers, std::function<void(error_code&)> completation)
+{
+    asio::async_write(m_stream, buffers, [completation](error_code ec, size_t bytes_written) {
+        completation(ec);
+    });
+}
 
-            response.type = content_type_from_string(response.headers.fetch("Content-Type"));
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::read_exactly(char* buffer, size_t to_read)
+{
+    size_t read = asio::read(m_stream, asio::buffer(buffer, to_read), asio::transfer_exactly(to_read));
 
-            async_read_body(socket, buffer, s, response.raw_body, response.headers, [&response, completation](uva::networking::error_code ec, size_t){
-                var content_type = response.headers.fetch("Content-Type");
+    if (read != to_read) {
+        throw std::runtime_error("expecting to read exactly " + std::to_string(to_read) + " bytes but " + std::to_string(read) + " were read instead.");
+    }
+}
 
-                if(content_type == "application/json") {
-                    response.params = uva::json::decode(response.raw_body);
-                }
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::read_exactly(std::string& buffer, size_t to_read)
+{
+    size_t read = asio::read(m_stream, asio::buffer(buffer), asio::transfer_exactly(to_read));
 
-                if(completation) {
-                    completation();
-                }
-            });
-        }
-    });
+    if (read != to_read) {
+        throw std::runtime_error("expecting to read exactly " + std::to_string(to_read) + " bytes but " + std::to_string(read) + " were read instead.");
+    }
 }
 
-void uva::networking::async_write_http_response(basic_socket &socket, const std::string &body, const status_code &status, const content_type &content_type, std::function<void (uva::networking::error_code &)> completation)
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_read_exactly(asio::mutable_buffer buffer, size_t to_read, std::function<void(error_code, size_t)> completation)
 {
-    std::string status_code_string = std::to_string((size_t)status);
-    std::string status_string = status_code_to_string(status);
-    std::string date_string = time_now_to_standard_string();
-    std::string content_type_string = content_type_to_string(content_type);
-    std::string body_length_string = std::to_string(body.size());
+    asio::async_read(m_stream, asio::buffer(buffer), asio::transfer_exactly(to_read), completation);
+}
 
-    const char* const header_format =
-"HTTP/1.1 {} {}\r\n"
-"Server: uva::networking/{}\r\n"
-"Date: {}\r\n"
-"Content-Type: {}\r\n"
-"Content-Length: {}\r\n"
-"\r\n";
+template<typename Stream>
+uint8_t uva::networking::basic_stream_socket<Stream>::read_byte()
+{
+	uint8_t byte;
+	const size_t to_read = sizeof(byte);
 
-    std::string header = std::format(header_format, status_code_string, status_string, s_server_version, date_string, content_type_string, body_length_string);
+    size_t read = asio::read(m_stream, asio::buffer(&byte, to_read), asio::transfer_exactly(to_read));
 
-    size_t bytes_written = 0;
+    if (read != to_read) {
+        throw std::runtime_error("expecting to read exactly " + std::to_string(to_read) + " bytes but " + std::to_string(read) + " were read instead.");
+    }
 
-    socket.async_write(header, [&body, &socket, completation](uva::networking::error_code ec) {
-        socket.async_write(body, [completation](uva::networking::error_code ec) {
-            completation(ec);
-        });
-    });
+    return byte;
 }
 
-void uva::networking::decode_char_from_web(std::string_view& sv, std::string &buffer)
+struct file_sender
 {
-    if(sv.starts_with('%')) {
-        sv.remove_prefix(1);
+    size_t remaining = 0;
+    //Used when sendfile is not available.
+    std::ifstream file;
+    std::vector<char> buffer;
+#ifdef __linux__
+    int fd = -1;
+    off_t offset = 0;
+
+    ~file_sender()
+    {
+        if(fd >= 0) {
+            ::close(fd);
+        }
+    }
+#endif
+};
 
-        if(sv.size() <= 1) {
-            if(!isdigit(sv.front())) {
-                throw std::runtime_error("invalid character following hex scape sequence");
-            }
+#ifdef __linux__
+//The kernel copies from the page cache straight into the socket. The socket is in non-blocking mode,
+//so when its buffer is full we wait for it to be writable again.
+static void async_sendfile(asio::ip::tcp::socket& socket, std::shared_ptr<file_sender> sender, std::function<void(error_code&)> completation)
+{
+    static constexpr size_t max_sendfile_size = 1 << 30;
 
-            buffer.push_back(uva::binary::nibble_from_hex_string(sv.front()));
-            sv.remove_prefix(1);
-        } else if(sv.size() >= 2) {
-            if(isdigit(sv[0])) {
-                if(isdigit(sv[1])) {
-                    buffer.push_back(uva::binary::byte_from_hex_string(sv.data()));
-                    sv.remove_prefix(2);
-                } else {
-                    buffer.push_back(uva::binary::nibble_from_hex_string(sv.front()));
-                    sv.remove_prefix(1);
+    while(sender->remaining) {
+        ssize_t sent = ::sendfile(socket.native_handle(), sender->fd, &sender->offset, std::min(sender->remaining, max_sendfile_size));
+
+        if(sent > 0) {
+            sender->remaining -= (size_t)sent;
+            continue;
+        }
+
+        if(sent == 0) {
+            //The file is smaller than announced.
+            error_code ec = asio::error::eof;
+            completation(ec);
+            return;
+        }
+
+        if(errno == EINTR) {
+            continue;
+        }
+
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            socket.async_wait(asio::ip::tcp::socket::wait_write, [&socket, sender, completation](error_code ec) {
+                if(ec) {
+                    completation(ec);
+                    return;
                 }
-            } else
-            {
-                throw std::runtime_error("invalid character following hex scape sequence");
-            }
 
+                async_sendfile(socket, sender, completation);
+            });
+
+            return;
         }
-    } else {
-        buffer.push_back(sv.front());
-        sv.remove_prefix(1);
+
+        error_code ec(errno, asio::error::get_system_category());
+        completation(ec);
+
+        return;
     }
+
+    error_code ec;
+    completation(ec);
 }
+#endif
 
-std::map<var, var> uva::networking::query_to_params(std::string_view query)
+//Only one chunk of the file is in memory at a time.
+template<typename Socket>
+static void async_send_file_chunks(Socket& socket, std::shared_ptr<file_sender> sender, std::function<void(error_code&)> completation)
 {
-    std::map<var, var> params;
+    if(!sender->remaining) {
+        error_code ec;
+        completation(ec);
+        return;
+    }
 
-    std::string current_param_key;
-    std::string current_param_value;
+    size_t to_read = std::min(sender->buffer.size(), sender->remaining);
 
-    while(query.size()) {
+    sender->file.read(sender->buffer.data(), to_read);
+    size_t read = (size_t)sender->file.gcount();
 
-        while(query.size())
-        {
-            if(query.starts_with('=')) {
-                query.remove_prefix(1);
-                break;
-            }
+    if(!read) {
+        error_code ec = asio::error::eof;
+        completation(ec);
+        return;
+    }
 
-            decode_char_from_web(query, current_param_key);
+    sender->remaining -= read;
+
+    socket.async_write(std::string_view(sender->buffer.data(), read), [&socket, sender, completation](error_code& ec) {
+        if(ec) {
+            completation(ec);
+            return;
         }
 
-        while(query.size())
-        {
-            if(query.starts_with('&')) {
-                query.remove_prefix(1);
-                break;
-            }
+        async_send_file_chunks(socket, sender, completation);
+    });
+}
 
-            decode_char_from_web(query, current_param_value);
+
+template<typename Stream>
+void uva::networking::basic_stream_socket<Stream>::async_send_file(const std::filesystem::path& path, size_t size, std::function<void(error_code&)> completation)
+{
+    static constexpr size_t chunk_size = 64 * 1024;
+
+    auto sender = std::make_shared<file_sender>();
+    sender->remaining = size;
+
+#ifdef __linux__
+    if constexpr(!is_secure) {
+        sender->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if(sender->fd < 0) {
+            error_code ec(errno, asio::error::get_system_category());
+            completation(ec);
+            return;
         }
 
-        params.insert({std::move(current_param_key), std::move(current_param_value)});
+        error_code ec;
+        m_stream.native_non_blocking(true, ec);
 
-        current_param_key.clear();
-        current_param_key.reserve(20);
+        if(ec) {
+            completation(ec);
+            return;
+        }
 
-        current_param_value.clear();
-        current_param_value.reserve(20);
+        async_sendfile(m_stream, sender, completation);
+        return;
+    } else if constexpr(std::is_same_v<Stream, ktls_stream>) {
+        if(m_stream.ktls_send()) {
+            sender->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if(sender->fd < 0) {
+                error_code ec(errno, asio::error::get_system_category());
+                completation(ec);
+                return;
+            }
+
+            //The kernel encrypts the records, so the file does not go through userspace either.
+            m_stream.async_sendfile(sender->fd, 0, size, [sender, completation](error_code& ec) {
+                completation(ec);
+            });
+
+            return;
+        }
     }
+#endif
 
-    return params;
+    sender->file.open(path, std::ios::binary);
+
+    if(!sender->file.is_open()) {
+        error_code ec = asio::error::not_found;
+        completation(ec);
+        return;
+    }
+
+    sender->buffer.resize(std::min(chunk_size, size));
+
+    async_send_file_chunks(*this, sender, completation);
 }
 
+template class uva::networking::basic_stream_socket<asio::ip::tcp::socket>;
+template class uva::networking::basic_stream_socket<asio::ssl::stream<asio::ip::tcp::socket>>;
+template class uva::networking::basic_stream_socket<ktls_stream>;
+
+// Type erased socket
+
 uva::networking::basic_socket::basic_socket(asio::ip::tcp::socket &&__socket, const protocol &__protocol)
     : m_protocol(__protocol)
 {
     switch(m_protocol)
     {
         case protocol::http:
-            m_socket = std::make_unique<asio::ip::tcp::socket>(std::forward<asio::ip::tcp::socket&&>(__socket));
+            m_socket = std::make_unique<http_socket>(std::move(__socket));
         break;
         case protocol::https:
-            m_ssl_socket = std::make_unique<asio::ssl::stream<asio::ip::tcp::socket>>(std::forward<asio::ip::tcp::socket&&>(__socket), *ssl_context);
+            if(s_ktls_enabled) {
+                m_socket = std::make_unique<ktls_socket>(std::move(__socket));
+            } else {
+                m_socket = std::make_unique<https_socket>(std::move(__socket));
+            }
         break;
     }
 }
 
-uva::networking::basic_socket::basic_socket(basic_socket &&__socket)
-    : m_ssl_socket(std::move(__socket.m_ssl_socket)), m_socket(std::move(__socket.m_socket)), m_protocol(__socket.m_protocol)
+uva::networking::basic_socket::operator bool()
 {
+    return std::visit([](auto& socket) {
+        return socket ? true : false;
+    }, m_socket);
+}
 
+bool uva::networking::basic_socket::is_open() const
+{
+    return std::visit([](auto& socket) {
+        return socket && socket->is_open();
+    }, m_socket);
 }
 
-uva::networking::basic_socket::operator bool()
+bool uva::networking::basic_socket::needs_handshake() const
 {
-    switch(m_protocol)
-    {
-        case protocol::http:
-            return m_socket ? true : false;
-        break;
-        case protocol::https:
-            return m_ssl_socket ? true : false;
-        break;
-    }
+    return m_protocol == protocol::https;
 }
 
-uva::networking::basic_socket::~basic_socket()
+size_t uva::networking::basic_socket::available() const
 {
-    switch(m_protocol)
-    {
-        case protocol::http:
-            if(m_socket) {
-                if(m_socket->is_open()) {
-                    m_socket->close();
-                }
-            }
-        break;
-        case protocol::https:
-            if(m_ssl_socket) {
-                if(m_ssl_socket->lowest_layer().is_open()) {
-                    m_ssl_socket->lowest_layer().close();
-                }
-            }
-        break;
-    }
+    return with_socket([](auto& socket) {
+        return socket.available();
+    });
 }
 
-bool uva::networking::basic_socket::is_open() const
+size_t uva::networking::basic_socket::available(error_code& ec) const
 {
-    if(!m_ssl_socket && !m_socket) return false;
+    return with_socket([&ec](auto& socket) {
+        return socket.available(ec);
+    });
+}
 
-    if(m_protocol == protocol::https) {
-        return m_ssl_socket->lowest_layer().is_open();
-    } else {
-        return m_socket->is_open();
+bool uva::networking::basic_socket::is_reusable() const
+{
+    if(!is_open()) {
+        return false;
     }
+
+    return with_socket([](auto& socket) {
+        asio::ip::tcp::socket* tcp_socket = nullptr;
+
+        if constexpr(std::is_same_v<typename std::decay_t<decltype(socket)>::stream_type, asio::ip::tcp::socket>) {
+            tcp_socket = &socket.stream();
+        } else {
+            //Bytes OpenSSL already read and decrypted are no longer in the socket, the peek would not see them.
+            if(SSL_pending(socket.stream().native_handle()) > 0) {
+                return false;
+            }
+
+            //Below TLS, encrypted bytes count the same.
+            tcp_socket = &socket.stream().next_layer();
+        }
+
+        error_code ec;
+        bool non_blocking = tcp_socket->non_blocking();
+
+        tcp_socket->non_blocking(true, ec);
+
+        if(ec) {
+            return false;
+        }
+
+        //Reads nothing from the socket. Zero bytes is the peer closing, any byte is a response nobody asked for (or a TLS alert).
+        char byte;
+        tcp_socket->receive(asio::buffer(&byte, 1), asio::socket_base::message_peek, ec);
+
+        error_code restore_ec;
+        tcp_socket->non_blocking(non_blocking, restore_ec);
+
+        return ec == asio::error::would_block;
+    });
 }
 
-bool uva::networking::basic_socket::needs_handshake() const
+asio::ip::tcp::socket::executor_type uva::networking::basic_socket::get_executor() const
 {
-    if(!m_ssl_socket && !m_socket) {
-        //throw error
-    }
+    return with_socket([](auto& socket) {
+        return socket.lowest_layer().get_executor();
+    });
+}
 
-    return m_protocol == protocol::https;
+std::string uva::networking::basic_socket::remote_endpoint_string() const
+{
+    return with_socket([](auto& socket) {
+        return socket.remote_endpoint_string();
+    });
 }
 
-size_t uva::networking::basic_socket::available() const
+void uva::networking::basic_socket::set_connected_socket(asio::ip::tcp::socket&& __socket)
 {
+    //Client connections do not use kTLS, their transfers are small.
     if(m_protocol == protocol::https) {
-        return m_ssl_socket->lowest_layer().available();
+        m_socket = std::make_unique<https_socket>(std::move(__socket), *client_ssl_context);
     } else {
-        return m_socket->available();
+        m_socket = std::make_unique<http_socket>(std::move(__socket));
     }
 }
 
-size_t uva::networking::basic_socket::available(error_code& ec) const
+//RFC 8305 section 4, the address families alternate, IPv6 first.
+static std::vector<asio::ip::tcp::endpoint> happy_eyeballs_order(const asio::ip::tcp::resolver::results_type& results)
 {
-    if(m_protocol == protocol::https) {
-        return m_ssl_socket->lowest_layer().available(ec);
-    } else {
-        return m_socket->available(ec);
+    std::vector<asio::ip::tcp::endpoint> v6;
+    std::vector<asio::ip::tcp::endpoint> v4;
+
+    for(const auto& entry : results) {
+        (entry.endpoint().address().is_v6() ? v6 : v4).push_back(entry.endpoint());
+    }
+
+    std::vector<asio::ip::tcp::endpoint> endpoints;
+    endpoints.reserve(v6.size() + v4.size());
+
+    for(size_t i = 0; i < std::max(v6.size(), v4.size()); ++i) {
+        if(i < v6.size()) {
+            endpoints.push_back(v6[i]);
+        }
+
+        if(i < v4.size()) {
+            endpoints.push_back(v4[i]);
+        }
     }
+
+    return endpoints;
 }
 
-std::string uva::networking::basic_socket::remote_endpoint_string() const
+//RFC 8305 section 5 recommends 250ms between connection attempts.
+static constexpr std::chrono::milliseconds s_connection_attempt_delay = std::chrono::milliseconds(250);
+
+//The attempts of a single connect. Everything runs on context, nothing is locked.
+struct connect_race
 {
-    error_code ec;
-    asio::ip::tcp::endpoint endpoint;
+    connect_race(asio::io_context& __context)
+        : context(__context), timer(__context)
+    {
+    }
 
-    if(m_protocol == protocol::https) {
-        endpoint = m_ssl_socket->lowest_layer().remote_endpoint(ec);
-    } else {
-        endpoint = m_socket->remote_endpoint(ec);
+    asio::io_context& context;
+    asio::steady_timer timer;
+    std::vector<asio::ip::tcp::endpoint> endpoints;
+    /* one per started attempt, in the order of endpoints */
+    std::vector<std::unique_ptr<asio::ip::tcp::socket>> sockets;
+    size_t pending = 0;
+    bool done = false;
+    error_code last_error = asio::error::host_not_found;
+    std::function<void(error_code, asio::ip::tcp::socket&&)> completation;
+};
+
+static void start_connect_attempt(std::shared_ptr<connect_race> race)
+{
+    if(race->done) {
+        return;
     }
 
-    if(ec) {
-        return "[Invalid Address]";
+    if(race->sockets.size() == race->endpoints.size()) {
+        if(!race->pending) {
+            race->done = true;
+            race->timer.cancel();
+
+            asio::ip::tcp::socket none(race->context);
+            race->completation(race->last_error, std::move(none));
+        }
+
+        return;
     }
 
-    return endpoint.address().to_string();
+    const asio::ip::tcp::endpoint& endpoint = race->endpoints[race->sockets.size()];
+
+    race->sockets.push_back(std::make_unique<asio::ip::tcp::socket>(race->context));
+    asio::ip::tcp::socket* socket = race->sockets.back().get();
+
+    ++race->pending;
+
+    socket->async_connect(endpoint, [race, socket](error_code ec) {
+        --race->pending;
+
+        if(race->done) {
+            return;
+        }
+
+        if(ec) {
+            race->last_error = ec;
+
+            //The next one starts now, without waiting for the delay.
+            start_connect_attempt(race);
+            return;
+        }
+
+        race->done = true;
+        race->timer.cancel();
+
+        for(std::unique_ptr<asio::ip::tcp::socket>& other : race->sockets) {
+            if(other.get() != socket) {
+                error_code close_ec;
+                other->close(close_ec);
+            }
+        }
+
+        race->completation(error_code(), std::move(*socket));
+    });
+
+    //The attempts in flight keep going, the next one is started beside them.
+    race->timer.expires_after(s_connection_attempt_delay);
+    race->timer.async_wait([race](error_code ec) {
+        if(ec) {
+            return;
+        }
+
+        start_connect_attempt(race);
+    });
+}
+
+void uva::networking::async_connect_race(asio::io_context& context, std::vector<asio::ip::tcp::endpoint> endpoints, std::function<void(error_code, asio::ip::tcp::socket&&)> completation)
+{
+    auto race = std::make_shared<connect_race>(context);
+    race->endpoints = std::move(endpoints);
+    race->completation = std::move(completation);
+
+    //Started on context, the attempts and the timer are never touched from two threads.
+    asio::post(context, [race]() {
+        start_connect_attempt(race);
+    });
 }
 
 error_code uva::networking::basic_socket::connect(const std::string &protocol, const std::string &host)
@@ -714,27 +3081,47 @@ error_code uva::networking::basic_socket::connect(const std::string &protocol, c
     asio::error_code ec;
 
     m_protocol = protocol == "https" ? protocol::https : protocol::http;
-    asio::ip::basic_resolver_results<asio::ip::tcp> results = resolver->resolve(asio::ip::tcp::resolver::query(__host, port), ec);
+    m_socket = std::unique_ptr<http_socket>();
+    m_host = host;
 
-    if(ec) {
-        return ec;
+    asio::io_context& context = next_io_context();
+
+    std::string key = resolve_cache_key(__host, port);
+    asio::ip::tcp::resolver::results_type results;
+
+    if(!find_resolved(key, results)) {
+        asio::ip::tcp::resolver resolver(context);
+        results = resolver.resolve(asio::ip::tcp::resolver::query(__host, port), ec);
+
+        if(ec) {
+            return ec;
+        }
+
+        store_resolved(key, results);
     }
-    else if(m_protocol == protocol::https) {
-        m_ssl_socket = std::make_unique<asio::ssl::stream<asio::ip::tcp::socket>>(*io_context, *ssl_context);
-        m_ssl_socket->lowest_layer().connect(*results, ec);
 
-        m_socket.reset();
-    } else {
-        m_socket = std::make_unique<asio::ip::tcp::socket>(*io_context);
-        m_socket->connect(*results, ec);
+    //Blocking, so the addresses are tried one after the other, in the same order as connect_async races them.
+    asio::ip::tcp::socket socket(context);
+    ec = asio::error::host_not_found;
+
+    for(const asio::ip::tcp::endpoint& endpoint : happy_eyeballs_order(results)) {
+        error_code close_ec;
+        socket.close(close_ec);
 
-        m_ssl_socket.reset();
+        socket.connect(endpoint, ec);
+
+        if(!ec) {
+            break;
+        }
     }
 
     if(ec) {
-        close();
+        forget_resolved(key);
+        return ec;
     }
 
+    set_connected_socket(std::move(socket));
+
     return ec;
 }
 
@@ -752,57 +3139,57 @@ void uva::networking::basic_socket::connect_async(const std::string &protocol, c
         __host.pop_back();
     }
 
-    asio::error_code ec;
-
     m_protocol = protocol == "https" ? protocol::https : protocol::http;
-    resolver->async_resolve(asio::ip::tcp::resolver::query(__host, port), [completation, this](error_code ec, asio::ip::tcp::resolver::iterator iterator){
+    m_socket = std::unique_ptr<http_socket>();
+    m_host = host;
+
+    asio::io_context& context = next_io_context();
+
+    uva::networking::async_resolve(context, __host, port, [completation, this, &context, key = resolve_cache_key(__host, port)](error_code ec, asio::ip::tcp::resolver::results_type results){
 
         if(ec) {
             completation(ec);
             return;
         }
 
-        auto connect_completation = [completation, this](error_code ec) {
+        uva::networking::async_connect_race(context, happy_eyeballs_order(results), [completation, this, key](error_code ec, asio::ip::tcp::socket&& socket) {
             if(ec) {
-                close();
+                forget_resolved(key);
+            } else {
+                set_connected_socket(std::move(socket));
             }
 
             completation(ec);
-        };
-
-        if (m_protocol == protocol::https) {
-            m_socket.reset();
-            m_ssl_socket = std::make_unique<asio::ssl::stream<asio::ip::tcp::socket>>(*io_context, *ssl_context);
-            m_ssl_socket->lowest_layer().async_connect(*iterator, connect_completation);
-        } else {
-            m_ssl_socket.reset();
-            m_socket = std::make_unique<asio::ip::tcp::socket>(*io_context);
-            m_socket->async_connect(*iterator, connect_completation);
-        }
+        });
     });
 }
 
 error_code uva::networking::basic_socket::server_handshake()
 {
-    error_code ec;
+    return with_socket([](auto& socket) {
+        return socket.server_handshake();
+    });
+}
 
-    if(m_protocol == protocol::https) {
-        m_ssl_socket->handshake(asio::ssl::stream_base::server, ec);
-    } else {
-        //throw excpetion
-    }
+void uva::networking::basic_socket::resume_tls_session()
+{
+    std::unique_ptr<https_socket>* socket = std::get_if<std::unique_ptr<https_socket>>(&m_socket);
 
-    return ec;
+    if(socket && *socket) {
+        uva::networking::resume_tls_session((*socket)->stream().native_handle(), m_host);
+    }
 }
 
 error_code uva::networking::basic_socket::client_handshake()
 {
-    error_code ec;
+    resume_tls_session();
 
-    if(m_protocol == protocol::https) {
-        m_ssl_socket->handshake(asio::ssl::stream_base::client, ec);
-    } else {
-        //throw excpetion
+    error_code ec = with_socket([](auto& socket) {
+        return socket.client_handshake();
+    });
+
+    if(ec) {
+        forget_tls_session(m_host);
     }
 
     return ec;
@@ -810,34 +3197,34 @@ error_code uva::networking::basic_socket::client_handshake()
 
 void uva::networking::basic_socket::async_client_handshake(std::function<void(error_code)> completation)
 {
-    if(m_protocol == protocol::https) {
-        m_ssl_socket->async_handshake(asio::ssl::stream_base::client, completation);
-    } else {
-        //throw excpetion
-    }
+    resume_tls_session();
+
+    with_socket([&](auto& socket) {
+        socket.async_client_handshake([this, completation](error_code ec) {
+            //A session the server rejects is not offered again.
+            if(ec) {
+                forget_tls_session(m_host);
+            }
+
+            completation(ec);
+        });
+    });
 }
 
 void uva::networking::basic_socket::async_server_handshake(std::function<void(error_code)> completation)
 {
-    if(m_protocol == protocol::https) {
-        m_ssl_socket->async_handshake(asio::ssl::stream_base::server, completation);
-    } else {
-        //throw excpetion
-    }
+    with_socket([&](auto& socket) {
+        socket.async_server_handshake(completation);
+    });
 }
 
 void uva::networking::basic_socket::close()
 {
-    if(!m_ssl_socket && !m_socket) {
-        //throw error
-        return;
-    }
-
-    if(m_protocol == protocol::https) {
-        m_ssl_socket->lowest_layer().close();
-    } else {
-        m_socket->close();
-    }  
+    std::visit([](auto& socket) {
+        if(socket) {
+            socket->close();
+        }
+    }, m_socket);
 }
 
 void uva::networking::basic_socket::read_until(std::string &buffer, std::string_view delimiter)
@@ -846,119 +3233,91 @@ void uva::networking::basic_socket::read_until(std::string &buffer, std::string_
 
 void uva::networking::basic_socket::async_read_until(asio::streambuf &buffer, std::string_view delimiter, std::function<void(error_code, size_t)> completation)
 {
-    switch(m_protocol)
-    {
-        case protocol::https:
-            asio::async_read_until(*m_ssl_socket, buffer, delimiter, completation);
-        break;
-            asio::async_read_until(*m_socket, buffer, delimiter, completation);
-        break;
-    }
+    with_socket([&](auto& socket) {
+        socket.async_read_until(buffer, delimiter, completation);
+    });
+}
+
+void uva::networking::basic_socket::async_read_some(asio::streambuf& buffer, std::function<void(error_code, size_t)> completation)
+{
+    with_socket([&](auto& socket) {
+        socket.async_read_some(buffer, completation);
+    });
 }
 
 void uva::networking::basic_socket::write(std::string_view sv)
-{   
-    if(m_protocol == protocol::https) {
-        if(!m_ssl_socket) {
-            throw std::runtime_error("error: attempt to write on a null socket");
-        }
-        asio::write(*m_ssl_socket, asio::buffer(sv, sv.size()));
-    } else {
-        asio::write(*m_socket, asio::buffer(sv, sv.size()));
-    }  
+{
+    if(!is_open()) {
+        throw std::runtime_error("error: attempt to write on a null socket");
+    }
+
+    with_socket([sv](auto& socket) {
+        socket.write(sv);
+    });
 }
 
 void uva::networking::basic_socket::async_write(std::string_view sv, std::function<void(error_code &)> completation)
 {
-    if(m_protocol == protocol::https) {
-        asio::async_write(*m_ssl_socket, asio::buffer(sv, sv.size()), [completation](error_code ec, size_t bytes_written) {
-            completation(ec);
-        });
-    } else {
-        asio::async_write(*m_ssl_socket, asio::buffer(sv, sv.size()), [completation](error_code ec, size_t bytes_written) {
-            completation(ec);
-        });
-    }  
+    with_socket([&](auto& socket) {
+        socket.async_write(sv, completation);
+    });
 }
 
-void uva::networking::basic_socket::read_exactly(char *buffer, size_t to_read)
+void uva::networking::basic_socket::async_write(const std::vector<asio::const_buffer>& buffers, std::function<void(error_code&)> completation)
 {
-    size_t read = 0;
-    switch (m_protocol)
-    {
-    case protocol::http:
-        read = asio::read(*m_socket, asio::buffer(buffer, to_read), asio::transfer_exactly(to_read));
-        break;
-    case protocol::https:
-        read = asio::read(*m_ssl_socket, asio::buffer(buffer, to_read), asio::transfer_exactly(to_read));
-        break;
-    default:
-        break;
-    }
+    with_socket([&](auto& socket) {
+        socket.async_write(buffers, completation);
+    });
+}
 
-    if (read != to_read) {
-        throw std::runtime_error("expecting to read exactly " + std::to_string(to_read) + " bytes but " + std::to_string(read) + " were read instead.");
-    }
+void uva::networking::basic_socket::read_exactly(char *buffer, size_t to_read)
+{
+    with_socket([&](auto& socket) {
+        socket.read_exactly(buffer, to_read);
+    });
 }
 
 void uva::networking::basic_socket::read_exactly(std::string &buffer, size_t to_read)
 {
-    size_t read = 0;
-    switch (m_protocol)
-    {
-    case protocol::http:
-        read = asio::read(*m_socket, asio::buffer(buffer), asio::transfer_exactly(to_read));
-        break;
-    case protocol::https:
-        read = asio::read(*m_ssl_socket, asio::buffer(buffer), asio::transfer_exactly(to_read));
-        break;
-    default:
-        break;
-    }
-
-    if (read != to_read) {
-        throw std::runtime_error("expecting to read exactly " + std::to_string(to_read) + " bytes but " + std::to_string(read) + " were read instead.");
-    }
+    with_socket([&](auto& socket) {
+        socket.read_exactly(buffer, to_read);
+    });
 }
 
 void uva::networking::basic_socket::async_read_exactly(asio::mutable_buffer buffer, size_t to_read, std::function<void(error_code, size_t)> completation)
 {
-    switch (m_protocol)
-    {
-    case protocol::http:
-        asio::async_read(*m_socket, asio::buffer(buffer), asio::transfer_exactly(to_read), completation);
-        break;
-    case protocol::https:
-        asio::async_read(*m_ssl_socket, asio::buffer(buffer), asio::transfer_exactly(to_read), completation);
-        break;
-    default:
-        break;
-    }
+    with_socket([&](auto& socket) {
+        socket.async_read_exactly(buffer, to_read, completation);
+    });
 }
 
 uint8_t uva::networking::basic_socket::read_byte()
 {
-	uint8_t byte;
-	const size_t to_read = sizeof(byte);
-
-	auto buffer = asio::buffer(&byte, to_read);
-
-    size_t read = 0;
-    switch (m_protocol)
-    {
-    case protocol::http:
-        read = asio::read(*m_socket, buffer, asio::transfer_exactly(to_read));
-        break;
-    case protocol::https:
-        read = asio::read(*m_ssl_socket, buffer, asio::transfer_exactly(to_read));
-        break;
-    default:
-        break;
-    }
-
-    if (read != to_read) {
-        throw std::runtime_error("expecting to read exactly " + std::to_string(to_read) + " bytes but " + std::to_string(read) + " were read instead.");
-    }
+    return with_socket([](auto& socket) {
+        return socket.read_byte();
+    });
+}
 
-    return byte;
+void uva::networking::basic_socket::async_send_file(const std::filesystem::path& path, size_t size, std::function<void(error_code&)> completation)
+{
+    with_socket([&](auto& socket) {
+        socket.async_send_file(path, size, completation);
+    });
 }
+
+// The http functions, for each socket they may be called with.
+
+#define UVA_NETWORKING_INSTANTIATE_HTTP_FUNCTIONS(Socket) \
+template void uva::networking::async_read_http_request<Socket>(Socket&, http_message&, asio::streambuf&, http_message_parser&, std::function<void()>, std::function<void(error_code&)>); \
+template void uva::networking::async_write_http_response<Socket>(Socket&, const std::string&, const status_code&, const content_type&, std::function<void(error_code&)>); \
+template void uva::networking::async_write_http_response<Socket>(Socket&, const http_message&, std::function<void(error_code&)>); \
+template size_t uva::networking::async_write_http_responses<Socket>(Socket&, const std::vector<const http_message*>&, size_t, std::function<void(error_code&, size_t)>); \
+template void uva::networking::async_write_chunk<Socket>(Socket&, std::string_view, char*, std::function<void(error_code&)>); \
+template void uva::networking::async_write_chunked_body<Socket>(Socket&, body_generator, std::function<void(error_code&)>); \
+template void uva::networking::async_write_http_request<Socket>(Socket&, http_message&, std::function<void()>, std::function<void(error_code&)>); \
+template void uva::networking::async_read_http_response<Socket>(Socket&, http_message&, asio::streambuf&, http_message_parser&, std::function<void()>, std::function<void(std::string_view)>, std::function<void(error_code&)>); \
+
+UVA_NETWORKING_INSTANTIATE_HTTP_FUNCTIONS(basic_socket)
+UVA_NETWORKING_INSTANTIATE_HTTP_FUNCTIONS(http_socket)
+UVA_NETWORKING_INSTANTIATE_HTTP_FUNCTIONS(https_socket)
+UVA_NETWORKING_INSTANTIATE_HTTP_FUNCTIONS(ktls_socket)
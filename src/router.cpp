@@ -0,0 +1,227 @@
+#include <router.hpp>
+
+#include <stdexcept>
+#include <format>
+
+using namespace uva;
+using namespace networking;
+using namespace web_application;
+
+basic_router& uva::networking::web_application::router()
+{
+    //Function local, routes are added during static initialization by some apps.
+    static basic_router instance;
+    return instance;
+}
+
+basic_router::node* uva::networking::web_application::basic_router::add_static(node* current, std::string_view text)
+{
+    while(text.size()) {
+        std::unique_ptr<node>* next = nullptr;
+
+        for(std::unique_ptr<node>& child : current->children) {
+            if(child->label.front() == text.front()) {
+                next = &child;
+                break;
+            }
+        }
+
+        if(!next) {
+            auto child = std::make_unique<node>();
+            child->label = std::string(text);
+
+            current->children.push_back(std::move(child));
+
+            return current->children.back().get();
+        }
+
+        node* child = next->get();
+
+        size_t common = 0;
+
+        while(common < child->label.size() && common < text.size() && child->label[common] == text[common]) {
+            ++common;
+        }
+
+        //Splits the child, the common prefix becomes its parent.
+        if(common < child->label.size()) {
+            auto prefix = std::make_unique<node>();
+            prefix->label = child->label.substr(0, common);
+
+            child->label.erase(0, common);
+
+            prefix->children.push_back(std::move(*next));
+            *next = std::move(prefix);
+
+            child = next->get();
+        }
+
+        text.remove_prefix(common);
+        current = child;
+    }
+
+    return current;
+}
+
+void uva::networking::web_application::basic_router::add(std::string_view method, std::string_view path, std::string route)
+{
+    method_tree* tree = nullptr;
+
+    for(method_tree& t : m_trees) {
+        if(t.method == method) {
+            tree = &t;
+            break;
+        }
+    }
+
+    if(!tree) {
+        m_trees.emplace_back(method);
+        tree = &m_trees.back();
+    }
+
+    node* current = &tree->root;
+    std::string_view remaining = path;
+    size_t param_count = 0;
+
+    while(remaining.size()) {
+        size_t special = remaining.find_first_of(":*");
+
+        if(special == std::string_view::npos) {
+            current = add_static(current, remaining);
+            break;
+        }
+
+        if(special) {
+            current = add_static(current, remaining.substr(0, special));
+        }
+
+        char kind = remaining[special];
+        remaining.remove_prefix(special + 1);
+
+        size_t name_end = remaining.find('/');
+        std::string_view name = remaining.substr(0, name_end);
+
+        if(name.empty()) {
+            throw std::runtime_error(std::format("error: route '{}' has a parameter without name", path));
+        }
+
+        if(++param_count > route_match::max_params) {
+            throw std::runtime_error(std::format("error: route '{}' has more than {} parameters", path, route_match::max_params));
+        }
+
+        std::unique_ptr<node>& child = kind == ':' ? current->parameter : current->splat;
+
+        if(!child) {
+            child = std::make_unique<node>();
+            child->name = std::string(name);
+        } else if(child->name != name) {
+            throw std::runtime_error(std::format("error: route '{}' names a parameter '{}', other route names it '{}'", path, name, child->name));
+        }
+
+        current = child.get();
+        remaining = name_end == std::string_view::npos ? std::string_view() : remaining.substr(name_end);
+
+        if(kind == '*' && remaining.size()) {
+            throw std::runtime_error(std::format("error: route '{}' has segments after a splat", path));
+        }
+    }
+
+    if(current->route.size() && current->route != route) {
+        throw std::runtime_error(std::format("error: route '{}' conflicts with '{}'", route, current->route));
+    }
+
+    current->route = std::move(route);
+}
+
+bool uva::networking::web_application::basic_router::find(std::string_view method, std::string_view path, route_match& match) const
+{
+    match.route = nullptr;
+    match.param_count = 0;
+
+    for(const method_tree& tree : m_trees) {
+        if(tree.method == method) {
+            return find(&tree.root, path, match);
+        }
+    }
+
+    return false;
+}
+
+bool uva::networking::web_application::basic_router::find(const node* current, std::string_view path, route_match& match) const
+{
+    if(path.empty() && current->route.size()) {
+        match.route = &current->route;
+        return true;
+    }
+
+    if(path.size()) {
+        for(const std::unique_ptr<node>& child : current->children) {
+            if(child->label.front() == path.front()) {
+                if(path.starts_with(child->label) && find(child.get(), path.substr(child->label.size()), match)) {
+                    return true;
+                }
+
+                break;
+            }
+        }
+    }
+
+    if(current->parameter) {
+        size_t end = path.find('/');
+        std::string_view value = path.substr(0, end);
+
+        if(value.size()) {
+            size_t param_count = match.param_count;
+            match.params[match.param_count++] = { current->parameter->name, value };
+
+            if(find(current->parameter.get(), path.substr(value.size()), match)) {
+                return true;
+            }
+
+            match.param_count = param_count;
+        }
+    }
+
+    if(current->splat && current->splat->route.size()) {
+        match.params[match.param_count++] = { current->splat->name, path };
+        match.route = &current->splat->route;
+
+        return true;
+    }
+
+    return false;
+}
+
+size_t uva::networking::web_application::basic_router::size() const
+{
+    size_t count = 0;
+
+    std::vector<const node*> pending;
+
+    for(const method_tree& tree : m_trees) {
+        pending.push_back(&tree.root);
+    }
+
+    while(pending.size()) {
+        const node* current = pending.back();
+        pending.pop_back();
+
+        if(current->route.size()) {
+            ++count;
+        }
+
+        for(const std::unique_ptr<node>& child : current->children) {
+            pending.push_back(child.get());
+        }
+
+        if(current->parameter) {
+            pending.push_back(current->parameter.get());
+        }
+
+        if(current->splat) {
+            pending.push_back(current->splat.get());
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,283 @@
+#include <tls_sessions.hpp>
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    #include <openssl/core_names.h>
+#else
+    #include <openssl/hmac.h>
+#endif
+
+using namespace uva;
+using namespace networking;
+
+struct ticket_key
+{
+    unsigned char name[16];
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+    std::chrono::steady_clock::time_point created;
+};
+
+static std::mutex s_ticket_keys_mutex;
+//The newest first. Only the first one encrypts, the others still decrypt.
+static std::deque<ticket_key> s_ticket_keys;
+static std::chrono::seconds s_ticket_key_rotation = std::chrono::hours(1);
+
+static std::mutex s_client_sessions_mutex;
+static std::unordered_map<std::string, SSL_SESSION*> s_client_sessions;
+static size_t s_client_hosts = 1024;
+//The host of a client connection, freed with it.
+static int s_host_index = -1;
+
+static std::atomic<uint64_t> s_server_full_handshakes = 0;
+static std::atomic<uint64_t> s_server_resumed_handshakes = 0;
+static std::atomic<uint64_t> s_client_full_handshakes = 0;
+static std::atomic<uint64_t> s_client_resumed_handshakes = 0;
+
+static ticket_key make_ticket_key()
+{
+    ticket_key key;
+
+    if(RAND_bytes(key.name, sizeof(key.name)) != 1 || RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1 || RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1) {
+        throw std::runtime_error("error: failed to generate a session ticket key");
+    }
+
+    key.created = std::chrono::steady_clock::now();
+
+    return key;
+}
+
+/* s_ticket_keys_mutex must be locked */
+static void rotate_ticket_keys()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if(s_ticket_keys.empty() || now - s_ticket_keys.front().created >= s_ticket_key_rotation) {
+        s_ticket_keys.push_front(make_ticket_key());
+    }
+
+    //A ticket is decrypted for one rotation after its key stopped encrypting.
+    while(s_ticket_keys.size() > 2) {
+        s_ticket_keys.pop_back();
+    }
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static bool set_ticket_hmac_key(EVP_MAC_CTX* hmac, ticket_key& key)
+{
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof(key.hmac_key)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*)"SHA256", 0),
+        OSSL_PARAM_construct_end(),
+    };
+
+    return EVP_MAC_CTX_set_params(hmac, params) == 1;
+}
+
+static int ticket_key_callback(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* hmac, int encrypt)
+#else
+static bool set_ticket_hmac_key(HMAC_CTX* hmac, ticket_key& key)
+{
+    return HMAC_Init_ex(hmac, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), nullptr) == 1;
+}
+
+static int ticket_key_callback(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, HMAC_CTX* hmac, int encrypt)
+#endif
+{
+    std::scoped_lock lock(s_ticket_keys_mutex);
+
+    rotate_ticket_keys();
+
+    if(encrypt) {
+        ticket_key& key = s_ticket_keys.front();
+
+        if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+            return -1;
+        }
+
+        std::memcpy(name, key.name, sizeof(key.name));
+
+        if(EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) != 1 || !set_ticket_hmac_key(hmac, key)) {
+            return -1;
+        }
+
+        return 1;
+    }
+
+    for(size_t i = 0; i < s_ticket_keys.size(); ++i) {
+        ticket_key& key = s_ticket_keys[i];
+
+        if(std::memcmp(name, key.name, sizeof(key.name)) != 0) {
+            continue;
+        }
+
+        if(EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) != 1 || !set_ticket_hmac_key(hmac, key)) {
+            return -1;
+        }
+
+        //2 resumes and asks for the ticket to be renewed with the current key.
+        return i == 0 ? 1 : 2;
+    }
+
+    //Unknown or expired key, the handshake is a full one.
+    return 0;
+}
+
+static int new_client_session_callback(SSL* ssl, SSL_SESSION* session)
+{
+    const std::string* host = (const std::string*)SSL_get_ex_data(ssl, s_host_index);
+
+    if(!host || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+
+    //OpenSSL marks the session of a connection closed without a shutdown as not resumable, the store keeps its own copy.
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+
+    if(!copy) {
+        return 0;
+    }
+
+    std::scoped_lock lock(s_client_sessions_mutex);
+
+    auto it = s_client_sessions.find(*host);
+
+    if(it != s_client_sessions.end()) {
+        SSL_SESSION_free(it->second);
+        it->second = copy;
+
+        return 0;
+    }
+
+    if(s_client_sessions.size() >= s_client_hosts && s_client_sessions.size()) {
+        SSL_SESSION_free(s_client_sessions.begin()->second);
+        s_client_sessions.erase(s_client_sessions.begin());
+    }
+
+    s_client_sessions.insert({ *host, copy });
+
+    return 0;
+}
+
+static void free_host(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int index, long argl, void* argp)
+{
+    delete (std::string*)ptr;
+}
+
+void uva::networking::configure_tls_sessions(const tls_session_options& options)
+{
+    if(!ssl_context || !client_ssl_context) {
+        throw std::runtime_error("error: configure_tls_sessions called before init");
+    }
+
+    SSL_CTX* server = ssl_context->native_handle();
+    SSL_CTX* client = client_ssl_context->native_handle();
+
+    {
+        std::scoped_lock lock(s_ticket_keys_mutex);
+
+        s_ticket_key_rotation = options.ticket_key_rotation;
+        s_ticket_keys.clear();
+
+        rotate_ticket_keys();
+    }
+
+    static const unsigned char session_id_context[] = "uva-networking";
+
+    SSL_CTX_set_session_id_context(server, session_id_context, sizeof(session_id_context) - 1);
+    SSL_CTX_set_session_cache_mode(server, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(server, (long)options.cache_size);
+    SSL_CTX_set_timeout(server, (long)options.ticket_key_rotation.count());
+
+    if(options.tickets) {
+        SSL_CTX_clear_options(server, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(server, ticket_key_callback);
+#else
+        SSL_CTX_set_tlsext_ticket_key_cb(server, ticket_key_callback);
+#endif
+    } else {
+        SSL_CTX_set_options(server, SSL_OP_NO_TICKET);
+    }
+
+    if(s_host_index < 0) {
+        s_host_index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, free_host);
+    }
+
+    {
+        std::scoped_lock lock(s_client_sessions_mutex);
+        s_client_hosts = options.client_hosts;
+    }
+
+    //Sessions go to new_client_session_callback only, they are looked up by host, not by id.
+    SSL_CTX_set_session_cache_mode(client, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(client, new_client_session_callback);
+}
+
+void uva::networking::resume_tls_session(SSL* ssl, const std::string& host)
+{
+    if(s_host_index < 0) {
+        return;
+    }
+
+    delete (std::string*)SSL_get_ex_data(ssl, s_host_index);
+    SSL_set_ex_data(ssl, s_host_index, new std::string(host));
+
+    std::scoped_lock lock(s_client_sessions_mutex);
+
+    auto it = s_client_sessions.find(host);
+
+    if(it != s_client_sessions.end()) {
+        SSL_SESSION* copy = SSL_SESSION_dup(it->second);
+
+        if(copy) {
+            SSL_set_session(ssl, copy);
+            SSL_SESSION_free(copy);
+        }
+    }
+}
+
+void uva::networking::forget_tls_session(const std::string& host)
+{
+    std::scoped_lock lock(s_client_sessions_mutex);
+
+    auto it = s_client_sessions.find(host);
+
+    if(it != s_client_sessions.end()) {
+        SSL_SESSION_free(it->second);
+        s_client_sessions.erase(it);
+    }
+}
+
+void uva::networking::count_tls_handshake(SSL* ssl)
+{
+    bool resumed = SSL_session_reused(ssl);
+
+    if(SSL_is_server(ssl)) {
+        ++(resumed ? s_server_resumed_handshakes : s_server_full_handshakes);
+    } else {
+        ++(resumed ? s_client_resumed_handshakes : s_client_full_handshakes);
+    }
+}
+
+tls_handshake_stats uva::networking::tls_handshake_counters()
+{
+    tls_handshake_stats stats;
+
+    stats.server_full = s_server_full_handshakes;
+    stats.server_resumed = s_server_resumed_handshakes;
+    stats.client_full = s_client_full_handshakes;
+    stats.client_resumed = s_client_resumed_handshakes;
+
+    return stats;
+}
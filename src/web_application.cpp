@@ -5,12 +5,19 @@
 #include <fstream>
 #include <atomic>
 #include <deque>
+#include <algorithm>
+#include <unordered_map>
 
 #include <asio.hpp>
 #include <asio/ssl.hpp>
 
 #include <networking.hpp>
 #include <web_application.hpp>
+#include <asset_cache.hpp>
+#include <html_template.hpp>
+#include <compression.hpp>
+#include <router.hpp>
+#include <tls_sessions.hpp>
 #include <file.hpp>
 #include <console.hpp>
 
@@ -20,56 +27,170 @@ using namespace networking;
 using namespace routing;
 using namespace web_application;
 
-http_message web_application::current_response;
+thread_local http_message web_application::current_response;
 
 std::string name = "web_application";
 
-class web_connection;
+struct listener
+{
+    networking::protocol protocol;
+    std::string address;
+    size_t port;
+    std::unique_ptr<asio::ip::tcp::acceptor> acceptor;
+};
+std::vector<listener> listeners;
+
+exposed_function_map exposed_functions;
+
+size_t max_write_batch_size = 64 * 1024;
+
+std::unique_ptr<basic_asset_cache> asset_cache;
 
-void proccess_request(std::shared_ptr<web_connection> connection, bool new_connection = false);
-asio::ip::tcp::acceptor* m_asioAcceptor = nullptr;
+std::unique_ptr<basic_html_template_cache> template_cache;
 
-std::map<std::string, std::function<std::string(var)>> exposed_functions;
+compression_options compression;
 
-using http_message_pipeline = uva::networking::basic_thread_safe_pipeline_waiter<http_message>;
+//Filled during static initialization, only read afterwards.
+static std::unordered_map<std::string, compiled_view>& compiled_views()
+{
+    static std::unordered_map<std::string, compiled_view> views;
+    return views;
+}
+
+using http_message_pipeline = uva::networking::basic_lock_free_pipeline<http_message>;
 http_message_pipeline m_deque;
 
+//Keeps the responses in order. What touches the socket is in basic_web_connection, one per socket type.
 class web_connection : public basic_connection, public std::enable_shared_from_this<web_connection>
 {
-private:
+protected:
     http_message m_request;
     std::deque<http_message> m_response_deque;
 
     asio::streambuf m_buffer;
-    basic_socket m_socket;
+    http_message_parser m_parser;
     bool m_seek = false;
+    //Set by close(). Nothing else is read, and the socket is closed once the last response is written.
+    bool m_closing = false;
+    //Set when a write failed. The socket is closed, the responses still to come are dropped.
+    bool m_write_failed = false;
     std::mutex m_mutex;
+
+    //Requests are dispatched in parallel, so responses may be finished out of order.
+    size_t m_next_request_sequence = 0;
+    size_t m_next_response_sequence = 0;
+    std::map<size_t, http_message> m_out_of_order_responses;
 public:
-    web_connection(basic_socket&& socket);
+    virtual ~web_connection() = default;
 public:
     bool is_seek();
-    void read_request();
-    void write_response(http_message&& message);
+    virtual void read_request() = 0;
+    void write_response(size_t sequence, http_message&& message);
+    /// @brief Closes the connection after the responses to the requests read so far are written. Safe from any thread.
     void close();
+    /// @brief Called from a dispatch worker once the pipeline has room for the request this connection is holding.
+    virtual void resume_reading() = 0;
 
     std::shared_ptr<web_connection> get_shared_pointer();
+protected:
+    /// @brief Runs on the socket io thread with m_mutex locked.
+    virtual void write_front_response() = 0;
+    /// @brief Requests run on the dispatch workers, but only the socket io thread may touch the socket.
+    /// Schedules write_front_response there. m_mutex must be locked.
+    virtual void post_write_front_response() = 0;
+    /// @brief Schedules closing the socket on its io thread.
+    virtual void post_close_socket() = 0;
+    void on_request_read();
+    /// @brief A malformed request is answered with 400 Bad Request. Either way, the connection is closed after the pending responses.
+    void on_request_error(const uva::networking::error_code& ec);
+    /// @brief Every request read has been responded and written. m_mutex must be locked.
+    bool is_drained() const;
+};
+
+//Connections holding a request the pipeline had no room for. They stop reading until a worker makes room.
+static std::mutex s_paused_connections_mutex;
+static std::vector<std::shared_ptr<web_connection>> s_paused_connections;
+static std::atomic<size_t> s_paused_connection_count = 0;
+
+static void resume_paused_connections()
+{
+    //Checked without the lock on every pop, paused connections are rare.
+    if(!s_paused_connection_count.load()) {
+        return;
+    }
+
+    std::vector<std::shared_ptr<web_connection>> paused;
+
+    {
+        std::scoped_lock lock(s_paused_connections_mutex);
+        paused.swap(s_paused_connections);
+        s_paused_connection_count = 0;
+    }
+
+    //The ones which still find the pipeline full are paused again.
+    for(auto& connection : paused) {
+        connection->resume_reading();
+    }
+}
+
+static void pause_reading(std::shared_ptr<web_connection> connection)
+{
+    {
+        std::scoped_lock lock(s_paused_connections_mutex);
+        s_paused_connections.push_back(std::move(connection));
+        ++s_paused_connection_count;
+    }
+
+    //The workers may have drained the pipeline between the failed push and the pause, no pop would resume us then.
+    if(m_deque.size() < m_deque.capacity()) {
+        resume_paused_connections();
+    }
+}
+
+//The listener protocol is only known at runtime, this is where it is chosen. Below it, every socket operation is resolved at compile time.
+template<typename Socket>
+class basic_web_connection : public web_connection
+{
 private:
-    void write_front_response();
+    Socket m_socket;
+public:
+    basic_web_connection(asio::ip::tcp::socket&& socket);
 public:
+    void read_request() override;
+    void resume_reading() override;
+protected:
+    void write_front_response() override;
+    void post_write_front_response() override;
+    void post_close_socket() override;
 };
 
-web_connection::web_connection(basic_socket&& socket)
-    : m_socket(std::forward<basic_socket&&>(socket))
+template<typename Socket>
+basic_web_connection<Socket>::basic_web_connection(asio::ip::tcp::socket&& socket)
+    : m_socket(std::move(socket))
 {
-    if(m_socket.needs_handshake()) {
-        m_socket.async_server_handshake([this](uva::networking::error_code ec){
-            if (ec) {
-                m_seek = true;
-            } else {
-                read_request();
-                m_seek = true;
+    if constexpr(Socket::is_secure) {
+        auto on_handshake = [this](uva::networking::error_code ec){
+            if (!ec) {
+                //The handshake may have run on a handshake thread, the requests are read on the io thread of the socket.
+                asio::post(m_socket.lowest_layer().get_executor(), [this]() {
+                    read_request();
+                });
             }
-        });
+
+            //Read by is_seek from other threads.
+            std::scoped_lock lock(m_mutex);
+            m_seek = true;
+        };
+
+        if(networking::handshake_thread_count()) {
+            m_socket.async_server_handshake(next_handshake_context(), on_handshake);
+        } else {
+            m_socket.async_server_handshake(on_handshake);
+        }
+    } else {
+        //Plain http has nothing to negotiate, the request is read right away.
+        read_request();
+        m_seek = true;
     }
 }
 
@@ -80,23 +201,122 @@ bool web_connection::is_seek()
     return m_seek;
 }
 
-void web_connection::read_request()
+void web_connection::on_request_read()
 {
-    networking::async_read_http_request(m_socket, m_request, m_buffer, [this]() {
+    {
         std::scoped_lock lock(m_mutex);
 
+        //A previous request asked to close, this one is not answered.
+        if(m_closing) {
+            return;
+        }
+
         m_request.connection = this;
-        m_deque.push_back(std::move(m_request));
+        m_request.sequence = m_next_request_sequence;
 
-        //Haven't we came here before?
-        read_request();
+        //Never wait for room here: the io thread would stop serving every other connection, and the workers may be
+        //blocked writing to this one. The request stays in m_request and nothing else is read until there is room.
+        if(!m_deque.try_push_back(std::move(m_request))) {
+            pause_reading(shared_from_this());
+            return;
+        }
+
+        ++m_next_request_sequence;
+    }
+
+    //Unlocked, its error handler takes m_mutex. A request already in m_buffer completes from a posted handler, not from here.
+    read_request();
+}
+
+void web_connection::on_request_error(const uva::networking::error_code& ec)
+{
+    //Not dispatched, the bytes after it cannot be trusted to start a request.
+    if(ec == std::errc::bad_message || ec == std::errc::value_too_large) {
+        size_t sequence = 0;
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            if(m_closing) {
+                return;
+            }
+
+            //Answered after the responses to the requests before it.
+            sequence = m_next_request_sequence++;
+        }
+
+        http_message message;
+        message.status = ec == std::errc::value_too_large ? status_code::payload_too_large : status_code::bad_request;
+        message.type = content_type::text_html;
+        message.headers.set("Connection", "close");
+
+        write_response(sequence, std::move(message));
+    }
+
+    close();
+}
+
+template<typename Socket>
+void basic_web_connection<Socket>::read_request()
+{
+    networking::async_read_http_request(m_socket, m_request, m_buffer, m_parser, [this]() {
+        on_request_read();
+    }, [this](uva::networking::error_code& ec) {
+        on_request_error(ec);
     });
 } 
 
+template<typename Socket>
+void basic_web_connection<Socket>::resume_reading()
+{
+    auto connection = std::static_pointer_cast<basic_web_connection<Socket>>(shared_from_this());
+
+    asio::post(m_socket.lowest_layer().get_executor(), [connection]() {
+        connection->on_request_read();
+    });
+}
+
 void web_connection::close()
 {
     std::scoped_lock lock(m_mutex);
-    m_socket.close();
+
+    if(m_closing) {
+        return;
+    }
+
+    m_closing = true;
+
+    //Otherwise, the write of the last response closes it.
+    if(is_drained()) {
+        post_close_socket();
+    }
+}
+
+bool web_connection::is_drained() const
+{
+    return m_response_deque.empty() && m_next_response_sequence == m_next_request_sequence;
+}
+
+template<typename Socket>
+void basic_web_connection<Socket>::post_close_socket()
+{
+    auto connection = std::static_pointer_cast<basic_web_connection<Socket>>(shared_from_this());
+
+    asio::post(m_socket.lowest_layer().get_executor(), [connection]() {
+        std::scoped_lock lock(connection->m_mutex);
+        connection->m_socket.close();
+    });
+}
+
+template<typename Socket>
+void basic_web_connection<Socket>::post_write_front_response()
+{
+    auto connection = std::static_pointer_cast<basic_web_connection<Socket>>(shared_from_this());
+
+    asio::post(m_socket.lowest_layer().get_executor(), [connection]() {
+        std::scoped_lock lock(connection->m_mutex);
+        connection->write_front_response();
+    });
 }
 
 std::shared_ptr<web_connection> web_connection::get_shared_pointer()
@@ -105,28 +325,92 @@ std::shared_ptr<web_connection> web_connection::get_shared_pointer()
     return shared_from_this();
 }
 
-void web_connection::write_response(http_message&& message)
+void web_connection::write_response(size_t sequence, http_message&& message)
 {
     std::scoped_lock lock(m_mutex);
+
+    if(m_write_failed) {
+        return;
+    }
+
+    if(sequence != m_next_response_sequence) {
+        //A previous request is still being processed, its response must be written first.
+        m_out_of_order_responses.insert({ sequence, std::move(message) });
+        return;
+    }
+
+    bool is_writing = m_response_deque.size();
+
     m_response_deque.push_back(std::move(message));
+    ++m_next_response_sequence;
+
+    auto it = m_out_of_order_responses.find(m_next_response_sequence);
+
+    while(it != m_out_of_order_responses.end()) {
+        m_response_deque.push_back(std::move(it->second));
+        m_out_of_order_responses.erase(it);
+
+        ++m_next_response_sequence;
+        it = m_out_of_order_responses.find(m_next_response_sequence);
+    }
 
-    if(m_response_deque.size() == 1) {
-        write_front_response();
+    //Called from a dispatch worker, the write starts on the socket io thread.
+    if(!is_writing) {
+        post_write_front_response();
     }
 }
 
-void web_connection::write_front_response()
+template<typename Socket>
+void basic_web_connection<Socket>::write_front_response()
 {
     /* The scope is already locked by write_response */
     const http_message& response = m_response_deque.front();
 
-    async_write_http_response(m_socket, response.raw_body, response.status, response.type, [this](uva::networking::error_code ec) {
-        m_response_deque.pop_front();
+    auto on_written = [this](uva::networking::error_code& ec, size_t count) {
+        //Called from the io thread, while write_response may be called from another one.
+        std::scoped_lock lock(m_mutex);
+
+        //The peer is gone or the stream is broken, nothing else can be written to it.
+        if(ec) {
+            m_write_failed = true;
+            m_closing = true;
+            m_response_deque.clear();
+            m_out_of_order_responses.clear();
+            m_socket.close();
+            return;
+        }
+
+        for(size_t i = 0; i < count; ++i) {
+            m_response_deque.pop_front();
+        }
 
         if(m_response_deque.size()) {
             write_front_response();
+        } else if(m_closing && is_drained()) {
+            m_socket.close();
         }
-    });
+    };
+
+    if(response.body_stream || !response.file_body.empty()) {
+        async_write_http_response(m_socket, response, [on_written](uva::networking::error_code& ec) {
+            on_written(ec, 1);
+        });
+
+        return;
+    }
+
+    //Every response ready in order goes in the same write, so pipelined requests do not cost a write each.
+    std::vector<const http_message*> batch;
+
+    for(const http_message& ready : m_response_deque) {
+        if(ready.body_stream || !ready.file_body.empty()) {
+            break;
+        }
+
+        batch.push_back(&ready);
+    }
+
+    async_write_http_responses(m_socket, batch, max_write_batch_size, on_written);
 }
 
 std::vector<std::shared_ptr<web_connection>> m_connections;
@@ -142,13 +426,13 @@ R"~~~(
 </html>
 )~~~";
 
-void write_404_http_message(std::shared_ptr<web_connection> connection)
+void write_404_http_message(std::shared_ptr<web_connection> connection, size_t sequence)
 {
     http_message message;
     message.raw_body = s_not_found_page;
     message.status = status_code::not_found;
     message.type = content_type::text_html;
-    connection->write_response(std::move(message));
+    connection->write_response(sequence, std::move(message));
 }
 
 static std::string cow_read_file(const std::filesystem::path& path)
@@ -171,13 +455,32 @@ static std::string cow_read_file(const std::filesystem::path& path)
     return content;
 }
 
+//Any url whose last segment has an extension, like /styles/uva.css
+static bool is_asset_url(std::string_view url)
+{
+    size_t last_separator = url.rfind('/');
+    std::string_view name = last_separator == std::string_view::npos ? url : url.substr(last_separator + 1);
+
+    return name.find('.') != std::string_view::npos;
+}
+
 void proccess_request(http_message request)
 {
+    //The request is moved into the controller, keep where the response goes.
+    web_connection* connection = request.connection;
+    size_t sequence = request.sequence;
+
     current_response.type = content_type::text_html;
     current_response.status = status_code::no_content;
     current_response.raw_body = "";
+    current_response.body_stream = nullptr;
+    current_response.shared_body.reset();
+    current_response.static_body = std::string_view();
+    current_response.file_body.clear();
+    current_response.file_body_size = 0;
+    current_response.headers.clear();
 
-    format_on_cout("\n\nStarted {} {} for {} with params:\n{}\nand headers: {}", request.method, request.url, request.endpoint, request.params.to_s(), request.headers.to_s());
+    format_on_cout("\n\nStarted {} {} for {} with params:\n{}\nand headers: {}", request.method, request.url, request.endpoint, request.params.to_s(), request.headers.to_var().to_s());
 
     std::string action;
     std::string controller;
@@ -187,20 +490,83 @@ void proccess_request(http_message request)
     the connection-token "close" was sent in the request.*/
 
     bool should_close = false;
-    if(request.headers["Connection"] == "close") {
+    if(case_insensitive_equals(request.headers.get(known_header::connection), "close")) {
         should_close = true;
     }
 
+    content_encoding accepted_encoding = content_encoding::identity;
+
+    if(compression.level) {
+        accepted_encoding = negotiate_content_encoding(request.headers.get(known_header::accept_encoding));
+    }
+
     //asking asset
-    if(request.url.ends_with(".css")) {
-        respond css_file(request.url);
+    std::shared_ptr<const static_asset> asset;
+    bool fingerprinted = false;
+
+    if(is_asset_url(request.url)) {
+        asset = asset_cache->find_fingerprinted(request.url);
+        fingerprinted = asset != nullptr;
 
-        request.connection->write_response(std::move(current_response));
+        if(!asset) {
+            asset = asset_cache->find(request.url);
+        }
+    }
+
+    if(asset) {
+        //A .gz next to the asset is served as it is, compressed at build time.
+        std::shared_ptr<const static_asset> compressed;
+
+        if(compression.level && asset->gzip) {
+            if(accepted_encoding == content_encoding::gzip) {
+                compressed = asset->gzip;
+            }
+
+            current_response.headers.set("Vary", "Accept-Encoding");
+        }
+
+        if(compressed) {
+            respond_with_asset(request, current_response, compressed);
+
+            current_response.type = asset->type;
+            current_response.headers.set("Content-Encoding", "gzip");
+        } else {
+            respond_with_asset(request, current_response, asset);
+        }
+
+        //The url changes with the content, so it never needs to be revalidated.
+        if(fingerprinted) {
+            current_response.headers.set("Cache-Control", "public, max-age=31536000, immutable");
+        }
+
+        connection->write_response(sequence, std::move(current_response));
     } else {
-        std::string route = request.method + " " + request.url;
+        route_match match;
+        std::string route;
+
+        //Path parameters are matched here, the routing table only resolves the route key to its action.
+        if(router().find(request.method, request.url, match)) {
+            route = *match.route;
+
+            if(match.param_count) {
+                std::map<var, var> params;
+
+                if(request.params.type == var::var_type::map) {
+                    params = request.params.as<var::var_type::map>();
+                }
+
+                for(size_t i = 0; i < match.param_count; ++i) {
+                    params[std::string(match.params[i].first)] = std::string(match.params[i].second);
+                }
+
+                request.params = var(std::move(params));
+            }
+        } else {
+            route = request.method + " " + request.url;
+        }
 
         try {
-            basic_action_target target = find_dispatch_target(route, request.connection->get_shared_pointer());
+            basic_action_target target = find_dispatch_target(route, connection->get_shared_pointer());
             if(target.controller) {
                 {
                     std::shared_ptr<basic_web_controller> web_controller = std::dynamic_pointer_cast<web_application::basic_web_controller>(target.controller);
@@ -209,7 +575,7 @@ void proccess_request(http_message request)
                         target.controller->params = request.params;
                         web_controller->request = std::move(request);
 
-                        dispatch(target, request.connection->get_shared_pointer());
+                        dispatch(target, connection->get_shared_pointer());
                     } else {
                         respond html_template("error", {
                             { "error_type", "Implementation Error" },
@@ -228,7 +594,9 @@ void proccess_request(http_message request)
                 }) with_status status_code::not_found;
             }
 
-            request.connection->write_response(std::move(current_response));
+            compress_response(current_response, accepted_encoding, compression);
+
+            connection->write_response(sequence, std::move(current_response));
         } catch(std::exception e)
         {
             //write 500 response
@@ -240,25 +608,64 @@ void proccess_request(http_message request)
                 { "error_description", std::format("An unhandled exception has been caught: {}", e.what()) },
             }) with_status status_code::internal_server_error;
 
-            request.connection->write_response(std::move(current_response));
+            compress_response(current_response, accepted_encoding, compression);
+
+            connection->write_response(sequence, std::move(current_response));
         }
     }
 
     if(should_close) {
-        request.connection->close();
+        connection->close();
     }
 
     return;
 }
 
-void acceptor(asio::ip::tcp::acceptor& asioAcceptor) {
-	asioAcceptor.async_accept([&asioAcceptor](std::error_code ec, asio::ip::tcp::socket socket)
+void dispatch_loop()
+{
+    http_message message;
+
+    while (1) {
+        m_deque.wait();
+
+        //Every worker has its own current_response, so requests are dispatched in parallel.
+        while(m_deque.try_pop_front(message)) {
+            resume_paused_connections();
+
+            try {
+                proccess_request(std::move(message));
+            } catch(std::exception e)
+            {
+                log_error("Exception caught at dispatch worker: {}", e.what());
+            }
+        }
+    }
+}
+
+void acceptor(listener& listener) {
+	//The acceptor runs on the main io_context, the connections are spread across all of them.
+	//https connections hand their handshake to the handshake threads, when there are any.
+	asio::io_context& context = next_io_context();
+
+	listener.acceptor->async_accept(context, [&listener](std::error_code ec, asio::ip::tcp::socket socket)
 	{
 		// Triggered by incoming connection request
 		if (!ec)
 		{
 	        std::cout << "New Connection: " << socket.remote_endpoint() << "\n";
-            m_connections.push_back(std::make_shared<web_connection>(std::move(basic_socket(std::move(socket), protocol::https))));
+            switch(listener.protocol)
+            {
+                case networking::protocol::http:
+                    m_connections.push_back(std::make_shared<basic_web_connection<http_socket>>(std::move(socket)));
+                break;
+                case networking::protocol::https:
+                    if(networking::ktls_enabled()) {
+                        m_connections.push_back(std::make_shared<basic_web_connection<ktls_socket>>(std::move(socket)));
+                    } else {
+                        m_connections.push_back(std::make_shared<basic_web_connection<https_socket>>(std::move(socket)));
+                    }
+                break;
+            }
 
             //log("Connection accepted with {} bytes available to read.", m_connections.back()->m_socket.available());
             //proccess_request(m_connections.back(), true);
@@ -269,106 +676,56 @@ void acceptor(asio::ip::tcp::acceptor& asioAcceptor) {
 			std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
 		}
 
-		acceptor(asioAcceptor);
+		acceptor(listener);
 	});
 }
 
-std::string find_html_file(const std::string& controller, const std::string& name)
+static std::string_view protocol_to_string(const networking::protocol& protocol)
 {
-    std::string folder;
-
-    static std::vector<std::string> extensions = { "cpp.html", "html" };
-
-    std::filesystem::path possibility = app_dir / "app" / "views" / controller / name;
+    return protocol == networking::protocol::https ? "https" : "http";
+}
 
-    for(const std::string& extension : extensions) {
-        possibility = possibility.replace_extension(extension);
-        if(std::filesystem::exists(possibility)) {
-            return possibility.string();
-        }
+static networking::protocol parse_protocol(std::string_view protocol)
+{
+    if(protocol == "http") {
+        return networking::protocol::http;
+    } else if(protocol == "https") {
+        return networking::protocol::https;
     }
 
-    return "";
+    throw std::runtime_error(std::format("error: unknown protocol '{}', expected http or https", protocol));
 }
 
-std::string format_html_file(const std::string& path, const var& locals)
+//[protocol://][address:]port, like "http://0.0.0.0:8080", "https://[::1]:8443" or "8080".
+static listener parse_listen_switch(std::string_view value, const networking::protocol& default_protocol, const std::string& default_address)
 {
-    static std::string var_tag = "<var>";
-    static std::string close_var_tag = "</var>";
+    listener listener;
+    listener.protocol = default_protocol;
+    listener.address = default_address;
 
-    std::string formated_content;
-    std::string content = uva::file::read_all_text<char>(path);
+    size_t scheme_end = value.find("://");
 
-    if(!path.ends_with(".cpp.html")) {
-        return content;
+    if(scheme_end != std::string_view::npos) {
+        listener.protocol = parse_protocol(value.substr(0, scheme_end));
+        value.remove_prefix(scheme_end + 3);
     }
 
-    formated_content.reserve(content.size());
-
-    size_t index = 0;
-
-    std::string current_var_name;
-
-    while(index < content.size())
-    {
-        if(formated_content.ends_with(var_tag))
-        {
-            current_var_name.push_back(content[index]);
-
-            if(current_var_name.ends_with(close_var_tag))
-            {
-                current_var_name.erase(current_var_name.end()-close_var_tag.size(), current_var_name.end());
+    size_t port_separator = value.rfind(':');
 
-                size_t parentheses_index = current_var_name.find('(');
+    if(port_separator != std::string_view::npos) {
+        std::string_view address = value.substr(0, port_separator);
 
-                if(parentheses_index == std::string::npos) {
-                    var value = locals.fetch(current_var_name);
-
-                    current_var_name.clear();
-                    formated_content.erase(formated_content.end()-var_tag.size(), formated_content.end());
-
-                    if(value)
-                    {
-                        formated_content += value.to_s();
-                    }
-                } else {
-                    std::string params = current_var_name.substr(parentheses_index);
-                    current_var_name = current_var_name.substr(0, parentheses_index);
-
-                    while(isspace(params.back())) {
-                        params.pop_back();
-                    }
-
-                    if(!params.ends_with(')')) {
-                        throw std::runtime_error("failed to parse HTML template: missing ')' at end of function call.");
-                    }
-
-                    params.erase(0, 1);
-                    params.pop_back();
-
-                    auto arguments = parse_argument_list(params);
-
-                    auto it = exposed_functions.find(current_var_name);
-
-                    if(it == exposed_functions.end()) {
-                        throw std::runtime_error(std::format("error: function '{}' not found", current_var_name));
-                    }
-
-                    current_var_name.clear();
-                    formated_content.erase(formated_content.end()-var_tag.size(), formated_content.end());
-
-                    formated_content += it->second(arguments);
-                }
-
-            }
-        } else {
-            formated_content.push_back(content[index]);
+        if(address.size() > 1 && address.front() == '[' && address.back() == ']') {
+            address = address.substr(1, address.size() - 2);
         }
 
-        index++;
+        listener.address = std::string(address);
+        value.remove_prefix(port_separator + 1);
     }
 
-    return formated_content;
+    listener.port = std::stoul(std::string(value));
+
+    return listener;
 }
 
 http_message& uva::networking::operator+=(http_message& http_message, std::map<var,var>&& __body)
@@ -391,38 +748,95 @@ http_message &uva::networking::operator<<(http_message &http_message, const web_
     http_message.status = status_code::ok;
     http_message.type = content_type::text_html;
 
-    std::string path = find_html_file(__template.controller, __template.file_name);
+    const auto& views = compiled_views();
+    compiled_view view = nullptr;
+
+    if(views.size()) {
+        auto it = views.find(__template.controller + '/' + __template.file_name);
+
+        if(it != views.end()) {
+            view = it->second;
+        }
+    }
+
+    //While developing, the files being edited win over what was compiled at build time.
+    if(view && !template_cache->watches_files()) {
+        http_message.raw_body = view(__template.locals);
+        return http_message;
+    }
+
+    std::shared_ptr<const basic_compiled_html_template> compiled = template_cache->find(__template.controller, __template.file_name);
+
+    if(!compiled) {
+        //An app with embedded assets has no app/views to read.
+        if(view) {
+            http_message.raw_body = view(__template.locals);
+            return http_message;
+        }
 
-    if(path.empty()) {
-        //throw error
+        throw std::runtime_error(std::format("error: cannot find view '{}/{}'", __template.controller, __template.file_name));
     }
 
-    http_message.raw_body = format_html_file(path, __template.locals); 
+    http_message.raw_body = compiled->render(__template.locals);
 
     return http_message;
 }
 
 http_message &uva::networking::operator<<(http_message &http_message, const web_application::basic_css_file &css)
 {
+    std::shared_ptr<const static_asset> asset = asset_cache->find(css.name);
+
+    if(!asset) {
+        throw std::runtime_error(std::format("error: cannot find css file '{}'", css.name));
+    }
+
     http_message.status = status_code::ok;
     http_message.type = content_type::text_css;
+    set_asset_body(http_message, *asset);
+    http_message.headers.set("ETag", asset->etag);
+    http_message.headers.set("Last-Modified", asset->last_modified);
 
-    std::filesystem::path path = (app_dir / "app" / css.name).make_preferred();
-
-    if(!std::filesystem::exists(path)) {
-        
-    }
+    return http_message;
+}
 
-    http_message.raw_body = uva::file::read_all_text<char>(path);
+http_message &uva::networking::operator<<(http_message &http_message, const web_application::basic_body_stream &stream)
+{
+    http_message.status = status_code::ok;
+    http_message.type = stream.type;
+    http_message.raw_body.clear();
+    http_message.body_stream = stream.generator;
 
     return http_message;
 }
 
+body_generator uva::networking::web_application::buffered_body(std::function<bool(std::string&)> write_some, size_t chunk_size)
+{
+    auto finished = std::make_shared<bool>(false);
+
+    return [write_some, chunk_size, finished](std::string& chunk) {
+        if(*finished) {
+            return false;
+        }
+
+        chunk.reserve(chunk_size);
+
+        while(chunk.size() < chunk_size) {
+            if(!write_some(chunk)) {
+                *finished = true;
+                break;
+            }
+        }
+
+        return chunk.size() || !*finished;
+    };
+}
+
 http_message &uva::networking::redirect_to(const std::string &url, const var &params)
 {
     current_response.status = status_code::moved;
     current_response.type   = content_type::text_html;
-    current_response.headers = { { "Location", url } };
+    current_response.headers.clear();
+    current_response.headers.set("Location", url);
     return current_response;
 }
 
@@ -432,12 +846,18 @@ uva::networking::web_application::basic_html_template::basic_html_template(std::
 
 }
 
+bool uva::networking::web_application::register_compiled_view(const std::string& controller, const std::string& name, compiled_view view)
+{
+    compiled_views()[controller + '/' + name] = view;
+    return true;
+}
+
 void uva::networking::web_application::expose_function(std::string name, std::function<std::string(var)> function)
 {
     exposed_functions.insert({name, function});
 }
 
-std::string stylesheet_path(var params)
+std::string uva::networking::web_application::stylesheet_path(var params)
 {
     if(params.size() != 1)
     {
@@ -449,14 +869,20 @@ std::string stylesheet_path(var params)
     }
 
     std::string path = params[0];
-    std::filesystem::path new_path;
 
-    if(path.starts_with("styles")) {
-        new_path = app_dir / "app" / path;
+    if(!path.starts_with("styles")) {
+        throw std::runtime_error(std::format("error: cannot find css file '{}'", path));
     }
 
-    if(!std::filesystem::exists(new_path)) {
-        throw std::runtime_error(std::format("error: cannot find css file '{}'", new_path.string()));
+    std::string_view url = asset_cache->fingerprinted_url(path);
+
+    if(url.size()) {
+        return std::format("<link rel='stylesheet' href='{}'/>", url);
+    }
+
+    //No manifest in development. The asset cache also knows the embedded assets, and does not touch the disk for known files.
+    if(!asset_cache->find(path)) {
+        throw std::runtime_error(std::format("error: cannot find css file '{}'", path));
     }
 
     return std::format("<link rel='stylesheet' href='{}'/>", path);
@@ -464,17 +890,37 @@ std::string stylesheet_path(var params)
 
 void web_application::init(int argc, const char **argv)
 {
-    if(!networking::is_initialized()) {
-        networking::init(run_mode::async);
-    }
-
-    expose_function("stylesheet_path", stylesheet_path);
-
 	size_t port = 3000;
+    size_t io_threads = 0;
+    size_t worker_count = std::thread::hardware_concurrency();
+    size_t handshake_threads = 0;
+    size_t asset_cache_size = 64 * 1024 * 1024;
+    size_t sendfile_threshold = 1024 * 1024;
+    bool use_ktls = false;
+    std::string environment = "development";
     std::string address = "localhost";
+    networking::protocol protocol = networking::protocol::https;
+    tls_session_options tls_sessions;
+    std::vector<std::string> listen_switches;
 
     static std::string port_switch = "--port=";
     static std::string address_switch = "--address=";
+    static std::string protocol_switch = "--protocol=";
+    static std::string listen_switch = "--listen=";
+    static std::string io_threads_switch = "--io-threads=";
+    static std::string workers_switch = "--workers=";
+    static std::string handshake_threads_switch = "--handshake-threads=";
+    static std::string max_write_batch_switch = "--max-write-batch=";
+    static std::string asset_cache_size_switch = "--asset-cache-size=";
+    static std::string sendfile_threshold_switch = "--sendfile-threshold=";
+    static std::string max_body_size_switch = "--max-body-size=";
+    static std::string ktls_switch = "--ktls";
+    static std::string environment_switch = "--environment=";
+    static std::string compression_level_switch = "--compression-level=";
+    static std::string compression_min_size_switch = "--compression-min-size=";
+    static std::string tls_session_cache_size_switch = "--tls-session-cache-size=";
+    static std::string tls_ticket_key_rotation_switch = "--tls-ticket-key-rotation=";
+    static std::string no_tls_tickets_switch = "--no-tls-tickets";
 
     for(size_t i = 0; i < argc; ++i) {
         std::string arg = argv[i];
@@ -484,39 +930,142 @@ void web_application::init(int argc, const char **argv)
         else if(arg.starts_with(address_switch)) {
             address = arg.substr(address_switch.size());
         }
+        else if(arg.starts_with(protocol_switch)) {
+            protocol = parse_protocol(arg.substr(protocol_switch.size()));
+        }
+        else if(arg.starts_with(listen_switch)) {
+            //Parsed after all switches, so --protocol and --address apply to every --listen.
+            listen_switches.push_back(arg.substr(listen_switch.size()));
+        }
+        else if(arg.starts_with(io_threads_switch)) {
+            io_threads = std::stoi(arg.substr(io_threads_switch.size()));
+        }
+        else if(arg.starts_with(workers_switch)) {
+            worker_count = std::stoi(arg.substr(workers_switch.size()));
+        }
+        else if(arg.starts_with(handshake_threads_switch)) {
+            handshake_threads = std::stoi(arg.substr(handshake_threads_switch.size()));
+        }
+        else if(arg.starts_with(max_write_batch_switch)) {
+            max_write_batch_size = std::stoull(arg.substr(max_write_batch_switch.size()));
+        }
+        else if(arg.starts_with(asset_cache_size_switch)) {
+            asset_cache_size = std::stoull(arg.substr(asset_cache_size_switch.size()));
+        }
+        else if(arg.starts_with(sendfile_threshold_switch)) {
+            sendfile_threshold = std::stoull(arg.substr(sendfile_threshold_switch.size()));
+        }
+        else if(arg.starts_with(max_body_size_switch)) {
+            networking::set_max_body_size(std::stoull(arg.substr(max_body_size_switch.size())));
+        }
+        else if(arg == ktls_switch) {
+            use_ktls = true;
+        }
+        else if(arg.starts_with(environment_switch)) {
+            environment = arg.substr(environment_switch.size());
+        }
+        else if(arg.starts_with(compression_level_switch)) {
+            compression.level = std::clamp(std::stoi(arg.substr(compression_level_switch.size())), 0, 9);
+        }
+        else if(arg.starts_with(compression_min_size_switch)) {
+            compression.min_size = std::stoull(arg.substr(compression_min_size_switch.size()));
+        }
+        else if(arg.starts_with(tls_session_cache_size_switch)) {
+            tls_sessions.cache_size = std::stoull(arg.substr(tls_session_cache_size_switch.size()));
+        }
+        else if(arg.starts_with(tls_ticket_key_rotation_switch)) {
+            //In seconds
+            tls_sessions.ticket_key_rotation = std::chrono::seconds(std::stoull(arg.substr(tls_ticket_key_rotation_switch.size())));
+        }
+        else if(arg == no_tls_tickets_switch) {
+            tls_sessions.tickets = false;
+        }
     }
 
-    try {
-        if(address.size()) {
-            asio::error_code ec;
+    if(!worker_count) {
+        worker_count = 1;
+    }
 
-            asio::ip::tcp::resolver resolver(*io_context);
-            asio::ip::basic_resolver_results res = resolver.resolve({ address, std::to_string(port).data() }, ec);
-            asio::ip::tcp::endpoint endpoint = asio::ip::tcp::endpoint(*res.begin());
+    if(!networking::is_initialized()) {
+        networking::init(run_mode::async_pool, io_threads);
+    }
 
-            m_asioAcceptor = new asio::ip::tcp::acceptor(*io_context, endpoint, port);
+    networking::configure_tls_sessions(tls_sessions);
+
+    if(handshake_threads && !networking::handshake_thread_count()) {
+        networking::start_handshake_threads(handshake_threads);
+    }
+
+    if(use_ktls) {
+        if(networking::enable_ktls()) {
+            log_success("Kernel TLS offload enabled");
         } else {
-            m_asioAcceptor = new asio::ip::tcp::acceptor(*io_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port));
+            log_error("Kernel TLS offload is not supported here, using userspace TLS");
         }
-    } catch(std::exception e)
-    {
-        log_error("Failed to start listening: {}", e.what());
-        return;
     }
 
-	acceptor(*m_asioAcceptor);
+    expose_function("stylesheet_path", stylesheet_path);
 
-    log_success("Started listening in {} ({})", address, m_asioAcceptor->local_endpoint().address().to_string());
+    asset_cache = std::make_unique<basic_asset_cache>(app_dir / "app", asset_cache_size, sendfile_threshold);
 
-	while (1) {
-        m_deque.wait();
+    //Assets may change while developing, fingerprinted urls would be cached by browsers with the old content.
+    if(environment != "development") {
+        asset_cache->build_manifest();
+    }
+
+    //Views are compiled on first use. Only development watches them for changes.
+    template_cache = std::make_unique<basic_html_template_cache>(app_dir / "app" / "views", exposed_functions, environment == "development");
+
+    //Without --listen, a single listener is made of --protocol, --address and --port.
+    if(listen_switches.empty()) {
+        listeners.push_back({ protocol, address, port });
+    } else {
+        for(const std::string& value : listen_switches) {
+            listeners.push_back(parse_listen_switch(value, protocol, address));
+        }
+    }
 
-        while(m_deque.size()) {
-            //The message is first pop'ed_back, so in any error, the following request will be processed.
-            //The pop_back is protected with a mutex, so no write while we read.
+    for(listener& listener : listeners) {
+        if(listener.protocol == networking::protocol::https && !networking::has_server_certificate()) {
+            log_error("Failed to start listening in https://{}:{}: server.crt and server.key could not be loaded", listener.address, listener.port);
+            return;
+        }
+
+        try {
+            if(listener.address.size()) {
+                asio::error_code ec;
 
-            http_message message(m_deque.pop_back());
-            proccess_request(std::move(message));
+                asio::ip::tcp::resolver resolver(main_io_context());
+                asio::ip::basic_resolver_results res = resolver.resolve({ listener.address, std::to_string(listener.port).data() }, ec);
+                asio::ip::tcp::endpoint endpoint = asio::ip::tcp::endpoint(*res.begin());
+
+                listener.acceptor = std::make_unique<asio::ip::tcp::acceptor>(main_io_context(), endpoint, true);
+            } else {
+                listener.acceptor = std::make_unique<asio::ip::tcp::acceptor>(main_io_context(), asio::ip::tcp::endpoint(asio::ip::tcp::v4(), listener.port));
+            }
+        } catch(std::exception e)
+        {
+            log_error("Failed to start listening in {}://{}:{}: {}", protocol_to_string(listener.protocol), listener.address, listener.port, e.what());
+            return;
         }
-	}
+
+        acceptor(listener);
+
+        log_success("Started listening in {}://{}:{} ({})", protocol_to_string(listener.protocol), listener.address, listener.port, listener.acceptor->local_endpoint().address().to_string());
+    }
+
+    log_success("Serving with {} io thread(s)", io_context_count());
+
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+
+    for(size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(&dispatch_loop);
+    }
+
+    log_success("Started {} dispatch worker(s)", worker_count);
+
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
 }
\ No newline at end of file
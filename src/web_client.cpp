@@ -3,10 +3,12 @@
 #include <networking.hpp>
 #include <json.hpp>
 
+#include <algorithm>
+
 using namespace uva;
 using namespace networking;
 
-uva::networking::basic_web_client::basic_web_client(std::string __host)
+uva::networking::basic_web_client::basic_web_client(std::string __host, web_client_pool_options __pool_options)
 {
     if(!uva::networking::is_initialized()) {
         uva::networking::init(run_mode::async);
@@ -30,70 +32,133 @@ uva::networking::basic_web_client::basic_web_client(std::string __host)
 
     m_host = __host.substr(m_protocol.size()+3); //+ "://"
 
-    // m_pipeline_executer = std::make_unique<std::thread>([this](){
-    //     while (1) {
-    //         m_requests_pipeline.wait();
-
-    //         while(m_requests_pipeline.size()) {
-    //             //The message is first pop'ed_back, so in any error, the following request will be processed.
-    //             //The pop_back is protected with a mutex, so no write while we read.
-
-    //             web_client_request re(m_requests_pipeline.pop_back());
-    //             forward_response(std::move(message));
-    //         }
-    //     }
-    // });
+    m_pool = std::make_shared<web_client_pool>(this, m_host, m_protocol, __pool_options);
+    m_pool->start();
 }
 
 uva::networking::basic_web_client::~basic_web_client()
 {
-    if(m_socket.is_open()) {
-        m_socket.close();
+    //The pool lives until its last pending handler is done, but none of them touches this client anymore.
+    m_pool->shutdown();
+}
+
+uva::networking::web_client_pool::web_client_pool(basic_web_client* __owner, std::string __host, std::string __protocol, web_client_pool_options __options)
+    : m_host(std::move(__host)), m_protocol(std::move(__protocol)), m_options(__options), m_owner(__owner)
+{
+    if(!m_options.max_connections) {
+        throw std::runtime_error("error: max_connections must be at least 1");
+    }
+
+    m_options.min_connections = std::min(m_options.min_connections, m_options.max_connections);
+
+    if(!m_options.pipeline_depth) {
+        m_options.pipeline_depth = 1;
     }
+
+    m_idle_timer = std::make_unique<asio::steady_timer>(main_io_context());
 }
 
-void uva::networking::basic_web_client::connect_if_is_not_open()
+void uva::networking::web_client_pool::start()
 {
-    if(!m_socket.is_open())
+    std::vector<std::shared_ptr<web_client_connection>> connections;
+
     {
-        error_code ec = m_socket.connect(m_protocol, m_host);
+        std::scoped_lock lock(m_mutex);
 
-        if(!ec) {
-            if(m_socket.needs_handshake()) {
-                ec = m_socket.client_handshake();
-            }
-        }
+        //The minimum is opened right away, so the first requests do not wait for connecting.
+        for(size_t i = 0; i < m_options.min_connections; ++i) {
+            auto connection = std::make_shared<web_client_connection>();
+            connection->writing = true;
+            connection->last_used = std::chrono::steady_clock::now();
 
-        if(ec)
-        {
-            on_connection_error(ec);
+            m_connections.push_back(connection);
+            connections.push_back(connection);
         }
     }
+
+    for(std::shared_ptr<web_client_connection>& connection : connections) {
+        open_connection(connection);
+    }
+}
+
+//Sockets are only touched from their io_context, TLS streams are not thread safe. A connection still connecting has no socket
+//to close yet, its connect handler finds it closed and closes it there.
+static void post_close(std::shared_ptr<web_client_connection> connection)
+{
+    if(!connection->connected) {
+        return;
+    }
+
+    asio::post(connection->socket.get_executor(), [connection]() {
+        connection->socket.close();
+    });
+}
+
+void uva::networking::web_client_pool::shutdown()
+{
+    {
+        std::scoped_lock lock(m_owner_mutex);
+        m_owner = nullptr;
+    }
+
+    std::scoped_lock lock(m_mutex);
+
+    m_shutdown = true;
+    m_idle_timer->cancel();
+
+    for(std::shared_ptr<web_client_connection>& connection : m_connections) {
+        connection->closed = true;
+        post_close(connection);
+    }
+
+    m_connections.clear();
+    m_requests_pipeline.clear();
+    m_retry_requests.clear();
+}
+
+void uva::networking::web_client_pool::notify_connection_error(const error_code& ec)
+{
+    std::scoped_lock lock(m_owner_mutex);
+
+    if(m_owner) {
+        m_owner->on_connection_error(ec);
+    }
+}
+
+//Safe to pipeline behind other requests, and to send again when the connection closes before the response.
+//A streamed body cannot be generated twice.
+static bool is_idempotent(const web_client_request& request)
+{
+    if(request.request.body_stream) {
+        return false;
+    }
+
+    const std::string& method = request.request.method;
+
+    return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS" || method == "TRACE";
 }
 
-void uva::networking::basic_web_client::connect_if_is_not_open_async(std::function<void()> success, std::function<void(error_code)> on_error)
+void uva::networking::web_client_pool::connect_if_is_not_open_async(web_client_connection& connection, std::function<void()> success, std::function<void(error_code)> on_error)
 {
-    if(!m_socket || !m_socket.is_open())
+    if(!connection.socket || !connection.socket.is_open())
     {
-        m_socket.connect_async(m_protocol, m_host, [this,success,on_error](error_code ec){
+        connection.socket.connect_async(m_protocol, m_host, [&connection,success,on_error](error_code ec){
 
             if(ec)
             {
                 if(on_error) {
                     on_error(ec);
                 }
-                on_connection_error(ec);
                 return;
             }
 
-            if(m_socket.needs_handshake()) {
-                m_socket.async_client_handshake([this,success,on_error](error_code ec){
+            if(connection.socket.needs_handshake()) {
+                connection.socket.async_client_handshake([success,on_error](error_code ec){
                     if(ec)
                     {
                         if(on_error) {
                             on_error(ec);
                         }
-                        on_connection_error(ec);
                         return;
                     }
 
@@ -108,46 +173,420 @@ void uva::networking::basic_web_client::connect_if_is_not_open_async(std::functi
     }
 }
 
-void uva::networking::basic_web_client::enqueue_request(http_message __request, std::function<void(http_message)> __success, std::function<void(error_code)> __error)
+void uva::networking::basic_web_client::enqueue_request(http_message __request, std::function<void(http_message)> __success, std::function<void(error_code)> __error, std::function<void(std::string_view)> __chunk)
 {
-    web_client_request request;
-    request.request = std::move(__request);
-    request.error   = __error;
-    request.success = __success;
+    auto request = std::make_shared<web_client_request>();
+    request->request = std::move(__request);
+    request->error   = __error;
+    request->success = __success;
+    request->chunk   = __chunk;
 
-    m_requests_pipeline.push_back(std::move(request));
+    m_pool->enqueue(std::move(request));
+}
 
-    if(m_requests_pipeline.size() == 1) {
-        write_front_request();
+void uva::networking::web_client_pool::enqueue(std::shared_ptr<web_client_request> request)
+{
+    if(m_shutdown) {
+        return;
     }
+
+    m_requests_pipeline.push_back(std::move(request));
+
+    dispatch_requests();
 }
 
-void uva::networking::basic_web_client::write_front_request()
+void uva::networking::web_client_pool::dispatch_requests()
 {
-    connect_if_is_not_open_async([this]() {
-        uva::networking::async_write_http_request(m_socket, m_requests_pipeline.front().request, [this]() {
+    /* connection, needs connecting */
+    std::vector<std::pair<std::shared_ptr<web_client_connection>, bool>> connections;
 
-            //TODO:
-            //Continue writing the requests, so while the server is working on first request, we're sending others.
+    {
+        std::scoped_lock lock(m_mutex);
 
-            uva::networking::async_read_http_response(m_socket, m_response_buffer, m_buffer, [this](){
-                try {
-                    m_requests_pipeline.front().success(std::move(m_response_buffer));
-                    m_requests_pipeline.consume_front();
-                } catch(std::exception e)
-                {
-                    m_requests_pipeline.consume_front();
-                }
+        while(true) {
+            bool idempotent = false;
 
-                if(m_requests_pipeline.size()) {
-                    write_front_request();
-                }
+            //Popping happens only here, with the lock held, so front is safe.
+            if(m_retry_requests.size()) {
+                idempotent = is_idempotent(*m_retry_requests.front());
+            } else if(!m_requests_pipeline.empty()) {
+                idempotent = is_idempotent(*m_requests_pipeline.front());
+            } else {
+                break;
+            }
+
+            //In order, a request that has to wait holds the ones behind it.
+            std::shared_ptr<web_client_connection> connection = checkout_connection(idempotent);
+
+            if(!connection) {
+                break;
+            }
+
+            std::shared_ptr<web_client_request> request;
+
+            if(m_retry_requests.size()) {
+                request = std::move(m_retry_requests.front());
+                m_retry_requests.pop_front();
+            } else {
+                m_requests_pipeline.try_pop_front(request);
+            }
+
+            connection->requests.push_back(std::move(request));
+
+            if(!connection->writing) {
+                connection->writing = true;
+                connections.push_back({ connection, !connection->connected });
+            }
+        }
+    }
+
+    for(auto& [connection, connect] : connections) {
+        if(connect) {
+            open_connection(connection);
+        } else {
+            //Everything on a connection runs on its io_context, TLS streams are not thread safe.
+            asio::post(connection->socket.get_executor(), [this, self = shared_from_this(), connection]() {
+                write_requests(connection);
             });
+        }
+    }
+}
+
+std::shared_ptr<web_client_connection> uva::networking::web_client_pool::checkout_connection(bool idempotent)
+{
+    for(std::shared_ptr<web_client_connection>& connection : m_connections) {
+        if(!connection->connected || connection->writing || connection->requests.size()) {
+            continue;
+        }
+
+        //The server may have closed it while it was idle. It is checked by write_requests, on its io_context.
+        connection->probe = true;
+
+        return connection;
+    }
+
+    if(m_connections.size() < m_options.max_connections) {
+        auto connection = std::make_shared<web_client_connection>();
+        m_connections.push_back(connection);
+
+        return connection;
+    }
+
+    //Pipelined behind the requests of the least busy connection. Nothing goes behind a request which is not idempotent,
+    //if its connection closes it is not known whether the server got it.
+    if(!idempotent || m_options.pipeline_depth < 2) {
+        return nullptr;
+    }
+
+    std::shared_ptr<web_client_connection> least_busy;
+
+    for(std::shared_ptr<web_client_connection>& connection : m_connections) {
+        if(connection->requests.empty() || connection->requests.size() >= m_options.pipeline_depth || !is_idempotent(*connection->requests.back())) {
+            continue;
+        }
+
+        if(!least_busy || connection->requests.size() < least_busy->requests.size()) {
+            least_busy = connection;
+        }
+    }
+
+    return least_busy;
+}
+
+void uva::networking::web_client_pool::open_connection(std::shared_ptr<web_client_connection> connection)
+{
+    connect_if_is_not_open_async(*connection, [this, self = shared_from_this(), connection]() {
+        {
+            std::scoped_lock lock(m_mutex);
+
+            //Shut down or evicted while connecting, post_close had no socket to close then.
+            if(connection->closed) {
+                connection->socket.close();
+                return;
+            }
+
+            connection->connected = true;
+        }
 
-        },  m_requests_pipeline.front().error);
+        write_requests(connection);
+        dispatch_requests();
+    }, [this, self = shared_from_this(), connection](error_code ec) {
+        close_connection(connection, ec);
+        notify_connection_error(ec);
     });
 }
 
+void uva::networking::web_client_pool::write_requests(std::shared_ptr<web_client_connection> connection)
+{
+    std::shared_ptr<web_client_request> request;
+    bool probe = false;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if(connection->closed) {
+            return;
+        }
+
+        probe = connection->probe;
+        connection->probe = false;
+
+        if(connection->written == connection->requests.size()) {
+            connection->writing = false;
+            schedule_idle_eviction();
+            return;
+        }
+
+        request = connection->requests[connection->written];
+    }
+
+    //Nothing is read or written on an idle connection, so the peek sees what the server sent while it was idle.
+    if(probe && (connection->buffer.size() || !connection->socket.is_reusable())) {
+        requeue_requests(connection);
+        return;
+    }
+
+    //request is captured so it outlives the write even if the connection is closed meanwhile.
+    uva::networking::async_write_http_request(connection->socket, request->request, [this, self = shared_from_this(), connection, request]() {
+        bool read = false;
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            if(connection->closed) {
+                return;
+            }
+
+            ++connection->written;
+
+            if(!connection->reading) {
+                connection->reading = true;
+                read = true;
+            }
+        }
+
+        if(read) {
+            read_responses(connection);
+        }
+
+        write_requests(connection);
+    }, [this, self = shared_from_this(), connection](error_code& ec) {
+        close_connection(connection, ec);
+    });
+}
+
+void uva::networking::web_client_pool::read_responses(std::shared_ptr<web_client_connection> connection)
+{
+    std::shared_ptr<web_client_request> request;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if(connection->closed) {
+            return;
+        }
+
+        if(!connection->written) {
+            connection->reading = false;
+            return;
+        }
+
+        request = connection->requests.front();
+    }
+
+    std::function<void(std::string_view)> on_chunk;
+
+    if(request->chunk) {
+        on_chunk = [request](std::string_view chunk) {
+            request->delivered = true;
+            request->chunk(chunk);
+        };
+    }
+
+    uva::networking::async_read_http_response(connection->socket, connection->response, connection->buffer, connection->parser, [this, self = shared_from_this(), connection, request](){
+        http_message response;
+        bool close = false;
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            if(connection->closed) {
+                return;
+            }
+
+            response = std::move(connection->response);
+
+            connection->requests.pop_front();
+            --connection->written;
+            connection->last_used = std::chrono::steady_clock::now();
+
+            close = case_insensitive_equals(response.headers.get(known_header::connection), "close");
+
+            if(connection->requests.empty()) {
+                schedule_idle_eviction();
+            }
+        }
+
+        //Called back before the next response is read, so the callbacks of a connection run in the order the requests were written.
+        try {
+            request->success(std::move(response));
+        } catch(std::exception e)
+        {
+        }
+
+        //The requests written after this one are sent again on another connection.
+        if(close) {
+            close_connection(connection, asio::error::eof);
+        } else {
+            read_responses(connection);
+            dispatch_requests();
+        }
+    }, on_chunk, [this, self = shared_from_this(), connection](error_code& ec) {
+        close_connection(connection, ec);
+    });
+}
+
+void uva::networking::web_client_pool::requeue_requests(std::shared_ptr<web_client_connection> connection)
+{
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if(connection->closed) {
+            return;
+        }
+
+        connection->closed = true;
+        connection->socket.close();
+
+        auto it = std::find(m_connections.begin(), m_connections.end(), connection);
+
+        if(it != m_connections.end()) {
+            m_connections.erase(it);
+        }
+
+        //None of them was written, they go back ahead of the queue as they were, any method, with no retry counted.
+        m_retry_requests.insert(m_retry_requests.begin(), connection->requests.begin(), connection->requests.end());
+
+        connection->requests.clear();
+        connection->written = 0;
+    }
+
+    dispatch_requests();
+}
+
+void uva::networking::web_client_pool::close_connection(std::shared_ptr<web_client_connection> connection, const error_code& ec)
+{
+    std::vector<std::shared_ptr<web_client_request>> failed;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if(connection->closed) {
+            return;
+        }
+
+        connection->closed = true;
+        connection->socket.close();
+
+        auto it = std::find(m_connections.begin(), m_connections.end(), connection);
+
+        if(it != m_connections.end()) {
+            m_connections.erase(it);
+        }
+
+        std::vector<std::shared_ptr<web_client_request>> retried;
+
+        for(size_t i = 0; i < connection->requests.size(); ++i) {
+            std::shared_ptr<web_client_request>& request = connection->requests[i];
+
+            //Sending it again would deliver the same bytes to chunk twice.
+            if(!is_idempotent(*request) || request->delivered) {
+                failed.push_back(std::move(request));
+                continue;
+            }
+
+            //The oldest one is what the connection closed on, the ones behind it are not counted against.
+            if(i == 0 && request->retries++) {
+                failed.push_back(std::move(request));
+                continue;
+            }
+
+            retried.push_back(std::move(request));
+        }
+
+        //Sent again ahead of the queue and in their order.
+        m_retry_requests.insert(m_retry_requests.begin(), retried.begin(), retried.end());
+
+        connection->requests.clear();
+        connection->written = 0;
+    }
+
+    dispatch_requests();
+
+    for(std::shared_ptr<web_client_request>& request : failed) {
+        try {
+            if(request->error) {
+                request->error(ec);
+            }
+        } catch(std::exception e)
+        {
+        }
+    }
+}
+
+void uva::networking::web_client_pool::schedule_idle_eviction()
+{
+    if(m_idle_timer_armed || !m_options.idle_timeout.count() || m_connections.size() <= m_options.min_connections) {
+        return;
+    }
+
+    m_idle_timer_armed = true;
+
+    m_idle_timer->expires_after(m_options.idle_timeout);
+    m_idle_timer->async_wait([this, self = shared_from_this()](error_code ec) {
+        if(ec) {
+            return;
+        }
+
+        evict_idle_connections();
+    });
+}
+
+void uva::networking::web_client_pool::evict_idle_connections()
+{
+    std::scoped_lock lock(m_mutex);
+
+    m_idle_timer_armed = false;
+
+    auto now = std::chrono::steady_clock::now();
+
+    for(auto it = m_connections.begin(); it != m_connections.end() && m_connections.size() > m_options.min_connections;) {
+        web_client_connection& connection = **it;
+
+        if(connection.connected && !connection.writing && connection.requests.empty() && now - connection.last_used >= m_options.idle_timeout) {
+            connection.closed = true;
+            post_close(*it);
+            it = m_connections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    //The ones left are checked again one idle_timeout later.
+    schedule_idle_eviction();
+}
+
+size_t uva::networking::web_client_pool::connection_count()
+{
+    std::scoped_lock lock(m_mutex);
+    return m_connections.size();
+}
+
+size_t uva::networking::basic_web_client::connection_count()
+{
+    return m_pool->connection_count();
+}
+
 void uva::networking::basic_web_client::get(const std::string& route, std::map<var, var> params, std::map<var, var> headers, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error)
 {
     http_message request;
@@ -161,6 +600,19 @@ void uva::networking::basic_web_client::get(const std::string& route, std::map<v
     enqueue_request(std::move(request), on_success, on_error);
 }
 
+void uva::networking::basic_web_client::get(const std::string& route, std::map<var, var> params, std::map<var, var> headers, std::function<void(std::string_view)> on_chunk, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error)
+{
+    http_message request;
+    request.method = "GET";
+    request.url = route;
+    request.params = std::move(params);
+    request.headers = std::move(headers);
+    request.type = content_type::text_html;
+    request.host = m_host;
+
+    enqueue_request(std::move(request), on_success, on_error, on_chunk);
+}
+
 void uva::networking::basic_web_client::post(const std::string &route, std::map<var, var> body, std::map<var, var> headers, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error)
 {
     std::string content = json::enconde(std::move(body));
@@ -191,6 +643,20 @@ void uva::networking::basic_web_client::post(const std::string &route, std::stri
     enqueue_request(std::move(request), on_success, on_error);
 }
 
+void uva::networking::basic_web_client::post(const std::string &route, body_generator body, content_type type, std::map<var, var> headers, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error)
+{
+    http_message request;
+    request.method = "POST";
+    request.url = route;
+    request.body_stream = std::move(body);
+    request.type = type;
+    request.params = std::map<var, var>();
+    request.headers = std::move(headers);
+    request.host = m_host;
+
+    enqueue_request(std::move(request), on_success, on_error);
+}
+
 void uva::networking::basic_web_client::on_connection_error(const uva::networking::error_code &ec)
 {
     throw std::runtime_error(std::format("An error occurred while trying to establish a connection: {}", ec.message()));
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#include <networking.hpp>
+
+namespace uva
+{
+    namespace networking
+    {
+        struct tls_session_options
+        {
+            /* sessions kept by the server for session id resumption */
+            size_t cache_size = 20 * 1024;
+            /* a ticket key encrypts new tickets for this long, and still decrypts them for as long again */
+            std::chrono::seconds ticket_key_rotation = std::chrono::hours(1);
+            /* false falls back to the server cache only */
+            bool tickets = true;
+            /* hosts whose last session the client keeps */
+            size_t client_hosts = 1024;
+        };
+        /// @brief Sets up session resumption on ssl_context (server) and client_ssl_context. init calls it with the defaults.
+        /// The server issues tickets encrypted with keys it rotates itself, and keeps a bounded session cache. The client keeps the last session of each host.
+        void configure_tls_sessions(const tls_session_options& options);
+        /// @brief Offers the last session of host on ssl, a client connection not yet handshaked. New sessions of ssl are then stored for host,
+        /// including TLS 1.3 tickets, which only arrive after the handshake.
+        void resume_tls_session(SSL* ssl, const std::string& host);
+        /// @brief Drops the session of host, after a failed handshake.
+        void forget_tls_session(const std::string& host);
+
+        struct tls_handshake_stats
+        {
+            uint64_t server_full = 0;
+            uint64_t server_resumed = 0;
+            uint64_t client_full = 0;
+            uint64_t client_resumed = 0;
+        };
+        /// @brief Counts a successful handshake of ssl as full or resumed.
+        void count_tls_handshake(SSL* ssl);
+        /// @brief Handshakes since init. Sampling it twice gives the rates.
+        tls_handshake_stats tls_handshake_counters();
+    }; // namespace networking
+}; // namespace uva
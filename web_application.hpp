@@ -1,6 +1,7 @@
 #pragma once
 
 #include "networking.hpp"
+#include "router.hpp"
 #include <routing.hpp>
 #include <json.hpp>
 
@@ -13,10 +14,10 @@ int main(int argc, const char **argv)\
 }\
 
 #define GET(path, action_handler) \
-route("GET " path, &action_handler, #action_handler)\
+(uva::networking::web_application::router().add("GET", path, "GET " path), route("GET " path, &action_handler, #action_handler))\
 
 #define POST(path, action_handler) \
-route("POST " path, &action_handler, #action_handler)\
+(uva::networking::web_application::router().add("POST", path, "POST " path), route("POST " path, &action_handler, #action_handler))\
 
 namespace uva
 {
@@ -29,11 +30,21 @@ namespace uva
             public:
                 http_message request;
             };
-            extern http_message current_response;
+            /* each dispatch worker has its own response */
+            extern thread_local http_message current_response;
             extern std::filesystem::path app_dir;
             void expose_function(std::string name, std::function<std::string(var)> function);
             void init(int argc, const char **argv);
 
+            /// @brief <var>stylesheet_path('styles/file.css')</var>: the link tag for a stylesheet under app/styles.
+            std::string stylesheet_path(var params);
+
+            /// @brief A view translated to C++ at build time by add_web_app.
+            using compiled_view = std::string(*)(const var& locals);
+            /// @brief Registers a view compiled at build time. It is rendered instead of app/views/controller/name.(cpp.html|html).
+            /// Called by the generated code during static initialization.
+            bool register_compiled_view(const std::string& controller, const std::string& name, compiled_view view);
+
             struct basic_html_template
             {
             public:
@@ -42,6 +53,21 @@ namespace uva
                 std::string file_name;
                 var locals;
             };
+            /// @brief A response body produced while it is written. The generator is called on the io thread each time
+            /// the previous chunk was written, so it must own (capture by value) everything it uses.
+            struct basic_body_stream
+            {
+                body_generator generator;
+                content_type type;
+                basic_body_stream(body_generator __generator, const content_type& __type)
+                    : generator(std::move(__generator)), type(__type)
+                {
+
+                }
+            };
+            /// @brief Wraps write_some, which appends to its argument and returns false when there is nothing left, in a
+            /// generator producing chunks of about chunk_size bytes. Useful when the body is made of many small pieces, like CSV rows.
+            body_generator buffered_body(std::function<bool(std::string&)> write_some, size_t chunk_size = 16 * 1024);
             struct basic_css_file
             {
                 std::string name;
@@ -61,6 +87,7 @@ namespace uva
         http_message& operator<<(http_message& http_message, const status_code& __status);
         http_message& operator<<(http_message& http_message, const web_application::basic_html_template& __template);
         http_message& operator<<(http_message& http_message, const web_application::basic_css_file& css);
+        http_message& operator<<(http_message& http_message, const web_application::basic_body_stream& stream);
         http_message& redirect_to(const std::string& url, const var& params = null);
     }; // namespace networking
     
@@ -70,4 +97,5 @@ namespace uva
 #define JSON +=
 #define html_template(file_name, ...) << basic_html_template(file_name, __VA_ARGS__, name)
 #define css_file(file_name) << basic_css_file(file_name)
+#define stream_body(type, generator) << basic_body_stream(generator, type)
 #define with_status ; uva::networking::web_application::current_response <<
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include <format.hpp>
 #include <deque>
 #include <deque>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 
 #ifdef _WIN32
     #ifndef _WIN32_WINNT
@@ -32,37 +37,131 @@ namespace uva
         {
             std::function<void(http_message m)> success;
             std::function<void(error_code m)> error;
+            /* when set, receives the response body as it arrives instead of response.raw_body */
+            std::function<void(std::string_view)> chunk;
             http_message request;
+            /* times it was sent again after its connection closed before the response */
+            size_t retries = 0;
+            /* part of the body already went to chunk, so it is never sent again */
+            std::atomic<bool> delivered = false;
         };
-        using web_client_request_pipeline = uva::networking::basic_thread_safe_pipeline_waiter<web_client_request>;
-        class basic_web_client
+        /* get and post push without taking the pool lock. Past the ring the requests overflow instead of waiting for room,
+           since they may be queued from the response callbacks, on the io threads which drain it */
+        using web_client_request_pipeline = basic_lock_free_pipeline<std::shared_ptr<web_client_request>, 256, pipeline_full_policy::overflow>;
+        struct web_client_pool_options
+        {
+            /* connections opened by the constructor and never closed for being idle */
+            size_t min_connections = 0;
+            /* requests wait in the queue when this many connections are busy */
+            size_t max_connections = 8;
+            /* idle connections above min_connections are closed after this long, zero keeps them open */
+            std::chrono::seconds idle_timeout = std::chrono::seconds(30);
+            /* requests in flight on a single connection. Above 1, idempotent requests are written to busy connections
+               (once no new connection can be opened) without waiting for the previous responses */
+            size_t pipeline_depth = 1;
+        };
+        /// @brief A connection of the pool, with the requests it is carrying. Its members are guarded by the pool mutex.
+        struct web_client_connection
+        {
+            basic_socket socket;
+            asio::streambuf buffer;
+            http_message_parser parser;
+            http_message response;
+            /* in flight, oldest first. The responses arrive in this order */
+            std::deque<std::shared_ptr<web_client_request>> requests;
+            /* the first written ones of requests */
+            size_t written = 0;
+            bool connected = false;
+            /* connecting, or a write is pending or scheduled */
+            bool writing = false;
+            bool reading = false;
+            /* out of the pool, its handlers do nothing */
+            bool closed = false;
+            /* reused after being idle, write_requests checks it is still open before writing */
+            bool probe = false;
+            std::chrono::steady_clock::time_point last_used;
+        };
+        class basic_web_client;
+        /// @brief The connections and the queued requests of a basic_web_client. Every pending operation holds a reference to it,
+        /// so their handlers never run on a destroyed client.
+        class web_client_pool : public std::enable_shared_from_this<web_client_pool>
         {
         public:
-            basic_web_client(std::string __host);
-            ~basic_web_client();
-        protected:
+            web_client_pool(basic_web_client* __owner, std::string __host, std::string __protocol, web_client_pool_options __options);
+        private:
             std::string m_host;
             std::string m_protocol;
-            basic_socket m_socket;
+            web_client_pool_options m_options;
 
-            asio::streambuf m_buffer;
-            
+            /* guards the connections, m_retry_requests, popping m_requests_pipeline and the idle timer */
             std::mutex m_mutex;
+            std::vector<std::shared_ptr<web_client_connection>> m_connections;
             web_client_request_pipeline m_requests_pipeline;
+            /* sent before m_requests_pipeline, they were queued first */
+            std::deque<std::shared_ptr<web_client_request>> m_retry_requests;
+            /* set by shutdown, handlers still pending do nothing */
+            std::atomic<bool> m_shutdown = false;
 
-            std::unique_ptr<std::thread> m_pipeline_executer;
+            std::unique_ptr<asio::steady_timer> m_idle_timer;
+            bool m_idle_timer_armed = false;
 
-            http_message m_response_buffer;
-        protected:
-            void connect_if_is_not_open();
-            void connect_if_is_not_open_async(std::function<void()> success, std::function<void(error_code)> on_error = nullptr);
-            void enqueue_request(http_message __request, std::function<void(http_message)> __success, std::function<void(error_code)> __error = nullptr);
+            /* reset by shutdown. Recursive, the client may be destroyed from its own on_connection_error */
+            std::recursive_mutex m_owner_mutex;
+            basic_web_client* m_owner;
         private:
-            void write_front_request();
+            void connect_if_is_not_open_async(web_client_connection& connection, std::function<void()> success, std::function<void(error_code)> on_error = nullptr);
+            /// @brief Hands queued requests, in order, to connections with room for them, opening new ones up to max_connections.
+            void dispatch_requests();
+            /// @brief A connection with room for a request, or nullptr. m_mutex must be locked. Nothing is done on the connection sockets here,
+            /// an idle one is checked for reuse on its own io_context by write_requests.
+            std::shared_ptr<web_client_connection> checkout_connection(bool idempotent);
+            void open_connection(std::shared_ptr<web_client_connection> connection);
+            /// @brief Writes the requests of connection not yet written, one after the other. Runs on the connection io_context.
+            void write_requests(std::shared_ptr<web_client_connection> connection);
+            /// @brief Reads the responses of the written requests of connection, in order. Runs on the connection io_context.
+            void read_responses(std::shared_ptr<web_client_connection> connection);
+            /// @brief Takes connection out of the pool, found closed before anything was written to it. Its requests are sent again, whatever their method.
+            void requeue_requests(std::shared_ptr<web_client_connection> connection);
+            /// @brief Takes connection out of the pool. Its idempotent requests are sent again, the others fail with ec.
+            void close_connection(std::shared_ptr<web_client_connection> connection, const error_code& ec);
+            /// @brief m_mutex must be locked.
+            void schedule_idle_eviction();
+            void evict_idle_connections();
+            void notify_connection_error(const error_code& ec);
+        public:
+            /// @brief Opens min_connections. Must be called once, after the pool is owned by a shared_ptr.
+            void start();
+            void enqueue(std::shared_ptr<web_client_request> request);
+            /// @brief Closes every connection. Requests queued or in flight are dropped without calling their callbacks.
+            void shutdown();
+            size_t connection_count();
+        };
+        /// @brief A client to a single host. Requests are queued and each one goes to whichever pooled connection is free,
+        /// so up to max_connections * pipeline_depth requests are in flight at once. Responses of different connections may complete in any order.
+        /// Idempotent requests whose connection closes before their response are sent again, once, unless part of the body already went to on_chunk.
+        /// Destroying the client drops the requests still pending, their callbacks are not called.
+        class basic_web_client
+        {
+        public:
+            basic_web_client(std::string __host, web_client_pool_options __pool_options = web_client_pool_options());
+            ~basic_web_client();
+        protected:
+            std::string m_host;
+            std::string m_protocol;
+            std::shared_ptr<web_client_pool> m_pool;
+        protected:
+            void enqueue_request(http_message __request, std::function<void(http_message)> __success, std::function<void(error_code)> __error = nullptr, std::function<void(std::string_view)> __chunk = nullptr);
+        public:
+            /// @brief Connections in the pool, busy or not.
+            size_t connection_count();
         public:
             void get (const std::string& route, std::map<var, var> params, std::map<var, var> headers, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error = nullptr);
+            /// @brief Same as get, but the response body is delivered to on_chunk as it arrives and is not stored in the response passed to on_success.
+            void get (const std::string& route, std::map<var, var> params, std::map<var, var> headers, std::function<void(std::string_view)> on_chunk, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error = nullptr);
             void post(const std::string& route, std::map<var, var> body,   std::map<var, var> headers, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error = nullptr);
             void post(const std::string& route, std::string body, content_type type, std::map<var, var> headers, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error = nullptr);
+            /// @brief Posts a body produced by body, sent with chunked Transfer-Encoding.
+            void post(const std::string& route, body_generator body, content_type type, std::map<var, var> headers, std::function<void(http_message)> on_success, std::function<void(error_code)> on_error = nullptr);
         public:
             virtual void on_connection_error(const uva::networking::error_code& ec);
         }; // class basic_web_client